@@ -301,6 +301,9 @@ void sel_change_cb(Widget w, XtPointer pclient, XtPointer pcall)
 
 	show_selection_stats();
 	
+	prefetch_selection((cbd->count == 1 && S_ISDIR(cbd->item.mode)) ?
+		cbd->item.name : NULL);
+	
 	if(cbd->count == 1) {
 		struct file_type_rec *ft = NULL;
 		char *file_name = cbd->item.name;
@@ -894,13 +897,26 @@ void set_filter_cb(Widget w, XtPointer pclient, XtPointer pcall)
 {
 	Boolean need_refresh = app_inst.filter ? True : False;
 	char *input;
-
-	input = input_string_dlg(app_inst.wshell, "Filter",
-		"Specify a pattern", app_inst.filter, "filter", ISF_PRESELECT);
+	char *retry = NULL;
+	
+	get_input: /* on invalid expression below */
+	input = input_string_dlg(app_inst.wshell, "Filter", "Specify a pattern",
+		retry ? retry : app_inst.filter, "filter", ISF_PRESELECT);
+	
+	if(retry) {
+		free(retry);
+		retry = NULL;
+	}
 
 	if(input) need_refresh = True;
 	
-	set_filter(input);
+	if(set_filter(input)) {
+		va_message_box(app_inst.wshell, MB_ERROR, APP_TITLE,
+			"Invalid filter expression \"%s\".", input);
+		retry = input;
+		goto get_input;
+	}
+	if(input) free(input);
 	if(need_refresh) reread();
 }
 
@@ -972,21 +988,10 @@ void dbinfo_cb(Widget w, XtPointer pclient, XtPointer pcall)
 void path_change_cb(Widget w, XtPointer pclient, XtPointer pcall)
 {
 	struct path_field_cb_data *cbd = (struct path_field_cb_data*) pcall;
-	struct stat st;
 	
-	if(stat(cbd->value, &st) == -1) {
-		va_message_box(app_inst.wshell, MB_ERROR, APP_TITLE,
-			"Error accessing \'%s\'\n%s.",cbd->value, strerror(errno));	
-		cbd->accept = False;
-	} else if(!S_ISDIR(st.st_mode)) {
-		va_message_box(app_inst.wshell, MB_ERROR, APP_TITLE,
-			"Specified path \'%s\' is not a directory.",cbd->value);
-		cbd->accept = False;
-	} else if(!set_location(cbd->value, True)) {
-		cbd->accept = True;
-	} else {
-		cbd->accept = False;
-	}
+	/* the location is checked asynchronously; if it turns out to be
+	 * inaccessible, the field is reset to the current one then */
+	cbd->accept = set_location(cbd->value, True) ? False : True;
 }
 
 /*
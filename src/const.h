@@ -24,6 +24,7 @@
 #define HIST_SUBDIR "history"
 #define DB_SUBDIR "types"
 #define PM_SUBDIR "icons"
+#define SNAP_SUBDIR "cache"
 #define DB_SUFFIX ".db"
 
 /* Alternate invocation to just open files from db */
@@ -32,6 +33,27 @@
 /* Default update polling interval */
 #define DEF_REFRESH_INT 4
 
+/* Default and maximum number of directory reader threads */
+#define DEF_READER_THREADS 4
+#define MAX_READER_THREADS 64
+
+/* Default listing cache size in KB */
+#define DEF_LISTING_CACHE 8192
+
+/* Default reader shared message buffer size in KB */
+#define DEF_READER_BUFFER 1024
+
+/* Default directory prefetch delay in ms (0 disables prefetching) */
+#define DEF_PREFETCH_DELAY 0
+
+/* Default time in seconds after which an unresponsive location
+ * is reported, and a partial listing shown (0 disables that) */
+#define DEF_READ_TIMEOUT 10
+
+/* Default minimum number of items a directory listing must have
+ * to be saved on disk when left (0 disables saving listings) */
+#define DEF_SAVED_LISTING_MIN 500
+
 /* Default history limit */
 #define DEF_HISTORY_MAX 8
 
@@ -60,6 +82,14 @@
 #define CONFIRM_ALWAYS 1
 #define CONFIRM_MULTI 2
 
+/* Directory size field resource strings and constants */
+#define CS_DSIZE_NONE "none"
+#define CS_DSIZE_COUNT "count"
+#define CS_DSIZE_TOTAL "total"
+#define DSIZE_NONE 0
+#define DSIZE_COUNT 1
+#define DSIZE_TOTAL 2
+
 /* Icons size resource strings */
 #define CS_ICON_AUTO	"auto"
 #define CS_ICON_TINY	"tiny"
@@ -0,0 +1,299 @@
+/*
+ * Copyright (C) 2026 alx@fastestcode.org
+ * This software is distributed under the terms of the X/MIT license.
+ * See the included COPYING file for further information.
+ */
+
+/*
+ * Cache of recently visited directory listings
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "dircache.h"
+#include "debug.h"
+
+/* Listing growth increments */
+#define DLIST_RECS_GROW 256
+#define DLIST_NAMES_GROW 8192
+
+/* Local prototypes */
+static struct dir_cache_ent* put_ent(const char *path,
+	const struct stat *st, size_t size);
+static void unlink_ent(struct dir_cache_ent*);
+static void evict(size_t);
+
+/* Local variables */
+static struct dir_cache_ent *head = NULL; /* most recently used */
+static struct dir_cache_ent *tail = NULL;
+static size_t max_size = 0;
+static size_t cur_size = 0;
+static unsigned int nents = 0;
+
+#ifdef DEBUG
+static unsigned long nhits = 0;
+static unsigned long nmisses = 0;
+static unsigned long nevicted = 0;
+#endif
+
+
+void dcache_init(size_t size)
+{
+	max_size = size;
+	evict(max_size);
+}
+
+int dcache_put(const char *path, const struct stat *st,
+	struct file_list_snapshot *snap, unsigned int nfiles_shown,
+	unsigned int nfiles_hidden, const struct fsize *size_shown)
+{
+	struct dir_cache_ent *ent;
+	size_t size;
+	
+	size = sizeof(struct dir_cache_ent) + strlen(path) + 1 +
+		file_list_snapshot_size(snap);
+
+	if(size > max_size) {
+		file_list_free_snapshot(snap);
+		return ENOSPC;
+	}
+	
+	ent = put_ent(path, st, size);
+	if(!ent) {
+		file_list_free_snapshot(snap);
+		return ENOMEM;
+	}
+	
+	ent->snap = snap;
+	ent->nfiles_shown = nfiles_shown;
+	ent->nfiles_hidden = nfiles_hidden;
+	ent->size_shown = *size_shown;
+
+	return 0;
+}
+
+int dcache_put_listing(const char *path, const struct stat *st,
+	struct dir_listing *listing)
+{
+	struct dir_cache_ent *ent;
+	size_t size;
+	
+	size = sizeof(struct dir_cache_ent) + strlen(path) + 1 +
+		dlist_size(listing);
+
+	if(size > max_size) {
+		dlist_free(listing);
+		return ENOSPC;
+	}
+	
+	ent = put_ent(path, st, size);
+	if(!ent) {
+		dlist_free(listing);
+		return ENOMEM;
+	}
+	
+	ent->listing = listing;
+	ent->nfiles_shown = listing->totals.files_total;
+	ent->nfiles_hidden = listing->totals.files_skipped;
+	ent->size_shown = listing->totals.size_total;
+
+	return 0;
+}
+
+Boolean dcache_has(const char *path)
+{
+	struct dir_cache_ent *ent;
+	
+	for(ent = head; ent; ent = ent->next) {
+		if(!strcmp(ent->path, path)) return True;
+	}
+	return False;
+}
+
+struct dir_cache_ent* dcache_take(const char *path, const struct stat *st)
+{
+	struct dir_cache_ent *ent;
+	
+	for(ent = head; ent; ent = ent->next) {
+		if(!strcmp(ent->path, path)) break;
+	}
+	
+	if(!ent) {
+		#ifdef DEBUG
+		if(st) nmisses++;
+		#endif
+		return NULL;
+	}
+	
+	unlink_ent(ent);
+	
+	if(st && (ent->device != st->st_dev || ent->inode != st->st_ino ||
+		ent->mtime.tv_sec != st->st_mtim.tv_sec ||
+		ent->mtime.tv_nsec != st->st_mtim.tv_nsec)) {
+		/* changed since cached */
+		dcache_free(ent);
+		#ifdef DEBUG
+		nmisses++;
+		#endif
+		dbg_printf("dcache: %s is out of date\n", path);
+		return NULL;
+	}
+
+	#ifdef DEBUG
+	if(st) {
+		nhits++;
+		dbg_printf("dcache: hit %s, %lu hits, %lu misses, %lu evicted\n",
+			path, nhits, nmisses, nevicted);
+	}
+	#endif
+	return ent;
+}
+
+void dcache_free(struct dir_cache_ent *ent)
+{
+	if(ent->snap) file_list_free_snapshot(ent->snap);
+	if(ent->listing) dlist_free(ent->listing);
+	free(ent->path);
+	free(ent);
+}
+
+void dcache_flush(void)
+{
+	evict(0);
+}
+
+struct dir_listing* dlist_create(void)
+{
+	return calloc(1, sizeof(struct dir_listing));
+}
+
+int dlist_add(struct dir_listing *l,
+	const struct msg_data *msg, const char *name)
+{
+	size_t len = strlen(name) + 1;
+	
+	if(l->nrecs == l->recs_size) {
+		struct dir_listing_rec *p;
+		
+		p = realloc(l->recs, sizeof(struct dir_listing_rec) *
+			(l->recs_size + DLIST_RECS_GROW));
+		if(!p) return errno;
+		l->recs = p;
+		l->recs_size += DLIST_RECS_GROW;
+	}
+	
+	if(l->names_len + len > l->names_size) {
+		size_t size = l->names_size +
+			((len > DLIST_NAMES_GROW) ? len : DLIST_NAMES_GROW);
+		char *p;
+		
+		p = realloc(l->names, size);
+		if(!p) return errno;
+		l->names = p;
+		l->names_size = size;
+	}
+	
+	l->recs[l->nrecs].msg = *msg;
+	l->recs[l->nrecs].name = l->names_len;
+	memcpy(l->names + l->names_len, name, len);
+	l->names_len += len;
+	l->nrecs++;
+
+	return 0;
+}
+
+size_t dlist_size(const struct dir_listing *l)
+{
+	return sizeof(struct dir_listing) + l->names_size +
+		sizeof(struct dir_listing_rec) * l->recs_size;
+}
+
+void dlist_free(struct dir_listing *l)
+{
+	if(l->recs) free(l->recs);
+	if(l->names) free(l->names);
+	free(l);
+}
+
+/*
+ * Allocates a new entry for path, replacing the old one, if any,
+ * and places it at the head of the list, making room for size bytes.
+ * Returns NULL if there's not enough memory.
+ */
+static struct dir_cache_ent* put_ent(const char *path,
+	const struct stat *st, size_t size)
+{
+	struct dir_cache_ent *ent;
+
+	/* replace the old one, if any */
+	ent = dcache_take(path, NULL);
+	if(ent) dcache_free(ent);
+	
+	ent = calloc(1, sizeof(struct dir_cache_ent));
+	if(ent) ent->path = strdup(path);
+
+	if(!ent || !ent->path) {
+		if(ent) free(ent);
+		return NULL;
+	}
+	
+	evict(max_size - size);
+
+	ent->device = st->st_dev;
+	ent->inode = st->st_ino;
+	ent->mtime = st->st_mtim;
+	ent->size = size;
+	
+	ent->prev = NULL;
+	ent->next = head;
+	if(head) head->prev = ent;
+	head = ent;
+	if(!tail) tail = ent;
+	
+	cur_size += size;
+	nents++;
+	
+	dbg_printf("dcache: put %s (%lu bytes), %u entries, %lu bytes total\n",
+		path, (unsigned long)size, nents, (unsigned long)cur_size);
+
+	return ent;
+}
+
+/*
+ * Removes the entry from the cache list, without freeing it
+ */
+static void unlink_ent(struct dir_cache_ent *ent)
+{
+	if(ent->prev)
+		ent->prev->next = ent->next;
+	else
+		head = ent->next;
+	
+	if(ent->next)
+		ent->next->prev = ent->prev;
+	else
+		tail = ent->prev;
+	
+	cur_size -= ent->size;
+	nents--;
+}
+
+/*
+ * Evicts least recently used entries until no more than size bytes are used
+ */
+static void evict(size_t size)
+{
+	while(tail && cur_size > size) {
+		struct dir_cache_ent *ent = tail;
+		
+		unlink_ent(ent);
+		#ifdef DEBUG
+		nevicted++;
+		dbg_printf("dcache: evicted %s, %u entries, %lu bytes total, "
+			"%lu evicted\n", ent->path, nents,
+			(unsigned long)cur_size, nevicted);
+		#endif
+		dcache_free(ent);
+	}
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2026 alx@fastestcode.org
+ * This software is distributed under the terms of the X/MIT license.
+ * See the included COPYING file for further information.
+ */
+
+/*
+ * Cache of recently visited directory listings. Entries are file list
+ * snapshots, keyed by path and directory identity (device, inode and
+ * modification time), kept in most recently used order and evicted
+ * once the memory limit is exceeded. Listings of directories that were
+ * prefetched, but not visited yet, are kept as reader messages.
+ */
+
+#ifndef DIRCACHE_H
+#define DIRCACHE_H
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "listw.h"
+#include "fsutil.h"
+#include "rdmsg.h"
+
+/* Directory listing, as sent by the reader */
+struct dir_listing_rec {
+	struct msg_data msg;
+	size_t name; /* offset in dir_listing.names */
+};
+
+struct dir_listing {
+	struct dir_listing_rec *recs;
+	unsigned int nrecs;
+	unsigned int recs_size;
+	char *names;
+	size_t names_len;
+	size_t names_size;
+	struct msg_data totals; /* MSG_EOD */
+};
+
+#define dlist_name(l, r) ((l)->names + (r)->name)
+
+struct dir_cache_ent {
+	struct dir_cache_ent *prev;
+	struct dir_cache_ent *next;
+	char *path;
+	dev_t device;
+	ino_t inode;
+	struct timespec mtime;
+	size_t size;
+	struct file_list_snapshot *snap;
+	struct dir_listing *listing; /* if there's no snapshot */
+	unsigned int nfiles_shown;
+	unsigned int nfiles_hidden;
+	struct fsize size_shown;
+};
+
+/*
+ * Sets the memory limit in bytes. Zero disables caching.
+ */
+void dcache_init(size_t max_size);
+
+/*
+ * Adds a listing for the directory at path, with st being what stat
+ * returned for it, replacing any previous one. The snapshot is owned
+ * by the cache afterwards, even if this fails.
+ * Returns zero on success, errno otherwise.
+ */
+int dcache_put(const char *path, const struct stat *st,
+	struct file_list_snapshot *snap, unsigned int nfiles_shown,
+	unsigned int nfiles_hidden, const struct fsize *size_shown);
+
+/*
+ * Same as dcache_put, for a listing that wasn't shown yet. The listing is
+ * owned by the cache afterwards, even if this fails.
+ */
+int dcache_put_listing(const char *path, const struct stat *st,
+	struct dir_listing *listing);
+
+/*
+ * Returns True if there is a listing for path in the cache,
+ * whether or not it's up to date.
+ */
+Boolean dcache_has(const char *path);
+
+/*
+ * Removes the listing for path from the cache and returns it, or NULL
+ * if there's none, or the directory changed since it was cached (st
+ * is NULL if that doesn't matter). The entry must be freed with dcache_free.
+ */
+struct dir_cache_ent* dcache_take(const char *path, const struct stat *st);
+
+/*
+ * Frees a cache entry, and the snapshot or listing it holds, if any.
+ */
+void dcache_free(struct dir_cache_ent*);
+
+/*
+ * Discards all cached listings.
+ */
+void dcache_flush(void);
+
+/*
+ * Allocates an empty listing. Returns NULL on error.
+ */
+struct dir_listing* dlist_create(void);
+
+/*
+ * Appends a message and name to the listing.
+ * Returns zero on success, errno otherwise.
+ */
+int dlist_add(struct dir_listing*, const struct msg_data*, const char *name);
+
+/*
+ * Returns the amount of memory used by the listing
+ */
+size_t dlist_size(const struct dir_listing*);
+
+void dlist_free(struct dir_listing*);
+
+#endif /* DIRCACHE_H */
@@ -0,0 +1,581 @@
+/*
+ * Copyright (C) 2026 alx@fastestcode.org
+ * This software is distributed under the terms of the X/MIT license.
+ * See the included COPYING file for further information.
+ */
+
+/*
+ * Subdirectory sizing process
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <poll.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#include "dirsize.h"
+#include "dirtab.h"
+#include "rdmsg.h"
+#include "fsutil.h"
+#include "debug.h"
+
+/* Nice value for the sizing process */
+#ifndef DS_NICE
+#define DS_NICE 15
+#endif
+
+/* Linux I/O priority for the sizing process (idle class) */
+#define DS_IOPRIO_WHO_PROCESS 1
+#define DS_IOPRIO_IDLE (3 << 13)
+
+/* Number of entries walked between checks for commands */
+#ifndef DS_CMD_CHECK
+#define DS_CMD_CHECK 512
+#endif
+
+/* How long (in ms) results may be held back before being sent off */
+#ifndef DS_FLUSH_INT
+#define DS_FLUSH_INT 100
+#endif
+
+/* Number of directories results are kept for (the cache is emptied
+ * once it gets that full) */
+#ifndef DS_CACHE_MAX
+#define DS_CACHE_MAX 8192
+#endif
+
+/* Directories nested deeper than this aren't walked into */
+#ifndef DS_DEPTH_MAX
+#define DS_DEPTH_MAX 64
+#endif
+
+/* Initial number of cache slots (must be a power of two) */
+#define DS_CACHE_INIT 256
+
+/* Sizing results, by directory identity */
+struct ds_ent {
+	dev_t dev;
+	ino_t ino;
+	time_t mtime;
+	unsigned int nents; /* entries in it */
+	unsigned int ndots; /* of these, dot files */
+	off_t size; /* total, -1 if not known */
+	int used;
+};
+
+/* Sizing process state */
+struct ds_state {
+	int in_fd;
+	struct rdm_receiver in;
+	struct rdm_sender out;
+	char *path; /* directory being sized */
+	int dfd; /* and its descriptor, -1 if none */
+	unsigned int flags; /* CMD_SIZE_BASE flags */
+	char **queue; /* names to be sized, the next one last */
+	size_t nqueued;
+	size_t queue_size;
+	struct dir_tab done; /* names sized, or being sized */
+	int reset; /* the base changed while sizing */
+	int reported; /* MSG_EOD was sent since the queue emptied */
+	struct timespec flush_time; /* when pending results are due */
+	struct ds_ent *cache;
+	size_t cache_size;
+	size_t ncached;
+	unsigned int nwalked; /* entries walked, for command checks */
+};
+
+/* Local prototypes */
+static int read_commands(void);
+static int set_base(const char*, unsigned int, unsigned int);
+static int push_name(const char*);
+static void reverse_queue(size_t start);
+static void clear_queue(void);
+static int size_entry(const char*);
+static int count_entries(int, unsigned int*, unsigned int*);
+static int walk(int, dev_t, unsigned int, off_t*);
+static int send_result(const char*, const struct ds_ent*);
+static struct ds_ent* cache_find(dev_t, ino_t);
+static struct ds_ent* cache_slot(dev_t, ino_t);
+static void cache_clear(void);
+static int cache_grow(void);
+static long msecs_due(const struct timespec*);
+
+/* Sizing process state */
+static struct ds_state ds;
+
+int dsize_main(int in_fd, int out_fd)
+{
+	int res;
+
+	if(nice(DS_NICE) == -1) dbg_printf("%d: nice failed\n", getpid());
+	#if defined(__linux__) && defined(SYS_ioprio_set)
+	syscall(SYS_ioprio_set, DS_IOPRIO_WHO_PROCESS, 0, DS_IOPRIO_IDLE);
+	#endif
+
+	memset(&ds, 0, sizeof(struct ds_state));
+	ds.in_fd = in_fd;
+	ds.dfd = -1;
+	ds.reported = 1;
+
+	ds.cache = calloc(DS_CACHE_INIT, sizeof(struct ds_ent));
+	if(!ds.cache || rdm_init_receiver(&ds.in) || dtab_init(&ds.done))
+		return ENOMEM;
+	ds.cache_size = DS_CACHE_INIT;
+
+	rdm_init_sender(&ds.out, out_fd);
+	fcntl(in_fd, F_SETFL, O_NONBLOCK);
+
+	for(;;) {
+		struct pollfd pfd = { in_fd, POLLIN, 0 };
+
+		if(!ds.nqueued) {
+			if(ds.dfd != -1 && !ds.reported) {
+				struct msg_data msg;
+
+				memset(&msg, 0, sizeof(struct msg_data));
+				msg.reason = MSG_EOD;
+				res = rdm_put(&ds.out, &msg, NULL);
+				if(res) return res;
+				ds.reported = 1;
+			}
+			if(rdm_pending(&ds.out) && (res = rdm_flush(&ds.out)))
+				return res;
+		} else if(rdm_pending(&ds.out) && msecs_due(&ds.flush_time) <= 0) {
+			if( (res = rdm_flush(&ds.out)) ) return res;
+		}
+
+		res = poll(&pfd, 1, ds.nqueued ? 0 : -1);
+		if(res == -1 && errno != EINTR) return errno;
+
+		if(res > 0) {
+			res = read_commands();
+			if(res) return (res == EPIPE) ? 0 : res;
+		}
+
+		if(ds.nqueued) {
+			char *name = ds.queue[--ds.nqueued];
+
+			res = size_entry(name);
+			free(name);
+			if(res) return res;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Reads and processes commands from the GUI. Names received at once
+ * are queued ahead of the rest, in the order these were sent.
+ * Returns zero on success, errno otherwise (EPIPE if the GUI is gone).
+ */
+static int read_commands(void)
+{
+	struct msg_data msg;
+	const char *name;
+	size_t batch = ds.nqueued;
+	int res;
+
+	res = rdm_receive(&ds.in, ds.in_fd);
+
+	while((res == 0) && (res = rdm_next(&ds.in, &msg, &name)) > 0) {
+		res = 0;
+
+		switch(msg.reason) {
+			case CMD_SIZE_BASE:
+			res = set_base(name, msg.flags, rdm_tag(&ds.in));
+			batch = ds.nqueued;
+			break;
+
+			case CMD_SIZE:
+			if(ds.dfd == -1 || !name) break;
+
+			if(msg.flags & CF_RECHECK) {
+				struct dir_rec *rec = dtab_find(&ds.done, name);
+				if(rec) dtab_remove(&ds.done, rec);
+			} else if(dtab_find(&ds.done, name)) {
+				break;
+			}
+			res = push_name(name);
+			break;
+		}
+	}
+	if(res == -1) res = EINVAL;
+
+	reverse_queue(batch);
+
+	return res;
+}
+
+/*
+ * Sets the directory to be sized, and queues its subdirectories, as read.
+ * Nothing is sized on remote file systems, or if path is NULL.
+ * Returns zero on success, errno otherwise.
+ */
+static int set_base(const char *path, unsigned int flags, unsigned int tag)
+{
+	struct dirent *ent;
+	int fs_class;
+	DIR *dir;
+	int fd;
+
+	clear_queue();
+	dtab_clear(&ds.done);
+	rdm_retag(&ds.out, tag);
+	ds.reset = 1;
+	ds.reported = 1;
+	ds.flags = flags;
+
+	if(ds.dfd != -1) {
+		close(ds.dfd);
+		ds.dfd = -1;
+	}
+	if(ds.path) {
+		free(ds.path);
+		ds.path = NULL;
+	}
+
+	if(!path) return 0;
+
+	ds.dfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(ds.dfd == -1) return 0;
+
+	/* not worth the network traffic */
+	fs_class = get_fs_class(ds.dfd);
+	if(fs_class == FSC_REMOTE || fs_class == FSC_FUSE) {
+		close(ds.dfd);
+		ds.dfd = -1;
+		return 0;
+	}
+
+	ds.path = strdup(path);
+	if(!ds.path) return ENOMEM;
+
+	fd = dup(ds.dfd);
+	if(fd == -1 || !(dir = fdopendir(fd))) {
+		if(fd != -1) close(fd);
+		return 0;
+	}
+
+	while( (ent = readdir(dir)) ) {
+		const char *name = ent->d_name;
+
+		if(name[0] == '.' && (!(flags & CF_SHOW_ALL) || !name[1] ||
+			(name[1] == '.' && !name[2]))) continue;
+
+		#ifdef DT_UNKNOWN
+		if(ent->d_type != DT_DIR && ent->d_type != DT_LNK &&
+			ent->d_type != DT_UNKNOWN) continue;
+		#endif
+
+		if(push_name(name)) {
+			closedir(dir);
+			return ENOMEM;
+		}
+	}
+	closedir(dir);
+
+	reverse_queue(0);
+	ds.reported = 0;
+
+	dbg_trace("sizing %lu entries in %s\n", (unsigned long)ds.nqueued, path);
+
+	return 0;
+}
+
+static int push_name(const char *name)
+{
+	if(ds.nqueued == ds.queue_size) {
+		size_t size = ds.queue_size ? ds.queue_size * 2 : 64;
+		char **p = realloc(ds.queue, size * sizeof(char*));
+
+		if(!p) return ENOMEM;
+		ds.queue = p;
+		ds.queue_size = size;
+	}
+
+	ds.queue[ds.nqueued] = strdup(name);
+	if(!ds.queue[ds.nqueued]) return ENOMEM;
+	ds.nqueued++;
+	ds.reported = 0;
+
+	return 0;
+}
+
+/*
+ * Reverses names queued past start, so that these are taken in the order
+ * queued, ahead of any queued before
+ */
+static void reverse_queue(size_t start)
+{
+	size_t i = start, j = ds.nqueued;
+
+	while(j > i + 1) {
+		char *tmp = ds.queue[i];
+
+		ds.queue[i++] = ds.queue[--j];
+		ds.queue[j] = tmp;
+	}
+}
+
+static void clear_queue(void)
+{
+	while(ds.nqueued) free(ds.queue[--ds.nqueued]);
+}
+
+/*
+ * Sizes the named entry of the base directory, if it is a directory, and
+ * sends the results. With CF_RECURSIVE, the entry count is sent ahead of
+ * the total size, which may take a while. Returns zero or errno.
+ */
+static int size_entry(const char *name)
+{
+	struct ds_ent *ent;
+	struct stat st;
+	off_t size;
+	int res, fd;
+
+	if(dtab_find(&ds.done, name)) return 0;
+	if(!dtab_add(&ds.done, name)) return ENOMEM;
+
+	if(fstatat(ds.dfd, name, &st, 0) == -1 || !S_ISDIR(st.st_mode))
+		return 0;
+
+	ent = cache_find(st.st_dev, st.st_ino);
+
+	if(!ent->used || ent->mtime != st.st_mtime) {
+		unsigned int nents = 0, ndots = 0;
+
+		fd = openat(ds.dfd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if(fd == -1 || count_entries(fd, &nents, &ndots)) return 0;
+
+		if(!ent->used) ds.ncached++;
+		ent->used = 1;
+		ent->dev = st.st_dev;
+		ent->ino = st.st_ino;
+		ent->mtime = st.st_mtime;
+		ent->nents = nents;
+		ent->ndots = ndots;
+		ent->size = -1;
+	}
+
+	res = send_result(name, ent);
+	if(res || !(ds.flags & CF_RECURSIVE) || ent->size != -1) return res;
+
+	fd = openat(ds.dfd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(fd == -1) return 0;
+
+	ds.reset = 0;
+	ds.nwalked = 0;
+	size = 0;
+	res = walk(fd, st.st_dev, 0, &size);
+
+	/* the base changed while walking */
+	if(ds.reset || res) return (res == ENOMEM) ? res : 0;
+
+	/* the same again, now with the size */
+	ent->size = size;
+	return send_result(name, ent);
+}
+
+/*
+ * Counts entries of the directory fd, which is closed. Returns zero on
+ * success, errno otherwise.
+ */
+static int count_entries(int fd, unsigned int *nents, unsigned int *ndots)
+{
+	struct dirent *ent;
+	DIR *dir;
+
+	if( !(dir = fdopendir(fd)) ) {
+		close(fd);
+		return errno;
+	}
+
+	*nents = 0;
+	*ndots = 0;
+
+	while( (ent = readdir(dir)) ) {
+		const char *name = ent->d_name;
+
+		if(name[0] == '.') {
+			if(!name[1] || (name[1] == '.' && !name[2])) continue;
+			(*ndots)++;
+		}
+		(*nents)++;
+	}
+	closedir(dir);
+
+	return 0;
+}
+
+/*
+ * Adds sizes of files under the directory fd, which is closed, to *size,
+ * not crossing file system boundaries. Returns zero on success, errno
+ * otherwise, or -1 if the walk was cut short since the base changed.
+ */
+static int walk(int fd, dev_t dev, unsigned int depth, off_t *size)
+{
+	struct dirent *ent;
+	struct stat st;
+	DIR *dir;
+	int res = 0;
+
+	if( !(dir = fdopendir(fd)) ) {
+		close(fd);
+		return errno;
+	}
+
+	while(!res && (ent = readdir(dir))) {
+		const char *name = ent->d_name;
+		int sub_fd;
+
+		if(name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2])))
+			continue;
+
+		/* what the GUI wants to see next may be queued meanwhile,
+		 * and the walk is abandoned if the base changes */
+		if(!(++ds.nwalked % DS_CMD_CHECK)) {
+			struct pollfd pfd = { ds.in_fd, POLLIN, 0 };
+
+			/* errors are picked up again in the main loop */
+			if(poll(&pfd, 1, 0) > 0 && read_commands()) ds.reset = 1;
+			if(ds.reset) {
+				res = -1;
+				break;
+			}
+		}
+
+		if(fstatat(dirfd(dir), name, &st, AT_SYMLINK_NOFOLLOW) == -1)
+			continue;
+
+		if(S_ISREG(st.st_mode)) {
+			*size += st.st_size;
+		} else if(S_ISDIR(st.st_mode) && st.st_dev == dev &&
+			depth < DS_DEPTH_MAX) {
+			sub_fd = openat(dirfd(dir), name,
+				O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+			if(sub_fd == -1) continue;
+
+			res = walk(sub_fd, dev, depth + 1, size);
+			/* unreadable subdirectories are left out */
+			if(res > 0 && res != ENOMEM) res = 0;
+		}
+	}
+	closedir(dir);
+
+	return res;
+}
+
+/*
+ * Queues a MSG_DIRSIZE message for name. Results are sent off once
+ * there's nothing else to do, or DS_FLUSH_INT ms after the first
+ * one pending. Returns zero on success, errno otherwise.
+ */
+static int send_result(const char *name, const struct ds_ent *ent)
+{
+	struct msg_data msg;
+
+	memset(&msg, 0, sizeof(struct msg_data));
+	msg.reason = MSG_DIRSIZE;
+	msg.fields = MF_TOTALS;
+	msg.files_total = (ds.flags & CF_SHOW_ALL) ?
+		ent->nents : (ent->nents - ent->ndots);
+	init_fsize(&msg.size_total);
+	if(ent->size != -1 && (ds.flags & CF_RECURSIVE)) {
+		msg.fields |= MF_SIZE;
+		msg.size = ent->size;
+	}
+
+	if(!rdm_pending(&ds.out)) {
+		clock_gettime(CLOCK_MONOTONIC, &ds.flush_time);
+		ds.flush_time.tv_nsec += (long)DS_FLUSH_INT * 1000000;
+		if(ds.flush_time.tv_nsec >= 1000000000) {
+			ds.flush_time.tv_sec++;
+			ds.flush_time.tv_nsec -= 1000000000;
+		}
+	}
+
+	return rdm_put(&ds.out, &msg, name);
+}
+
+/*
+ * Returns the cache entry for the directory specified, or the vacant
+ * one it's to be put in, making room as needed.
+ */
+static struct ds_ent* cache_find(dev_t dev, ino_t ino)
+{
+	/* the table is kept no more than half full */
+	if((ds.ncached + 1) * 2 > ds.cache_size) {
+		if(ds.ncached >= DS_CACHE_MAX || cache_grow()) cache_clear();
+	}
+	return cache_slot(dev, ino);
+}
+
+/*
+ * Returns the cache entry for the directory specified,
+ * or the vacant slot it's to be put in if there's none.
+ */
+static struct ds_ent* cache_slot(dev_t dev, ino_t ino)
+{
+	size_t mask = ds.cache_size - 1;
+	size_t i = ((size_t)ino * 2654435761U ^ (size_t)dev) & mask;
+
+	while(ds.cache[i].used) {
+		if(ds.cache[i].ino == ino && ds.cache[i].dev == dev) break;
+		i = (i + 1) & mask;
+	}
+	return &ds.cache[i];
+}
+
+static void cache_clear(void)
+{
+	dbg_trace("clearing %lu size cache entries\n", (unsigned long)ds.ncached);
+
+	memset(ds.cache, 0, ds.cache_size * sizeof(struct ds_ent));
+	ds.ncached = 0;
+}
+
+/*
+ * Doubles the number of cache slots. Returns zero on success, errno otherwise.
+ */
+static int cache_grow(void)
+{
+	struct ds_ent *old = ds.cache;
+	size_t old_size = ds.cache_size;
+	size_t i;
+
+	ds.cache = calloc(old_size * 2, sizeof(struct ds_ent));
+	if(!ds.cache) {
+		ds.cache = old;
+		return ENOMEM;
+	}
+	ds.cache_size = old_size * 2;
+
+	for(i = 0; i < old_size; i++) {
+		if(old[i].used) *cache_slot(old[i].dev, old[i].ino) = old[i];
+	}
+	free(old);
+
+	return 0;
+}
+
+/*
+ * Returns milliseconds until the time specified (negative if it's past)
+ */
+static long msecs_due(const struct timespec *ts)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (ts->tv_sec - now.tv_sec) * 1000 +
+		(ts->tv_nsec - now.tv_nsec) / 1000000;
+}
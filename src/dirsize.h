@@ -0,0 +1,31 @@
+/*
+ * Copyright (C) 2026 alx@fastestcode.org
+ * This software is distributed under the terms of the X/MIT license.
+ * See the included COPYING file for further information.
+ */
+
+/*
+ * Subdirectory sizing process. Counts entries in, and optionally totals
+ * sizes of files under, subdirectories of the location being shown, at
+ * low CPU and I/O priority, so that these can be shown in the size field
+ * instead of directory inode sizes. It's told the location to size with
+ * CMD_SIZE_BASE, sizes subdirectories named by CMD_SIZE ahead of the rest
+ * (the GUI sends those that can be seen), and reports each with a
+ * MSG_DIRSIZE message, followed by MSG_EOD once all are done. Results are
+ * kept by directory identity and modification time, so that unchanged
+ * directories are reported right away when seen again. Total sizes are
+ * only as current as the directory itself, since changes deeper down
+ * don't affect its modification time.
+ */
+
+#ifndef DIRSIZE_H
+#define DIRSIZE_H
+
+/*
+ * Sizing process entry point. Reads commands from in_fd and writes
+ * results to out_fd until in_fd is closed. Returns zero on success,
+ * errno otherwise.
+ */
+int dsize_main(int in_fd, int out_fd);
+
+#endif /* DIRSIZE_H */
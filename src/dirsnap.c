@@ -0,0 +1,479 @@
+/*
+ * Copyright (C) 2026 alx@fastestcode.org
+ * This software is distributed under the terms of the X/MIT license.
+ * See the included COPYING file for further information.
+ */
+
+/*
+ * Directory listing snapshots saved on disk
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "dirsnap.h"
+#include "path.h"
+#include "debug.h"
+
+/* Number of snapshot files kept */
+#ifndef DSNAP_MAX_FILES
+#define DSNAP_MAX_FILES 64
+#endif
+
+/* Snapshot file name suffix */
+#define DSNAP_SUFFIX ".snap"
+
+/* Snapshots are written to a uniquely named temporary file first, and
+ * renamed on commit; ones left behind are removed after DSNAP_TMP_AGE */
+#define DSNAP_TMP_INFIX ".tmp."
+#define DSNAP_TMP_SUFFIX DSNAP_TMP_INFIX "XXXXXX"
+#ifndef DSNAP_TMP_AGE
+#define DSNAP_TMP_AGE 3600
+#endif
+
+/* Identifies the format, and the size of the structures below, since
+ * these are written as they are, and only read by the same build */
+#define DSNAP_MAGIC (0x58530000u | \
+	((sizeof(struct dsnap_header) + sizeof(struct dsnap_rec)) & 0xFFFF))
+
+struct dsnap_header {
+	unsigned int magic;
+	unsigned int key;
+	unsigned int nrecs;
+	unsigned int path_len; /* including the NUL, follows the header */
+	dev_t device;
+	ino_t inode;
+	struct msg_data totals;
+};
+
+struct dsnap_rec {
+	off_t size;
+	time_t mtime;
+	time_t ctime;
+	mode_t mode;
+	uid_t uid;
+	gid_t gid;
+	int db_index;
+	unsigned int name_len; /* including the NUL, follows the record */
+	unsigned short flags; /* MF_SYMLINK, MF_MPOINT and MF_MOUNTED */
+	unsigned char icon;
+};
+
+/* Records and names that follow are aligned to this */
+#define DSNAP_ALIGN sizeof(off_t)
+#define align(n) (((n) + DSNAP_ALIGN - 1) & ~(DSNAP_ALIGN - 1))
+
+/* Local prototypes */
+static char* snap_path(const char *path, const char *suffix);
+static unsigned int hash_bytes(unsigned int, const void*, size_t);
+static void prune(void);
+static int mtime_cmp(const void*, const void*);
+
+/* Local variables */
+static char *snap_dir = NULL;
+static int dir_checked = 0;
+
+
+int dsnap_init(const char *dir)
+{
+	char *p = NULL;
+
+	if(dir) {
+		p = strdup(dir);
+		if(!p) return errno;
+	}
+	free(snap_dir);
+	snap_dir = p;
+	dir_checked = 0;
+
+	return 0;
+}
+
+int dsnap_enabled(void)
+{
+	return (snap_dir != NULL);
+}
+
+unsigned int dsnap_key(unsigned int db_hash,
+	unsigned int filter_flags, const char *filter)
+{
+	unsigned int hash = hash_bytes(db_hash,
+		&filter_flags, sizeof(unsigned int));
+
+	if(filter) hash = hash_bytes(hash, filter, strlen(filter));
+
+	return hash;
+}
+
+int dsnap_create(struct dsnap_writer *w, const char *path,
+	const struct stat *st, unsigned int key)
+{
+	static const char pad[DSNAP_ALIGN] = { 0 };
+	struct dsnap_header hdr;
+	size_t len = strlen(path) + 1;
+	int fd;
+
+	memset(w, 0, sizeof(struct dsnap_writer));
+	if(!snap_dir) return EINVAL;
+
+	if(!dir_checked) {
+		int res = create_hier(snap_dir, S_IRUSR | S_IWUSR | S_IXUSR);
+		if(res) return res;
+		dir_checked = 1;
+	}
+
+	w->path = snap_path(path, DSNAP_SUFFIX);
+	w->tmp_path = snap_path(path, DSNAP_TMP_SUFFIX);
+	if(!w->path || !w->tmp_path) {
+		dsnap_abort(w);
+		return ENOMEM;
+	}
+
+	/* another instance may be writing the same snapshot */
+	fd = mkstemp(w->tmp_path);
+	if(fd == -1 || !(w->file = fdopen(fd, "w"))) {
+		int errv = errno;
+		if(fd != -1) {
+			close(fd);
+			unlink(w->tmp_path);
+		}
+		dsnap_abort(w);
+		return errv;
+	}
+
+	/* rewritten with the record count and totals on commit */
+	memset(&hdr, 0, sizeof(struct dsnap_header));
+	hdr.key = key;
+	hdr.path_len = len;
+	hdr.device = st->st_dev;
+	hdr.inode = st->st_ino;
+
+	if(fwrite(&hdr, sizeof(struct dsnap_header), 1, w->file) != 1 ||
+		fwrite(path, 1, len, w->file) != len ||
+		fwrite(pad, 1, align(len) - len, w->file) != align(len) - len) {
+		int errv = errno ? errno : EIO;
+		dsnap_abort(w);
+		return errv;
+	}
+
+	return 0;
+}
+
+void dsnap_add(struct dsnap_writer *w,
+	const struct msg_data *msg, const char *name)
+{
+	static const char pad[DSNAP_ALIGN] = { 0 };
+	struct dsnap_rec rec;
+	size_t len = strlen(name) + 1;
+
+	if(w->err) return;
+
+	memset(&rec, 0, sizeof(struct dsnap_rec));
+	rec.size = msg->size;
+	rec.mtime = msg->mtime;
+	rec.ctime = msg->ctime;
+	rec.mode = msg->mode;
+	rec.uid = msg->uid;
+	rec.gid = msg->gid;
+	rec.db_index = msg->db_index;
+	rec.name_len = len;
+	rec.flags = msg->flags & (MF_SYMLINK | MF_MPOINT | MF_MOUNTED);
+	rec.icon = msg->icon;
+
+	if(fwrite(&rec, sizeof(struct dsnap_rec), 1, w->file) != 1 ||
+		fwrite(name, 1, len, w->file) != len ||
+		fwrite(pad, 1, align(len) - len, w->file) != align(len) - len) {
+		w->err = errno ? errno : EIO;
+		return;
+	}
+	w->nrecs++;
+}
+
+int dsnap_commit(struct dsnap_writer *w, const struct msg_data *totals)
+{
+	struct dsnap_header hdr;
+	int res;
+
+	if(w->err) {
+		res = w->err;
+		dsnap_abort(w);
+		return res;
+	}
+
+	if(fflush(w->file)) {
+		res = errno;
+		dsnap_abort(w);
+		return res;
+	}
+
+	/* completed last, so that a partially written file is never valid */
+	if(pread(fileno(w->file), &hdr,
+		sizeof(struct dsnap_header), 0) != sizeof(struct dsnap_header)) {
+		dsnap_abort(w);
+		return EIO;
+	}
+	hdr.magic = DSNAP_MAGIC;
+	hdr.nrecs = w->nrecs;
+	hdr.totals = *totals;
+
+	if(pwrite(fileno(w->file), &hdr, sizeof(struct dsnap_header), 0) !=
+		sizeof(struct dsnap_header)) {
+		res = errno ? errno : EIO;
+		dsnap_abort(w);
+		return res;
+	}
+
+	res = fclose(w->file);
+	w->file = NULL;
+	if(res || rename(w->tmp_path, w->path)) {
+		res = errno;
+		dsnap_abort(w);
+		return res;
+	}
+
+	free(w->path);
+	free(w->tmp_path);
+	memset(w, 0, sizeof(struct dsnap_writer));
+
+	prune();
+	return 0;
+}
+
+void dsnap_abort(struct dsnap_writer *w)
+{
+	if(w->file) {
+		fclose(w->file);
+		unlink(w->tmp_path);
+	}
+	free(w->path);
+	free(w->tmp_path);
+	memset(w, 0, sizeof(struct dsnap_writer));
+}
+
+int dsnap_open(struct dsnap_reader *r, const char *path,
+	const struct stat *st, unsigned int key, struct msg_data *totals)
+{
+	const struct dsnap_header *hdr;
+	struct stat fst;
+	char *snap;
+	size_t len = strlen(path) + 1;
+	int fd;
+
+	memset(r, 0, sizeof(struct dsnap_reader));
+	if(!snap_dir) return ENOENT;
+
+	snap = snap_path(path, DSNAP_SUFFIX);
+	if(!snap) return ENOMEM;
+
+	fd = open(snap, O_RDONLY);
+	free(snap);
+	if(fd == -1) return errno;
+
+	if(fstat(fd, &fst) == -1 ||
+		fst.st_size < (off_t)(sizeof(struct dsnap_header) + align(len))) {
+		close(fd);
+		return ENOENT;
+	}
+
+	r->map_size = fst.st_size;
+	r->map = mmap(NULL, r->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if(r->map == MAP_FAILED) {
+		int errv = errno;
+		close(fd);
+		r->map = NULL;
+		return errv;
+	}
+
+	/* recently used ones are kept over others (see prune) */
+	futimens(fd, NULL);
+	close(fd);
+
+	hdr = r->map;
+
+	/* made by another build or with another key, for another directory
+	 * with the same name hash, or the directory was replaced since */
+	if(hdr->magic != DSNAP_MAGIC || hdr->key != key ||
+		hdr->device != st->st_dev || hdr->inode != st->st_ino ||
+		hdr->path_len != len ||
+		memcmp((char*)r->map + sizeof(struct dsnap_header), path, len)) {
+		dsnap_close(r);
+		return ENOENT;
+	}
+
+	r->next = sizeof(struct dsnap_header) + align(len);
+	r->nrecs = hdr->nrecs;
+	*totals = hdr->totals;
+
+	return 0;
+}
+
+int dsnap_next(struct dsnap_reader *r,
+	struct msg_data *msg, const char **name)
+{
+	struct dsnap_rec rec;
+	const char *p;
+
+	if(!r->nrecs) return 0;
+
+	if(r->map_size - r->next < sizeof(struct dsnap_rec)) return -1;
+	memcpy(&rec, (char*)r->map + r->next, sizeof(struct dsnap_rec));
+
+	p = (char*)r->map + r->next + sizeof(struct dsnap_rec);
+	if(!rec.name_len || rec.name_len > r->map_size - r->next -
+		sizeof(struct dsnap_rec) || p[rec.name_len - 1]) return -1;
+
+	memset(msg, 0, sizeof(struct msg_data));
+	msg->reason = MSG_ADD;
+	msg->fields = MF_MODE | MF_TIMES | MF_OWNER | MF_SIZE |
+		MF_DBINDEX | MF_ICON;
+	msg->flags = rec.flags;
+	msg->mode = rec.mode;
+	msg->ctime = rec.ctime;
+	msg->mtime = rec.mtime;
+	msg->uid = rec.uid;
+	msg->gid = rec.gid;
+	msg->db_index = rec.db_index;
+	msg->icon = rec.icon;
+	msg->size = rec.size;
+	*name = p;
+
+	r->next += sizeof(struct dsnap_rec) + align(rec.name_len);
+	r->nrecs--;
+
+	return 1;
+}
+
+void dsnap_close(struct dsnap_reader *r)
+{
+	if(r->map) munmap(r->map, r->map_size);
+	memset(r, 0, sizeof(struct dsnap_reader));
+}
+
+void dsnap_remove(const char *path)
+{
+	char *snap;
+
+	if(!snap_dir) return;
+
+	snap = snap_path(path, DSNAP_SUFFIX);
+	if(snap) {
+		unlink(snap);
+		free(snap);
+	}
+}
+
+/*
+ * Returns the snapshot file name for the directory at path.
+ * The string returned must be freed by the caller.
+ */
+static char* snap_path(const char *path, const char *suffix)
+{
+	char name[32];
+
+	/* collisions are told apart by the path in the header */
+	snprintf(name, sizeof(name), "%08x%s",
+		hash_bytes(2166136261u, path, strlen(path)), suffix);
+
+	return build_path(NULL, snap_dir, name, NULL);
+}
+
+/*
+ * FNV-1a hash step over len bytes
+ */
+static unsigned int hash_bytes(unsigned int hash, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+
+	while(len--) {
+		hash ^= *p++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+struct snap_file {
+	time_t mtime;
+	char *name;
+};
+
+/*
+ * Removes least recently used snapshots beyond DSNAP_MAX_FILES,
+ * and temporary files left behind by writers that didn't finish
+ */
+static void prune(void)
+{
+	struct snap_file *files = NULL;
+	size_t nfiles = 0, size = 0, i;
+	struct dirent *ent;
+	DIR *dir;
+	int dfd;
+	time_t now = time(NULL);
+
+	dir = opendir(snap_dir);
+	if(!dir) return;
+	dfd = dirfd(dir);
+
+	while((ent = readdir(dir))) {
+		size_t len = strlen(ent->d_name);
+		struct stat st;
+
+		if(len > strlen(DSNAP_TMP_SUFFIX) &&
+			!strncmp(ent->d_name + len - strlen(DSNAP_TMP_SUFFIX),
+			DSNAP_TMP_INFIX, strlen(DSNAP_TMP_INFIX))) {
+			if(!fstatat(dfd, ent->d_name, &st, AT_SYMLINK_NOFOLLOW) &&
+				S_ISREG(st.st_mode) && now - st.st_mtime > DSNAP_TMP_AGE) {
+				dbg_trace("removing stale %s\n", ent->d_name);
+				unlinkat(dfd, ent->d_name, 0);
+			}
+			continue;
+		}
+
+		if(len <= strlen(DSNAP_SUFFIX) || strcmp(ent->d_name +
+			len - strlen(DSNAP_SUFFIX), DSNAP_SUFFIX)) continue;
+
+		if(fstatat(dfd, ent->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1 ||
+			!S_ISREG(st.st_mode)) continue;
+
+		if(nfiles == size) {
+			struct snap_file *p = realloc(files,
+				(size + 64) * sizeof(struct snap_file));
+			if(!p) break;
+			files = p;
+			size += 64;
+		}
+		files[nfiles].name = strdup(ent->d_name);
+		if(!files[nfiles].name) break;
+		files[nfiles++].mtime = st.st_mtime;
+	}
+
+	if(nfiles > DSNAP_MAX_FILES) {
+		qsort(files, nfiles, sizeof(struct snap_file), mtime_cmp);
+
+		for(i = DSNAP_MAX_FILES; i < nfiles; i++) {
+			dbg_trace("removing snapshot %s\n", files[i].name);
+			unlinkat(dfd, files[i].name, 0);
+		}
+	}
+	closedir(dir);
+
+	for(i = 0; i < nfiles; i++) free(files[i].name);
+	free(files);
+}
+
+/* Most recent first */
+static int mtime_cmp(const void *pa, const void *pb)
+{
+	const struct snap_file *a = pa;
+	const struct snap_file *b = pb;
+
+	if(a->mtime == b->mtime) return 0;
+	return (a->mtime > b->mtime) ? -1 : 1;
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2026 alx@fastestcode.org
+ * This software is distributed under the terms of the X/MIT license.
+ * See the included COPYING file for further information.
+ */
+
+/*
+ * Directory listing snapshots saved on disk, so that a directory can be
+ * shown right away when xfile is started, while the reader revalidates
+ * its listing. Each snapshot is a file in the snapshot directory, named
+ * by a hash of the directory path, consisting of a header, the path, and
+ * records with names, as sent by the reader. Snapshots are keyed by the
+ * directory identity (device and inode) and by a hash of whatever else
+ * they depend on (see dsnap_key); ones that don't match are ignored.
+ * Files are read through a memory mapping, and the least recently used
+ * are removed once there are more than DSNAP_MAX_FILES.
+ */
+
+#ifndef DIRSNAP_H
+#define DIRSNAP_H
+
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "rdmsg.h"
+
+/* Snapshot being written */
+struct dsnap_writer {
+	FILE *file;
+	char *path; /* of the snapshot file */
+	char *tmp_path; /* written to first, and renamed on commit */
+	unsigned int nrecs;
+	int err;
+};
+
+/* Snapshot being read */
+struct dsnap_reader {
+	void *map;
+	size_t map_size;
+	size_t next; /* offset of the next record */
+	unsigned int nrecs; /* left to be read */
+};
+
+/*
+ * Sets the directory snapshots are kept in, created on first use.
+ * NULL disables snapshots. Returns zero on success, errno otherwise.
+ */
+int dsnap_init(const char *dir);
+
+/* Returns non-zero if snapshots are enabled */
+int dsnap_enabled(void);
+
+/*
+ * Returns a snapshot key for the type DB hash (see db_hash), and
+ * filter settings (CF_* flags and the filter expression, if any).
+ */
+unsigned int dsnap_key(unsigned int db_hash,
+	unsigned int filter_flags, const char *filter);
+
+/*
+ * Starts writing a snapshot of the directory at path, with st being what
+ * stat returned for it. Returns zero on success, errno otherwise.
+ */
+int dsnap_create(struct dsnap_writer*, const char *path,
+	const struct stat *st, unsigned int key);
+
+/*
+ * Adds a MSG_ADD message to the snapshot. Errors are reported on commit.
+ */
+void dsnap_add(struct dsnap_writer*, const struct msg_data*, const char *name);
+
+/*
+ * Completes the snapshot, with totals being the MSG_EOD message, replacing
+ * the previous one, if any. The writer is freed either way.
+ * Returns zero on success, errno otherwise.
+ */
+int dsnap_commit(struct dsnap_writer*, const struct msg_data *totals);
+
+/* Discards the snapshot being written */
+void dsnap_abort(struct dsnap_writer*);
+
+/*
+ * Opens the snapshot of the directory at path, if there is one for the
+ * same directory and key. Totals receives the MSG_EOD message saved.
+ * Returns zero on success, errno otherwise (ENOENT if there's none).
+ */
+int dsnap_open(struct dsnap_reader*, const char *path,
+	const struct stat *st, unsigned int key, struct msg_data *totals);
+
+/*
+ * Retrieves the next MSG_ADD message and name. Returns 1 on success,
+ * zero if there are no more, or -1 if the file is corrupt.
+ */
+int dsnap_next(struct dsnap_reader*, struct msg_data*, const char **name);
+
+void dsnap_close(struct dsnap_reader*);
+
+/* Removes the snapshot of the directory at path, if any */
+void dsnap_remove(const char *path);
+
+#endif /* DIRSNAP_H */
@@ -0,0 +1,275 @@
+/*
+ * Copyright (C) 2026 alx@fastestcode.org
+ * This software is distributed under the terms of the X/MIT license.
+ * See the included COPYING file for further information.
+ */
+
+/*
+ * Directory entry table used by the directory watcher
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "dirtab.h"
+#include "debug.h"
+
+/* Initial number of hash slots (must be a power of two) */
+#define INIT_SLOTS 256
+
+/* Initial string pool size */
+#define INIT_POOL 4096
+
+/* Number of records to grow the array by */
+#define RECS_GROW_BY 256
+
+/* Local prototypes */
+static unsigned int hash_name(const char*);
+static size_t find_slot(struct dir_tab*, const char*, unsigned int);
+static int grow_slots(struct dir_tab*);
+static int pool_add(struct dir_tab*, const char*, size_t*);
+static void pool_compact(struct dir_tab*);
+
+
+int dtab_init(struct dir_tab *tab)
+{
+	memset(tab, 0, sizeof(struct dir_tab));
+	
+	tab->slots = calloc(INIT_SLOTS, sizeof(unsigned int));
+	if(!tab->slots) return errno;
+	tab->nslots = INIT_SLOTS;
+	
+	tab->pool = malloc(INIT_POOL);
+	if(!tab->pool) {
+		free(tab->slots);
+		return errno;
+	}
+	tab->pool_size = INIT_POOL;
+	
+	return 0;
+}
+
+void dtab_free(struct dir_tab *tab)
+{
+	free(tab->slots);
+	free(tab->pool);
+	free(tab->recs);
+	memset(tab, 0, sizeof(struct dir_tab));
+}
+
+void dtab_clear(struct dir_tab *tab)
+{
+	memset(tab->slots, 0, tab->nslots * sizeof(unsigned int));
+	tab->nrecs = 0;
+	tab->pool_len = 0;
+	tab->pool_waste = 0;
+}
+
+struct dir_rec* dtab_find(struct dir_tab *tab, const char *name)
+{
+	size_t i = find_slot(tab, name, hash_name(name));
+
+	if(!tab->slots[i]) return NULL;
+	
+	return &tab->recs[tab->slots[i] - 1];
+}
+
+struct dir_rec* dtab_add(struct dir_tab *tab, const char *name)
+{
+	struct dir_rec *rec;
+	unsigned int hash = hash_name(name);
+	size_t name_off = 0;
+	size_t i;
+	
+	/* keep the load factor below 1/2 */
+	if((tab->nrecs + 1) * 2 > tab->nslots) {
+		if(grow_slots(tab)) return NULL;
+	}
+	
+	if(tab->nrecs == tab->recs_size) {
+		size_t new_size = tab->recs_size + RECS_GROW_BY;
+		struct dir_rec *new_recs;
+		
+		new_recs = realloc(tab->recs, new_size * sizeof(struct dir_rec));
+		if(!new_recs) return NULL;
+		
+		tab->recs = new_recs;
+		tab->recs_size = new_size;
+	}
+	
+	if(pool_add(tab, name, &name_off)) return NULL;
+
+	i = find_slot(tab, name, hash);
+	dbg_assert(tab->slots[i] == 0);
+
+	rec = &tab->recs[tab->nrecs];
+	memset(rec, 0, sizeof(struct dir_rec));
+	rec->name = name_off;
+	rec->hash = hash;
+	rec->gen = tab->gen;
+
+	tab->nrecs++;
+	tab->slots[i] = tab->nrecs;
+	
+	return rec;
+}
+
+void dtab_remove(struct dir_tab *tab, struct dir_rec *rec)
+{
+	size_t mask = tab->nslots - 1;
+	size_t index = rec - tab->recs;
+	size_t last = tab->nrecs - 1;
+	size_t i, j;
+	
+	tab->pool_waste += strlen(tab->pool + rec->name) + 1;
+	
+	/* vacate the slot and shift any displaced entries that follow
+	 * back into it, so that no tombstones are needed */
+	i = find_slot(tab, tab->pool + rec->name, rec->hash);
+	dbg_assert(tab->slots[i] == index + 1);
+	tab->slots[i] = 0;
+	
+	for(j = (i + 1) & mask; tab->slots[j]; j = (j + 1) & mask) {
+		size_t home = tab->recs[tab->slots[j] - 1].hash & mask;
+
+		/* can't move the entry at j to i if its home slot
+		 * lies cyclically within (i, j] */
+		if( (i <= j) ? ((i < home) && (home <= j)) :
+			((i < home) || (home <= j)) ) continue;
+
+		tab->slots[i] = tab->slots[j];
+		tab->slots[j] = 0;
+		i = j;
+	}
+
+	/* move the last record into the vacated array position */
+	if(index != last) {
+		struct dir_rec *lrec = &tab->recs[last];
+		
+		i = find_slot(tab, tab->pool + lrec->name, lrec->hash);
+		dbg_assert(tab->slots[i] == last + 1);
+		tab->slots[i] = index + 1;
+		tab->recs[index] = *lrec;
+	}
+	tab->nrecs--;
+	
+	if(tab->pool_waste > INIT_POOL && tab->pool_waste > tab->pool_len / 2)
+		pool_compact(tab);
+}
+
+/*
+ * FNV-1a string hash
+ */
+static unsigned int hash_name(const char *name)
+{
+	unsigned int h = 2166136261U;
+
+	while(*name) {
+		h ^= (unsigned char)*name++;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+/*
+ * Returns index of the slot that contains name, or the vacant
+ * slot where it should be placed if it's not in the table.
+ */
+static size_t find_slot(struct dir_tab *tab,
+	const char *name, unsigned int hash)
+{
+	size_t mask = tab->nslots - 1;
+	size_t i = hash & mask;
+
+	while(tab->slots[i]) {
+		struct dir_rec *rec = &tab->recs[tab->slots[i] - 1];
+		
+		if(rec->hash == hash && !strcmp(tab->pool + rec->name, name))
+			break;
+		i = (i + 1) & mask;
+	}
+	return i;
+}
+
+/*
+ * Doubles the number of hash slots and rehashes all records
+ */
+static int grow_slots(struct dir_tab *tab)
+{
+	size_t new_nslots = tab->nslots * 2;
+	size_t mask = new_nslots - 1;
+	unsigned int *new_slots;
+	size_t i;
+	
+	new_slots = calloc(new_nslots, sizeof(unsigned int));
+	if(!new_slots) return errno;
+
+	for(i = 0; i < tab->nrecs; i++) {
+		size_t j = tab->recs[i].hash & mask;
+		
+		while(new_slots[j]) j = (j + 1) & mask;
+		new_slots[j] = i + 1;
+	}
+	free(tab->slots);
+	tab->slots = new_slots;
+	tab->nslots = new_nslots;
+	
+	return 0;
+}
+
+/*
+ * Appends a string to the pool, returns its offset in *poff
+ */
+static int pool_add(struct dir_tab *tab, const char *name, size_t *poff)
+{
+	size_t len = strlen(name) + 1;
+	
+	if(tab->pool_len + len > tab->pool_size) {
+		size_t new_size = tab->pool_size * 2;
+		char *new_pool;
+		
+		while(tab->pool_len + len > new_size) new_size *= 2;
+		
+		new_pool = realloc(tab->pool, new_size);
+		if(!new_pool) return ENOMEM;
+		
+		tab->pool = new_pool;
+		tab->pool_size = new_size;
+	}
+	memcpy(tab->pool + tab->pool_len, name, len);
+	*poff = tab->pool_len;
+	tab->pool_len += len;
+	
+	return 0;
+}
+
+/*
+ * Rebuilds the string pool, dropping names of removed records.
+ * The pool isn't shrunk if a new buffer can't be allocated.
+ */
+static void pool_compact(struct dir_tab *tab)
+{
+	size_t new_size = tab->pool_size;
+	char *new_pool;
+	size_t len = 0;
+	size_t i;
+	
+	while(new_size > INIT_POOL &&
+		(tab->pool_len - tab->pool_waste) < new_size / 4) new_size /= 2;
+
+	new_pool = malloc(new_size);
+	if(!new_pool) return;
+	
+	for(i = 0; i < tab->nrecs; i++) {
+		size_t name_len = strlen(tab->pool + tab->recs[i].name) + 1;
+		
+		memcpy(new_pool + len, tab->pool + tab->recs[i].name, name_len);
+		tab->recs[i].name = len;
+		len += name_len;
+	}
+	free(tab->pool);
+	tab->pool = new_pool;
+	tab->pool_size = new_size;
+	tab->pool_len = len;
+	tab->pool_waste = 0;
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2026 alx@fastestcode.org
+ * This software is distributed under the terms of the X/MIT license.
+ * See the included COPYING file for further information.
+ */
+
+/*
+ * Directory entry table used by the directory watcher.
+ * Records are kept in a dense array, indexed by an open addressing
+ * (linear probing) hash table keyed by name. Names are stored in
+ * a string pool, which is compacted when it gets too fragmented.
+ */
+
+#ifndef DIRTAB_H
+#define DIRTAB_H
+
+#include <sys/types.h>
+
+struct dir_rec {
+	size_t name;  /* offset into the string pool */
+	unsigned int hash;
+	unsigned int gen;
+	time_t mtime;
+	time_t ctime;
+	off_t size;
+	dev_t device;
+	unsigned short flags;
+	unsigned short hot; /* polls to go checking it every time */
+};
+
+/* dir_rec flags */
+#define DRF_SHOWN	0x01	/* passed the filter */
+#define DRF_MPOINT	0x02	/* mount point */
+#define DRF_PARTIAL	0x04	/* attributes not sent to the parent yet */
+
+struct dir_tab {
+	struct dir_rec *recs;
+	size_t nrecs;
+	size_t recs_size;
+	
+	unsigned int *slots; /* record index + 1, zero if vacant */
+	size_t nslots;
+
+	char *pool;
+	size_t pool_len;
+	size_t pool_size;
+	size_t pool_waste;
+	
+	unsigned int gen;
+};
+
+/* Initializes an empty table. Returns zero on success, errno otherwise. */
+int dtab_init(struct dir_tab*);
+
+/* Frees all data associated with the table */
+void dtab_free(struct dir_tab*);
+
+/* Removes all records, retaining allocated memory for reuse */
+void dtab_clear(struct dir_tab*);
+
+/* Returns the record for name, or NULL if there is none */
+struct dir_rec* dtab_find(struct dir_tab*, const char *name);
+
+/*
+ * Adds a zeroed record for name, stamped with the current generation.
+ * Name must not exist in the table already. Returns NULL on failure.
+ */
+struct dir_rec* dtab_add(struct dir_tab*, const char *name);
+
+/*
+ * Removes the record. The last record in the array is moved into its
+ * place, so when iterating, the current index must be checked again.
+ */
+void dtab_remove(struct dir_tab*, struct dir_rec*);
+
+/*
+ * Starts a new generation. Records that aren't stamped with
+ * dtab_touch afterwards may be considered stale.
+ */
+#define dtab_new_gen(tab) ((tab)->gen++)
+#define dtab_touch(tab, rec) ((rec)->gen = (tab)->gen)
+#define dtab_stale(tab, rec) ((rec)->gen != (tab)->gen)
+
+/* Returns the name of the record. Valid until the next add/remove. */
+#define dtab_name(tab, rec) ((tab)->pool + (rec)->name)
+
+#endif /* DIRTAB_H */
@@ -7,7 +7,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <errno.h>
-#include <fnmatch.h>
+#include <time.h>
 #include <dirent.h>
 #include <fcntl.h>
 #include <sys/types.h>
@@ -15,9 +15,15 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <signal.h>
+#include <pthread.h>
 #include <unistd.h>
+#include <poll.h>
 #include <grp.h>
 #include <pwd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <sys/syscall.h>
+#endif
 #include <X11/Intrinsic.h>
 #include <Xm/Xm.h>
 #include "menu.h"
@@ -33,6 +39,15 @@
 #include "fstab.h"
 #include "fsutil.h"
 #include "mbstr.h"
+#include "dirtab.h"
+#include "rdmsg.h"
+#include "dircache.h"
+#include "lnkcache.h"
+#include "dirsnap.h"
+#include "dirsize.h"
+#include "mnttab.h"
+#include "fspolicy.h"
+#include "watchd.h"
 #include "debug.h"
 
 
@@ -41,121 +56,490 @@ struct read_proc_data {
 	volatile pid_t pid;
 	volatile int status;
 	XtInputId iid;
+	XtInputId cmd_iid; /* registered while commands are queued */
+	XtWorkProcId drain_wpid; /* messages are left to process */
 	XtSignalId sigid;
 	int in_fd;
-	int out_fd;
+	int cmd_fd;
+	struct rdm_receiver in;
+	struct rdm_sender *cmd;
+	struct rdm_ring *ring; /* shared message buffer (may be NULL) */
+	unsigned int scan_id; /* tag of the current scan */
+	#ifdef DEBUG
+	struct timespec scan_start; /* for throughput reports */
+	#endif
+	Boolean unmapped;
+	Boolean obscured;
+	Boolean paused; /* watching suspended while the window is hidden */
 	Boolean init_done;
+	Boolean partial; /* only names were received so far */
+	Boolean progressive; /* shown while being read, laid out periodically */
+	Boolean primed; /* contents were restored from the listing cache */
+	Boolean stale; /* restored from a saved snapshot, not confirmed yet */
+	Boolean stalled; /* nothing was received for readTimeout seconds */
+	struct timespec stall_time; /* when the scan is considered stalled */
+	struct stat loc_st; /* location attributes the listing is keyed with */
+};
+
+/* Location probe data (see set_location) */
+struct probe_data {
+	int fd; /* results are read from here */
+	int out_fd; /* and written here by probe threads */
+	XtInputId iid;
+	XtIntervalId timer;
+	struct probe_result *pr; /* probe in progress */
+};
+
+/* Location probe request and result. Owned by the probe thread until it's
+ * passed back, which it is even if the probe was abandoned meanwhile. */
+struct probe_result {
+	char *path;
+	int fd; /* the directory, if it could be opened */
+	int err;
+	struct stat st;
+};
+
+/* Directory prefetch data */
+struct prefetch_data {
+	volatile pid_t pid;
+	int fd;
+	XtInputId iid;
+	XtIntervalId dwell_iid;
+	struct rdm_receiver in;
+	struct dir_listing *listing; /* received so far */
+	char *path; /* being prefetched */
+	char *next_path; /* to be prefetched next */
+	char *selected; /* selected directory name */
+	int ptr_x; /* last pointer position over the list */
+	int ptr_y;
+	Boolean hover; /* the dwell timer was set by pointer motion */
 };
 
-/* Reader/watcher message data */
-enum msg_reason {
-	MSG_ADD,
-	MSG_REMOVE,
-	MSG_UPDATE,
-	MSG_EOD
+/* Subdirectory sizing process data (see dirsize.h) */
+struct dirsize_data {
+	volatile pid_t pid;
+	int in_fd;
+	int cmd_fd;
+	XtInputId iid;
+	XtInputId cmd_iid;
+	XtIntervalId vis_iid;
+	struct rdm_receiver in;
+	struct rdm_sender *cmd;
+	unsigned int tag; /* of the current location's requests */
+	unsigned int vis_first; /* range of items last asked for */
+	unsigned int vis_end;
+	Boolean active; /* sizing the current location */
 };
 
-struct msg_data {
-	int reason;
+/* Directory entry stat data */
+struct entry_info {
+	struct stat st;
 	int stat_errno;
-	mode_t mode;
 	Boolean is_symlink;
-	Boolean is_mpoint;
-	Boolean is_mounted;
-	time_t ctime;
-	time_t mtime;
-	gid_t gid;
-	uid_t uid;
-	int db_index;
-	off_t size;
-	size_t name_len;
-	unsigned int files_total;
-	unsigned int files_skipped;
-	struct fsize size_total;
+	struct link_id link; /* identity of the link itself, if it's one */
+	Boolean skipped; /* filtered out by type, not stat'ed */
+	Boolean no_access; /* a directory that can't be entered */
 };
 
-struct watch_rec {
-	char *name;
-	time_t mtime;
-	time_t ctime;
-	Boolean is_mpoint;
-	dev_t device;
-	Boolean touched;
+/* Cached icon pixmaps */
+struct icon_pixmaps {
+	Pixmap image;
+	Pixmap mask;
+	int state; /* one of IPS_* below */
 };
+#define IPS_UNKNOWN 0
+#define IPS_LOADED 1
+#define IPS_FAILED 2
 
+/* Directory entry queued for scanning */
+struct scan_ent {
+	ino_t ino;
+	mode_t type;
+	size_t name;
+	Boolean done;
+	struct entry_info info;
+};
+
+/* Sort key for the names pass (see sort_names) */
+struct sort_key {
+	const char *name; /* as compared by the list widget */
+	size_t index; /* in the scan pool */
+	Boolean dir;
+};
+
+/* Directory scan context, shared by scan worker threads */
+struct scan_pool {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int dfd;
+	struct scan_ent *ents;
+	size_t nents;
+	size_t ents_size;
+	size_t next;
+	char *names;
+	size_t names_size;
+	Boolean cancel;
+};
+
+/* Watcher process data */
+struct watch_data {
+	char *path;
+	int cmd_fd;
+	int notify_fd;
+	int notify_wd; /* inotify watch descriptor, -1 if none */
+	int watchd_fd; /* watcher daemon connection, -1 if none */
+	Boolean subscribed; /* the daemon is watching the directory for us */
+	struct timespec watchd_deadline; /* to hear from the daemon by */
+	DIR *dir;
+	dev_t device;
+	Boolean has_mpts;
+	int state;
+	unsigned int tag; /* id of the current scan */
+	Boolean primed; /* the parent is showing a cached listing */
+	Boolean rescan; /* a rescan was requested while reading */
+	Boolean paused; /* the parent's window can't be seen */
+	Boolean sort_names; /* names are sent in the parent's sort order */
+	unsigned int sort_flags; /* CMD_SORT flags */
+	int fs_class;
+	long interval; /* polling interval in ms */
+	struct timespec next_poll;
+	unsigned int npolls; /* partial polls since the last full rescan */
+	size_t poll_next; /* next watch list record to be polled */
+	ino_t dir_ino; /* directory attributes, as of open_directory */
+	time_t dir_mtime;
+	long dir_mtime_ns;
+	time_t dir_ctime;
+	time_t dir_time; /* when these were taken */
+	unsigned int nchanges; /* number of changes sent */
+	struct dir_tab list;
+	struct link_cache links; /* symlink targets (see is_mount_point) */
+	struct scan_pool sp;
+	struct rdm_sender *out;
+	struct rdm_receiver in;
+	struct timespec flush_time;
+};
 
-/* Watcher process  nice() value*/
-#ifndef WATCH_PROC_NICE
-#define WATCH_PROC_NICE	10
-#endif
 
 /* Reader/watcher process return values */
 #define RP_SUCCES 0
 #define RP_ENOACC 1
 #define RP_ENOMEM 2
 #define RP_IOFAIL 3
+#define RP_ABORT 4 /* superseded by a new scan request */
+
+/* Reader process states */
+#define RS_IDLE 0	/* waiting for a scan request */
+#define RS_PRIME 1	/* receiving the list of entries shown already */
+#define RS_READ 2	/* the directory is to be read */
+#define RS_WATCH 3	/* watching it for changes */
+
+#ifdef __linux__
+/* Events the watcher process is interested in */
+#define NOTIFY_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+	IN_ATTRIB | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+/* inotify event buffer size */
+#ifndef NOTIFY_BUFSIZ
+#define NOTIFY_BUFSIZ 4096
+#endif
+#endif /* __linux__ */
 
-/* Used by the watcher process */
-#ifndef FILE_LIST_GROW_BY
-#define FILE_LIST_GROW_BY 256
+/* Unchanged directories are polled at up to this many times
+ * the refresh interval, which is doubled after each such poll */
+#ifndef RP_BACKOFF_MAX
+#define RP_BACKOFF_MAX 16
 #endif
 
-/* Status-bar update interval in MS (while reading a directory) */
+/* Number of entries whose attributes are checked each time an unchanged
+ * directory is polled, besides those that changed recently, and the number
+ * of polls these are checked on after a change (see poll_directory) */
+#ifndef RP_POLL_SLICE
+#define RP_POLL_SLICE 256
+#endif
+#ifndef RP_HOT_POLLS
+#define RP_HOT_POLLS 8
+#endif
+
+/* Unchanged directories are reread in full every so many polls anyway */
+#ifndef RP_POLL_FULL
+#define RP_POLL_FULL 16
+#endif
+
+/* Number of entries the reader processes between checks for commands */
+#ifndef RP_CMD_CHECK
+#define RP_CMD_CHECK 256
+#endif
+
+/* Directories with fewer entries than this are scanned serially */
+#ifndef RP_PAR_SCAN_MIN
+#define RP_PAR_SCAN_MIN 64
+#endif
+
+/* How long the reader may hold back messages (in ms) before
+ * sending them off, if the frame buffer doesn't fill up first */
+#ifndef RP_FLUSH_INT
+#define RP_FLUSH_INT 100
+#endif
+
+/* Time in ms the GUI may spend processing reader messages
+ * before handling pending events, and the number of messages
+ * processed between checks for that */
+#ifndef RP_DRAIN_TIME
+#define RP_DRAIN_TIME 8
+#endif
+#ifndef RP_DRAIN_CHECK
+#define RP_DRAIN_CHECK 32
+#endif
+
+/* Nice value for the prefetch process */
+#ifndef PF_NICE
+#define PF_NICE 10
+#endif
+
+/* Linux I/O priority for the prefetch process (idle class) */
+#define PF_IOPRIO_WHO_PROCESS 1
+#define PF_IOPRIO_IDLE (3 << 13)
+
+/* Interval in ms at which the part of the list that can be seen is
+ * checked for subdirectories to be sized next, while these are sized */
+#ifndef DS_VISIBLE_INT
+#define DS_VISIBLE_INT 250
+#endif
+
+/* Status-bar update interval in MS (while reading a directory),
+ * at which items read so far are sorted and laid out, too */
 #ifndef STATUS_UPDATE_INT
-#define STATUS_UPDATE_INT 250
+#define STATUS_UPDATE_INT 100
 #endif
 
 /* Local prototypes */
 static int read_directory(void);
-static int read_proc_main(pid_t, int);
-static int read_proc_watch(const char*, pid_t, int,
-	struct watch_rec*, size_t, size_t, Boolean);
+static void cache_listing(void);
+static Boolean restore_listing(void);
+static int start_read_proc(void);
+static void kill_read_proc(void);
+static void close_read_proc(void);
+static int send_scan_command(void);
+static unsigned int get_sort_flags(void);
+static void write_commands(void);
+static void cmd_write_proc(XtPointer, int*, XtInputId*);
+static void send_command(int);
+static void visibility_handler(Widget, XtPointer, XEvent*, Boolean*);
+static void next_scan_id(void);
+static const char* read_proc_error(int);
+static int read_proc_main(int, int);
+static int wait_events(struct watch_data*);
+static int read_commands(struct watch_data*, Boolean);
+static int check_commands(struct watch_data*);
+static int begin_scan(struct watch_data*, const char*, unsigned int);
+static int prime_entry(struct watch_data*,
+	const char*, const struct msg_data*);
+static void end_scan(struct watch_data*);
+static int read_contents(struct watch_data*);
+static void schedule_poll(struct watch_data*, Boolean);
+static void add_msecs(struct timespec*, long);
+static long msecs_until(const struct timespec*);
+static int update_mounts(struct watch_data*);
+static void mount_changed(const char*, void*);
+#ifdef __linux__
+static void set_notify_watch(struct watch_data*);
+static int read_events(struct watch_data*);
+static void set_watchd_watch(struct watch_data*);
+static void set_watchd_deadline(struct watch_data*);
+static int read_watchd_events(struct watch_data*);
+static int drop_watchd(struct watch_data*);
+#endif
+static int open_directory(struct watch_data*);
+static int rescan_directory(struct watch_data*);
+static int poll_directory(struct watch_data*);
+static int scan_directory(struct watch_data*, Boolean);
+static int read_entries(struct watch_data*, struct scan_pool*);
+static int send_names(struct watch_data*, struct scan_pool*);
+static int stat_entries(struct watch_data*, struct scan_pool*, Boolean);
+static void* scan_worker(void*);
+static int scan_ent_cmp(const void*, const void*);
+static struct sort_key* sort_names(struct watch_data*, struct scan_pool*);
+static int sort_key_cmp(const void*, const void*);
+static int process_entry(struct watch_data*, const char*, mode_t, Boolean);
+static void stat_entry(int, const char*, mode_t, struct entry_info*);
+static int apply_entry(struct watch_data*, const char*,
+	struct entry_info*, Boolean);
+static mode_t entry_type(const struct dirent*);
+static int icon_class(mode_t, int, int, unsigned int, Boolean);
+static Boolean is_mount_point(struct watch_data*,
+	const char*, const struct entry_info*, Boolean*);
+static int send_message(struct watch_data*, struct msg_data*, const char*);
+static int flush_messages(struct watch_data*);
+static int send_removal(struct watch_data*, const char*);
+static int send_totals(struct watch_data*);
+static void send_error(struct watch_data*, int);
+static void get_totals(struct watch_data*, struct msg_data*);
 static void reader_callback_proc(XtPointer, int*, XtInputId*);
+static Boolean drain_work_proc(XtPointer);
+static Boolean drain_messages(void);
+static Boolean process_message(const struct msg_data*, const char*);
+static Boolean get_entry_icon(const struct msg_data*, Pixmap*, Pixmap*);
+#ifdef DEBUG
+static void report_throughput(void);
+#endif
 static void read_error_msg(const char*, const char*, Boolean);
 static void xt_read_proc_sig_handler(XtPointer,XtSignalId*);
 static void read_proc_sigterm(int sig);
-static void read_proc_sigalrm(int sig);
-static Boolean filter(const char*, mode_t);
+static Boolean filter(const char*, const struct stat*, int*);
+static int filter_type(const char*, mode_t);
+static Boolean sniff_contents(void);
 static void status_timeout_cb(XtPointer, XtIntervalId*);
 static void reset_context_data(void);
+static Boolean replay_listing(struct dir_cache_ent*);
+static Boolean restore_snapshot(const struct stat*);
+static void save_snapshot(const struct stat*);
+static unsigned int snapshot_key(void);
+static void set_dwell_timer(void);
+static void dwell_timeout_cb(XtPointer, XtIntervalId*);
+static void pointer_motion_handler(Widget, XtPointer, XEvent*, Boolean*);
+static void start_prefetch(char*);
+static void start_next_prefetch(void);
+static void stop_prefetch(void);
+static void cancel_prefetch(void);
+static void prefetch_input_proc(XtPointer, int*, XtInputId*);
+static void get_dir_id(const struct msg_data*, struct stat*);
+static int prefetch_main(const char*, int);
+static void start_dir_sizes(void);
+static void stop_dir_sizes(void);
+static void request_dir_size(const char*);
+static void request_visible_sizes(void);
+static void dirsize_visible_cb(XtPointer, XtIntervalId*);
+static void dirsize_input_proc(XtPointer, int*, XtInputId*);
+static void write_dirsize_commands(void);
+static void dirsize_write_proc(XtPointer, int*, XtInputId*);
+static int start_dirsize_proc(void);
+static void stop_dirsize_proc(void);
+static int probe_location(char*);
+static void stop_probe(void);
+static void* probe_thread(void*);
+static void probe_input_proc(XtPointer, int*, XtInputId*);
+static void probe_timeout_cb(XtPointer, XtIntervalId*);
+static int enter_location(char*, const struct stat*);
+static void abandon_read_proc(void);
+static void set_stall_time(void);
 
 /* Local variables */
 static struct read_proc_data rp_data = {0};
+static struct prefetch_data pf_data = {0};
+static struct dirsize_data ds_data = {0};
+static struct probe_data pb_data = {0};
 static XtIntervalId xt_update_iid = None;
 
+/* CMD_SORT flags for sort_key_cmp (reader process) */
+static unsigned int sort_key_flags;
+
+/* Policy for the file system being scanned (reader process) */
+static const struct fs_policy *scan_policy = &fs_policies[FSC_LOCAL];
+
+/* The reader's working directory is the one being scanned; type DB
+ * content patterns are matched against bare entry names (reader process) */
+static Boolean in_scan_dir = False;
+
+/* Icons by type DB index, and by MI_* icon class */
+static struct icon_pixmaps *type_icons = NULL;
+static struct icon_pixmaps class_icons[NUM_MSG_ICONS];
+static const char *class_icon_names[NUM_MSG_ICONS] = {
+	ICON_FILE, ICON_DIR, ICON_NXDIR, ICON_MPT,
+	ICON_MPTI, ICON_TEXT, ICON_BIN, ICON_DLNK
+};
+
 /*
  * One time file manager iniialization routine.
- * Creates communication pipes and registers them with Xt.
+ * Starts the directory reader process, which is kept around
+ * for the lifetime of the application.
  */
 int initialize(void)
 {
+	int fds[2];
 	int res;
-	int pipe_fd[2];
 	
-	res = pipe(pipe_fd);
-	if(res) return errno;
+	rp_data.in_fd = -1;
+	rp_data.cmd_fd = -1;
+	pf_data.fd = -1;
+	ds_data.in_fd = -1;
+	ds_data.cmd_fd = -1;
 	
-	rp_data.in_fd = pipe_fd[0];
-	rp_data.out_fd = pipe_fd[1];
-
-	fcntl(rp_data.in_fd, F_SETFL, O_NONBLOCK);
+	res = rdm_init_receiver(&rp_data.in);
+	if(res) return res;
 	
+	/* location probe results are passed back through this */
+	if(pipe(fds)) return errno;
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+	fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+	pb_data.fd = fds[0];
+	pb_data.out_fd = fds[1];
+	pb_data.iid = XtAppAddInput(app_inst.context, pb_data.fd,
+		(XtPointer)XtInputReadMask, probe_input_proc, NULL);
+	
+	rp_data.cmd = malloc(sizeof(struct rdm_sender));
+	if(!rp_data.cmd) return errno;
+	rdm_init_sender(rp_data.cmd, -1);
+
 	rp_data.sigid = XtAppAddSignal(app_inst.context,
 			xt_read_proc_sig_handler, NULL);
+	
+	XtAddEventHandler(app_inst.wshell, StructureNotifyMask,
+		False, visibility_handler, NULL);
+	XtAddEventHandler(app_inst.wlist, VisibilityChangeMask,
+		False, visibility_handler, NULL);
+	
+	dcache_init((size_t)app_res.listing_cache * 1024);
+	
+	if(app_res.saved_listing_min) {
+		char *home = getenv("HOME");
+		char *path = home ?
+			build_path(NULL, home, HOME_SUBDIR, SNAP_SUBDIR, NULL) : NULL;
+		
+		if(path) {
+			dsnap_init(path);
+			free(path);
+		}
+	}
 
-	rp_data.iid = XtAppAddInput(app_inst.context, rp_data.in_fd,
-		(XtPointer)XtInputReadMask, reader_callback_proc, NULL);
+	/* prefetched listings are kept in the listing cache */
+	if(app_res.listing_cache && app_res.prefetch_delay &&
+		!rdm_init_receiver(&pf_data.in)) {
+		XtAddEventHandler(app_inst.wlist, PointerMotionMask |
+			LeaveWindowMask, False, pointer_motion_handler, NULL);
+	} else {
+		app_res.prefetch_delay = 0;
+	}
 	
-	return 0;
+	/* subdirectories are sized by a process started on first use */
+	if(app_inst.dir_sizes != DSIZE_NONE) {
+		ds_data.cmd = malloc(sizeof(struct rdm_sender));
+		if(ds_data.cmd && !rdm_init_receiver(&ds_data.in)) {
+			rdm_init_sender(ds_data.cmd, -1);
+		} else {
+			app_inst.dir_sizes = DSIZE_NONE;
+		}
+	}
+	
+	/* messages are passed through the pipe alone without it */
+	if(app_res.reader_buffer) {
+		rp_data.ring = rdm_create_ring((size_t)app_res.reader_buffer * 1024);
+		if(!rp_data.ring)
+			dbg_printf("rdm_create_ring: %s\n", strerror(errno));
+	}
+	
+	return start_read_proc();
 }
 
 /* 
  * Reads directory specified; if absolute is False, path is appended
- * to the current location. Returns 0 on success, errno otherwise.
+ * to the current location. The location is opened by a probe thread
+ * first, so that an unresponsive file system can't lock up the UI, and
+ * entered once that's done (see probe_input_proc), which is also where
+ * errors are reported. Returns 0 if the probe was started, errno otherwise.
  */
 int set_location(const char *path, Boolean absolute)
 {
-	struct stat st;
 	char *psz;
 	int err = 0;
 
@@ -184,22 +568,154 @@ int set_location(const char *path, Boolean absolute)
 		strip_path(psz);
 	}
 	
-	/* check if it's a directory with R+X access */
-	if(stat(psz, &st) == -1) {
-		err = errno;
-		read_error_msg(psz, strerror(err), True);
-	} else if(!S_ISDIR(st.st_mode)) {
-		err = ENOTDIR;
-		read_error_msg(psz, strerror(err), True);
+	err = probe_location(psz);
+	if(err) read_error_msg(path, strerror(err), True);
+	
+	return err;
+}
+
+/*
+ * Starts a thread that opens the directory at path, and has the location
+ * entered once it's done (see probe_input_proc), since that may take a while
+ * on a file system that doesn't respond. A probe still in progress is
+ * abandoned. Path is owned by the routine. Returns zero or errno.
+ */
+static int probe_location(char *path)
+{
+	struct probe_result *pr;
+	pthread_attr_t attr;
+	pthread_t thread;
+	sigset_t sigs, old_sigs;
+	int res;
+	
+	stop_probe();
+	
+	pr = calloc(1, sizeof(struct probe_result));
+	if(!pr) {
+		free(path);
+		return ENOMEM;
+	}
+	pr->path = path;
+	pr->fd = -1;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	
+	/* signals are to be handled by the main thread */
+	sigfillset(&sigs);
+	pthread_sigmask(SIG_BLOCK, &sigs, &old_sigs);
+	res = pthread_create(&thread, &attr, probe_thread, pr);
+	pthread_sigmask(SIG_SETMASK, &old_sigs, NULL);
+	pthread_attr_destroy(&attr);
+	
+	if(res) {
+		free(pr->path);
+		free(pr);
+		return res;
+	}
+	pb_data.pr = pr;
+	
+	if(app_res.read_timeout) {
+		pb_data.timer = XtAppAddTimeOut(app_inst.context,
+			app_res.read_timeout * 1000, probe_timeout_cb, NULL);
+	}
+	return 0;
+}
+
+/*
+ * Abandons the probe in progress, if any. Its thread may be stuck on a
+ * file system that doesn't respond, so it's left to finish on its own,
+ * and the result is discarded once it's passed back.
+ */
+static void stop_probe(void)
+{
+	pb_data.pr = NULL;
+	
+	if(pb_data.timer) {
+		XtRemoveTimeOut(pb_data.timer);
+		pb_data.timer = None;
 	}
-	if(err)	return err;
+}
+
+/*
+ * Location probe thread. Opens the directory and passes the result back
+ * through the probe pipe, for the main thread to enter it.
+ */
+static void* probe_thread(void *arg)
+{
+	struct probe_result *pr = (struct probe_result*)arg;
+	
+	pr->fd = open(pr->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(pr->fd == -1)
+		pr->err = errno;
+	else if(fstat(pr->fd, &pr->st) == -1)
+		pr->err = errno;
+	
+	/* a pointer is written in one go, so results can't interleave */
+	while(write(pb_data.out_fd, &pr, sizeof(pr)) == -1 && errno == EINTR);
+	
+	return NULL;
+}
 
+/*
+ * Reads probe results, and enters the location if it's accessible.
+ * Results of probes that were abandoned are discarded.
+ */
+static void probe_input_proc(XtPointer p, int *fd, XtInputId *id)
+{
+	struct probe_result *pr;
 	
-	if(chdir(psz)) {
-		read_error_msg(psz, strerror(errno), True);
-		return errno;
+	while(read(pb_data.fd, &pr, sizeof(pr)) == sizeof(pr)) {
+		if(pr != pb_data.pr) {
+			if(pr->fd != -1) close(pr->fd);
+			free(pr->path);
+			free(pr);
+			continue;
+		}
+		stop_probe();
+
+		/* it's open already, so the path isn't looked up again */
+		if(!pr->err && fchdir(pr->fd)) pr->err = errno;
+		if(pr->fd != -1) close(pr->fd);
+		
+		if(pr->err) {
+			read_error_msg(pr->path, strerror(pr->err), True);
+			free(pr->path);
+			
+			/* the path field may have been edited */
+			if(app_inst.location)
+				path_field_set_location(app_inst.wpath,
+					app_inst.location, False);
+		} else {
+			enter_location(pr->path, &pr->st);
+		}
+		free(pr);
 	}
+}
+
+/*
+ * Called if the probe didn't finish within readTimeout seconds.
+ * It's left running, and the location is entered when it does.
+ */
+static void probe_timeout_cb(XtPointer p, XtIntervalId *iid)
+{
+	pb_data.timer = None;
 	
+	set_status_text("%s is not responding, still trying...",
+		pb_data.pr->path);
+}
+
+/*
+ * Makes path (owned by the routine), which is the working directory
+ * already, the current location, and tells the reader to read it.
+ * The location's attributes, as probed, are passed in st.
+ * Returns 0 or errno.
+ */
+static int enter_location(char *psz, const struct stat *st)
+{
+	cancel_prefetch();
+	cache_listing();
+	rp_data.loc_st = *st;
 	set_ui_sensitivity(0);
 	update_context_menus(NULL, 0, 0);
 	
@@ -217,6 +733,10 @@ int set_location(const char *path, Boolean absolute)
 int reread(void)
 {
 	dbg_assert(app_inst.location);
+	
+	/* cached listings may have been filtered differently */
+	cancel_prefetch();
+	dcache_flush();
 	return read_directory();
 }
 
@@ -229,7 +749,43 @@ void force_update(void)
 		dbg_trace("NO watcher process\n");
 		return;
 	}
-	kill(rp_data.pid, SIGALRM);
+	send_command(CMD_RESCAN);
+}
+
+/*
+ * Map/unmap and visibility change handler for the main window. The reader
+ * is told to suspend watching while the window is unmapped (iconified),
+ * or fully obscured, since there is no point in updating it then.
+ */
+static void visibility_handler(Widget w, XtPointer client,
+	XEvent *evt, Boolean *cont)
+{
+	Boolean paused;
+	
+	*cont = True;
+
+	switch(evt->type) {
+		case MapNotify:
+		rp_data.unmapped = False;
+		break;
+		case UnmapNotify:
+		rp_data.unmapped = True;
+		break;
+		case VisibilityNotify:
+		rp_data.obscured = (evt->xvisibility.state ==
+			VisibilityFullyObscured) ? True : False;
+		break;
+		default:
+		return;
+	}
+	
+	paused = (rp_data.unmapped || rp_data.obscured) ? True : False;
+	if(paused == rp_data.paused) return;
+	
+	rp_data.paused = paused;
+	dbg_trace("watcher %s\n", paused ? "paused" : "resumed");
+
+	if(rp_data.pid) send_command(paused ? CMD_PAUSE : CMD_RESUME);
 }
 
 /*
@@ -339,12 +895,21 @@ Boolean read_proc_sigchld(pid_t pid, int status)
 		rp_data.status = status;
 		XtNoticeSignal(rp_data.sigid);
 		return True;
+	} else if(pf_data.pid == pid) {
+		/* whatever was sent is still read from the pipe */
+		pf_data.pid = 0;
+		return True;
+	} else if(ds_data.pid == pid) {
+		/* noticed once its pipe is closed */
+		ds_data.pid = 0;
+		return True;
 	}
 	return False;
 }
 
 /*
- * Deferred (XtNoticeSignal) SIGCHLD handler triggered in read_proc_exit
+ * Deferred (XtNoticeSignal) SIGCHLD handler triggered in read_proc_sigchld.
+ * The reader is restarted when a directory is to be read next.
  */
 static void xt_read_proc_sig_handler(XtPointer p, XtSignalId *id)
 {
@@ -353,26 +918,11 @@ static void xt_read_proc_sig_handler(XtPointer p, XtSignalId *id)
 		xt_update_iid = None;
 	}
 	
+	close_read_proc();
+	
 	if( WIFEXITED(rp_data.status) && WEXITSTATUS(rp_data.status) ) {
-		char *errcs;
-		
-		switch(WEXITSTATUS(rp_data.status)) {
-			case RP_ENOACC:
-			errcs = "The location is not accessible";
-			break;
-			case RP_ENOMEM:
-			errcs = "Memory allocation error";
-			break;
-			case RP_IOFAIL:
-			errcs = "Data I/O error";
-			break;
-			default:
-			errcs = "Unexpected error";
-			break;
-		}
-		
-		read_error_msg(app_inst.location, errcs, False);
-
+		read_error_msg(app_inst.location,
+			read_proc_error(WEXITSTATUS(rp_data.status)), False);
 	} else if((WIFSIGNALED(rp_data.status) &&
 		(WTERMSIG(rp_data.status) != SIGTERM))) {
 		read_error_msg(app_inst.location,
@@ -380,6 +930,22 @@ static void xt_read_proc_sig_handler(XtPointer p, XtSignalId *id)
 	}
 	reset_context_data();
 }
+
+/*
+ * Returns the error string for a reader process error code
+ */
+static const char* read_proc_error(int code)
+{
+	switch(code) {
+		case RP_ENOACC:
+		return "The location is not accessible";
+		case RP_ENOMEM:
+		return "Memory allocation error";
+		case RP_IOFAIL:
+		return "Data I/O error";
+	}
+	return "Unexpected error";
+}
 	
 /*
  * Resets global context data 
@@ -393,8 +959,17 @@ static void reset_context_data(void)
 		
 	file_list_remove_all(app_inst.wlist);
 	file_list_show_contents(app_inst.wlist, False);
+	file_list_defer_sort(app_inst.wlist, False);
+	file_list_defer_layout(app_inst.wlist, False);
 	
 	rp_data.init_done = False;
+	rp_data.partial = False;
+	rp_data.progressive = False;
+	rp_data.primed = False;
+	rp_data.stale = False;
+	rp_data.stalled = False;
+	
+	if(app_inst.dir_sizes != DSIZE_NONE) stop_dir_sizes();
 
 	show_directory_stats();
 	set_ui_sensitivity(0);
@@ -403,17 +978,32 @@ static void reset_context_data(void)
 
 
 /*
- * Forks off a directory reader.
+ * Tells the directory reader to read the current location,
+ * restarting it first if necessary.
  */
 static int read_directory(void)
 {
-	pid_t pid;
-	pid_t parent_pid = getpid();
-	sigset_t sigmask;
+	int res;
 	
 	set_status_text("Reading %s...", app_inst.location);
 
-	if(rp_data.pid) stop_read_proc();
+	if(xt_update_iid) {
+		XtRemoveTimeOut(xt_update_iid);
+		xt_update_iid = None;
+	}
+
+	/* a reader stuck on an unresponsive file system can't be told
+	 * to read something else, so a new one is started instead */
+	if(rp_data.stalled) abandon_read_proc();
+
+	if(!rp_data.pid) {
+		res = start_read_proc();
+		if(res) return res;
+	}
+	
+	/* anything still in transit pertains to the previous scan */
+	next_scan_id();
+	if(app_inst.dir_sizes != DSIZE_NONE) stop_dir_sizes();
 
 	/* reset global context data */
 	init_fsize(&app_inst.size_shown);
@@ -423,30 +1013,22 @@ static int read_directory(void)
 	
 	file_list_remove_all(app_inst.wlist);
 	file_list_show_contents(app_inst.wlist, False);
+	file_list_defer_sort(app_inst.wlist, False);
+	file_list_defer_layout(app_inst.wlist, False);
 	
 	/* reset reader proc data */
 	rp_data.init_done = False;
+	rp_data.partial = False;
+	rp_data.progressive = False;
+	rp_data.stale = False;
+	rp_data.stalled = False;
+	set_stall_time();
 	
-	sigemptyset(&sigmask);
-	sigaddset(&sigmask, SIGCHLD);
-	sigprocmask(SIG_BLOCK, &sigmask, NULL);
-	
-	pid = fork();
-	if(pid == (-1)) return errno;
+	/* if the listing is cached, show it while the reader revalidates it */
+	rp_data.primed = restore_listing();
 	
-	if(!pid) {
-		int res;
-		
-		close(XConnectionNumber(app_inst.display));
-		close(rp_data.in_fd);
-		res = read_proc_main(parent_pid, rp_data.out_fd);
-		
-		_exit(res);
-	}
-
-	rp_data.pid = pid;
-
-	sigprocmask(SIG_UNBLOCK, &sigmask, NULL);
+	res = send_scan_command();
+	if(res) return res;
 
 	xt_update_iid = XtAppAddTimeOut(app_inst.context,
 		STATUS_UPDATE_INT, status_timeout_cb, NULL);
@@ -455,589 +1037,3102 @@ static int read_directory(void)
 }
 
 /*
- * Kills the directory reader/watcher process if it's active
+ * Queues the scan request for the current location, preceded by filter
+ * settings and followed by entries restored from the listing cache, if
+ * any, and sends it off to the reader. Returns zero or errno.
  */
-void stop_read_proc(void)
+static int send_scan_command(void)
 {
-	if(xt_update_iid) {
-		XtRemoveTimeOut(xt_update_iid);
-		xt_update_iid = None;
+	struct file_list_item fli;
+	struct msg_data msg;
+	unsigned int i;
+	char *path;
+	int res;
+	
+	/* the reader isn't in the same working directory */
+	path = get_working_dir();
+	if(!path) return errno;
+	
+	memset(&msg, 0, sizeof(struct msg_data));
+	msg.reason = CMD_FILTER;
+	msg.flags = (app_res.show_all ? CF_SHOW_ALL : 0) |
+		(app_res.filter_dirs ? CF_FILTER_DIRS : 0);
+	res = rdm_put(rp_data.cmd, &msg, app_inst.filter);
+	
+	msg.reason = CMD_SORT;
+	msg.flags = get_sort_flags();
+	if(!res) res = rdm_put(rp_data.cmd, &msg, NULL);
+
+	msg.reason = CMD_SCAN;
+	msg.flags = rp_data.primed ? CF_PRIMED : 0;
+	if(!res) res = rdm_put(rp_data.cmd, &msg, path);
+	free(path);
+	
+	if(rp_data.primed) {
+		msg.reason = CMD_PRIME;
+		msg.fields = MF_TIMES | MF_SIZE;
+
+		for(i = 0; !res &&
+			file_list_get_item_at(app_inst.wlist, i, &fli); i++) {
+			msg.flags = (fli.partial ? MF_PARTIAL : 0) |
+				((fli.user_flags & FLI_MNTPOINT) ? MF_MPOINT : 0) |
+				((fli.user_flags & FLI_MOUNTED) ? MF_MOUNTED : 0);
+			msg.mtime = fli.mtime;
+			msg.ctime = fli.ctime;
+			msg.size = fli.size;
+			res = rdm_put(rp_data.cmd, &msg, fli.name);
+		}
+
+		memset(&msg, 0, sizeof(struct msg_data));
+		msg.reason = CMD_PRIME;
+		if(!res) res = rdm_put(rp_data.cmd, &msg, NULL);
 	}
+	
+	if(!res) res = rdm_flush(rp_data.cmd);
+	if(res) return res;
+	
+	write_commands();
+	return 0;
+}
 
-	if(rp_data.pid){
-		pid_t pid = rp_data.pid;
-		dbg_printf("waiting for %d to exit\n", rp_data.pid);
-		rp_data.pid = 0;
-		kill(pid, SIGKILL);
-		waitpid(pid, (int*)&rp_data.status, 0);
+/*
+ * Writes out queued commands as far as the pipe takes these, and
+ * has Xt call back once it can take more if there's anything left.
+ * Commands may be held back for a while, since the reader only reads
+ * these between processing entries, and the list of primed entries
+ * may be larger than the pipe buffer.
+ */
+static void write_commands(void)
+{
+	struct rdm_sender *s = rp_data.cmd;
+
+	while(rdm_queued_len(s)) {
+		ssize_t n = write(rp_data.cmd_fd, rdm_queued(s), rdm_queued_len(s));
+		
+		if(n == -1) {
+			if(errno == EINTR) continue;
+			if(errno != EAGAIN && errno != EWOULDBLOCK) {
+				/* the reader is gone, SIGCHLD handler deals with that */
+				dbg_trace("write: %s\n", strerror(errno));
+				rdm_drain(s, rdm_queued_len(s));
+			}
+			break;
+		}
+		rdm_drain(s, n);
+	}
+	
+	if(rdm_queued_len(s) && !rp_data.cmd_iid) {
+		rp_data.cmd_iid = XtAppAddInput(app_inst.context, rp_data.cmd_fd,
+			(XtPointer)XtInputWriteMask, cmd_write_proc, NULL);
+	} else if(!rdm_queued_len(s) && rp_data.cmd_iid) {
+		XtRemoveInput(rp_data.cmd_iid);
+		rp_data.cmd_iid = None;
 	}
-	reset_context_data();
 }
 
+static void cmd_write_proc(XtPointer cd, int *pfd, XtInputId *iid)
+{
+	write_commands();
+}
 
 /*
- * Called periodically to update status bar text while a directory is read
+ * Sends a command that has no arguments to the reader
  */
-static void status_timeout_cb(XtPointer data, XtIntervalId *iid)
+static void send_command(int reason)
 {
-	if(rp_data.init_done) return;
+	struct msg_data msg;
 	
-	set_status_text("Reading %s (%u items)",
-		app_inst.location, app_inst.nfiles_read);
-	XtAppAddTimeOut(app_inst.context,
-		STATUS_UPDATE_INT, status_timeout_cb, NULL);
+	memset(&msg, 0, sizeof(struct msg_data));
+	msg.reason = reason;
+
+	if(rdm_put(rp_data.cmd, &msg, NULL) || rdm_flush(rp_data.cmd)) return;
+	write_commands();
 }
 
 /*
- * Processes messages sent by directory reader
+ * Starts a new scan. Commands are tagged with the scan id from here on,
+ * and messages tagged otherwise are dropped as these arrive.
  */
-static void reader_callback_proc(XtPointer cd, int *pfd, XtInputId *iid)
+static void next_scan_id(void)
 {
-	/* fname_buf is reused across calls and just grows if necessary */
-	static char *fname_buf = NULL;
-	static size_t buf_size = 0;
-	
-	struct file_list_item fli;
-	struct msg_data msg;
-	struct file_type_rec *ft = NULL;
-	Pixmap pm_icon;
-	Pixmap pm_mask;
-	Boolean update = False;
-	int res;
+	/* frame tags are 16 bit; zero is the reader's initial state */
+	if(++rp_data.scan_id > 0xFFFF) rp_data.scan_id = 1;
+	rdm_retag(rp_data.cmd, rp_data.scan_id);
 
-	if(readn(*pfd, &msg, sizeof(struct msg_data)) == -1) {
-			read_error_msg(app_inst.location, strerror(errno), False);
-			stop_read_proc();
-			return;
-	}
+	#ifdef DEBUG
+	clock_gettime(CLOCK_MONOTONIC, &rp_data.scan_start);
+	rp_data.in.pipe_bytes = 0;
+	rp_data.in.ring_bytes = 0;
+	rp_data.in.nrecs_total = 0;
+	#endif
+}
 
-	if(msg.name_len > buf_size) {
-		char *new_ptr;
-		new_ptr = realloc(fname_buf, (buf_size += 256));
-		if(!new_ptr) {
-			read_error_msg(app_inst.location, strerror(errno), False);
-			buf_size = 0;
-			stop_read_proc();
+/*
+ * Forks off the directory reader process and registers communication
+ * pipes with Xt. Returns 0 on success, errno otherwise.
+ */
+static int start_read_proc(void)
+{
+	int in_pipe[2];
+	int cmd_pipe[2];
+	sigset_t sigmask;
+	pid_t pid;
+	
+	if(pipe(in_pipe)) return errno;
+
+	/* the previous reader may have been killed halfway through */
+	if(rp_data.ring) rdm_reset_ring(rp_data.ring);
+	rdm_receiver_ring(&rp_data.in, rp_data.ring);
+
+	if(pipe(cmd_pipe)) {
+		int errv = errno;
+		close(in_pipe[0]);
+		close(in_pipe[1]);
+		return errv;
+	}
+	
+	sigemptyset(&sigmask);
+	sigaddset(&sigmask, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &sigmask, NULL);
+	
+	pid = fork();
+	if(pid == (-1)) {
+		int errv = errno;
+		
+		sigprocmask(SIG_UNBLOCK, &sigmask, NULL);
+		close(in_pipe[0]);
+		close(in_pipe[1]);
+		close(cmd_pipe[0]);
+		close(cmd_pipe[1]);
+		return errv;
+	}
+	
+	if(!pid) {
+		int res;
+		
+		close(XConnectionNumber(app_inst.display));
+		close(in_pipe[0]);
+		close(cmd_pipe[1]);
+		/* the sizing process quits once the GUI's end of this is closed */
+		if(ds_data.cmd_fd != -1) close(ds_data.cmd_fd);
+		fcntl(cmd_pipe[0], F_SETFL, O_NONBLOCK);
+
+		res = read_proc_main(cmd_pipe[0], in_pipe[1]);
+		
+		_exit(res);
+	}
+
+	rp_data.pid = pid;
+
+	sigprocmask(SIG_UNBLOCK, &sigmask, NULL);
+	
+	close(in_pipe[1]);
+	close(cmd_pipe[0]);
+	rp_data.in_fd = in_pipe[0];
+	rp_data.cmd_fd = cmd_pipe[1];
+	
+	fcntl(rp_data.in_fd, F_SETFL, O_NONBLOCK);
+	fcntl(rp_data.cmd_fd, F_SETFL, O_NONBLOCK);
+	fcntl(rp_data.in_fd, F_SETFD, FD_CLOEXEC);
+	fcntl(rp_data.cmd_fd, F_SETFD, FD_CLOEXEC);
+
+	rdm_reset_receiver(&rp_data.in);
+	
+	rp_data.iid = XtAppAddInput(app_inst.context, rp_data.in_fd,
+		(XtPointer)XtInputReadMask, reader_callback_proc, NULL);
+	
+	if(rp_data.paused) send_command(CMD_PAUSE);
+	
+	return 0;
+}
+
+/*
+ * Kills the reader process, which is restarted when a directory is to
+ * be read next. Used when communication with it can't be carried on.
+ */
+static void kill_read_proc(void)
+{
+	if(rp_data.pid){
+		pid_t pid = rp_data.pid;
+		dbg_printf("waiting for %d to exit\n", rp_data.pid);
+		rp_data.pid = 0;
+		kill(pid, SIGKILL);
+		waitpid(pid, (int*)&rp_data.status, 0);
+	}
+	close_read_proc();
+}
+
+/*
+ * Kills the reader process without waiting for it to exit. Used when it
+ * stalled on a file system that doesn't respond, and may not be able to
+ * exit until it does. It won't touch the shared buffer once killed, so the
+ * buffer may be reset for a new reader right away.
+ */
+static void abandon_read_proc(void)
+{
+	if(rp_data.pid) {
+		pid_t pid = rp_data.pid;
+		
+		dbg_printf("abandoning %d\n", pid);
+		/* reaped by the SIGCHLD handler */
+		rp_data.pid = 0;
+		kill(pid, SIGKILL);
+	}
+	close_read_proc();
+	rp_data.stalled = False;
+}
+
+/*
+ * Sets the time at which the current scan is considered stalled,
+ * unless anything is received from the reader before
+ */
+static void set_stall_time(void)
+{
+	clock_gettime(CLOCK_MONOTONIC, &rp_data.stall_time);
+	add_msecs(&rp_data.stall_time, app_res.read_timeout * 1000);
+}
+
+/*
+ * Returns CMD_SORT flags for the list widget's current sort settings
+ */
+static unsigned int get_sort_flags(void)
+{
+	short order, direction;
+	Boolean numbered, case_sens;
+	
+	XtVaGetValues(app_inst.wlist, XfNsortOrder, &order,
+		XfNsortDirection, &direction, XfNnumberedSort, &numbered,
+		XfNcaseSensitive, &case_sens, NULL);
+
+	return (order & CF_SORT_ORDER) |
+		((direction == XfDESCEND) ? CF_DESCEND : 0) |
+		(numbered ? CF_NUMBERED : 0) | (case_sens ? CF_CASE_SENS : 0);
+}
+
+/*
+ * Unregisters and closes reader communication pipes, discarding
+ * any data that is buffered. Called once the reader process is gone.
+ */
+static void close_read_proc(void)
+{
+	if(rp_data.iid) {
+		XtRemoveInput(rp_data.iid);
+		rp_data.iid = None;
+	}
+	
+	if(rp_data.drain_wpid) {
+		XtRemoveWorkProc(rp_data.drain_wpid);
+		rp_data.drain_wpid = None;
+	}
+	
+	if(rp_data.cmd_iid) {
+		XtRemoveInput(rp_data.cmd_iid);
+		rp_data.cmd_iid = None;
+	}
+	
+	if(rp_data.in_fd != -1) {
+		close(rp_data.in_fd);
+		rp_data.in_fd = -1;
+	}
+
+	if(rp_data.cmd_fd != -1) {
+		close(rp_data.cmd_fd);
+		rp_data.cmd_fd = -1;
+	}
+	
+	rdm_reset_receiver(&rp_data.in);
+	rdm_retag(rp_data.cmd, rp_data.scan_id);
+	rdm_drain(rp_data.cmd, rdm_queued_len(rp_data.cmd));
+}
+
+/*
+ * Moves the current directory listing, if complete, into the listing cache,
+ * and saves it on disk if it's large enough to be worth it
+ */
+static void cache_listing(void)
+{
+	struct file_list_snapshot *snap;
+	
+	if(!app_inst.location || !rp_data.pid ||
+		!rp_data.init_done || rp_data.partial) return;
+	
+	if(!app_res.listing_cache && !dsnap_enabled()) return;
+	
+	save_snapshot(&rp_data.loc_st);
+	if(!app_res.listing_cache) return;
+	
+	snap = file_list_detach_items(app_inst.wlist);
+	if(!snap) return;
+	
+	dcache_put(app_inst.location, &rp_data.loc_st, snap,
+		app_inst.nfiles_shown, app_inst.nfiles_hidden, &app_inst.size_shown);
+}
+
+/*
+ * Shows the cached listing of the current location, if there is one,
+ * or the snapshot saved on disk otherwise. Returns True if so.
+ */
+static Boolean restore_listing(void)
+{
+	struct dir_cache_ent *ent;
+	
+	ent = dcache_take(app_inst.location, &rp_data.loc_st);
+	if(!ent) return restore_snapshot(&rp_data.loc_st);
+	
+	if(ent->listing) return replay_listing(ent);
+	
+	file_list_attach_items(app_inst.wlist, ent->snap);
+	ent->snap = NULL;
+	
+	app_inst.nfiles_shown = ent->nfiles_shown;
+	app_inst.nfiles_hidden = ent->nfiles_hidden;
+	app_inst.size_shown = ent->size_shown;
+	dcache_free(ent);
+	
+	rp_data.init_done = True;
+	set_ui_sensitivity(UIF_DIR);
+	file_list_show_contents(app_inst.wlist, True);
+	update_shell_title(app_inst.location);
+	show_selection_stats();
+	
+	return True;
+}
+
+/*
+ * Shows a prefetched listing, as if it was just sent by the reader, and
+ * frees the cache entry. Returns True on success.
+ */
+static Boolean replay_listing(struct dir_cache_ent *ent)
+{
+	struct dir_listing *l = ent->listing;
+	unsigned int i;
+	
+	file_list_defer_layout(app_inst.wlist, True);
+	
+	for(i = 0; i < l->nrecs; i++) {
+		if(!process_message(&l->recs[i].msg, dlist_name(l, &l->recs[i])))
+			break;
+	}
+	if(i == l->nrecs) process_message(&l->totals, NULL);
+	
+	if(!rp_data.init_done) file_list_remove_all(app_inst.wlist);
+	file_list_defer_layout(app_inst.wlist, False);
+	dcache_free(ent);
+	
+	return rp_data.init_done;
+}
+
+/*
+ * Shows the listing of the current location saved on disk, if there is
+ * one for the same directory, type DB and filter settings. The listing
+ * is marked as stale until the reader is done checking it for changes.
+ * Returns True on success.
+ */
+static Boolean restore_snapshot(const struct stat *st)
+{
+	struct dsnap_reader r;
+	struct msg_data msg;
+	struct msg_data totals;
+	const char *name;
+	int res;
+	
+	if(!dsnap_enabled() || dsnap_open(&r, app_inst.location,
+		st, snapshot_key(), &totals)) return False;
+	
+	file_list_defer_layout(app_inst.wlist, True);
+	
+	while((res = dsnap_next(&r, &msg, &name)) > 0) {
+		if(!process_message(&msg, name)) break;
+	}
+	dsnap_close(&r);
+	
+	if(res == 0) {
+		process_message(&totals, NULL);
+	} else if(res < 0) {
+		dbg_printf("corrupt snapshot of %s\n", app_inst.location);
+		dsnap_remove(app_inst.location);
+	}
+	
+	if(!rp_data.init_done) file_list_remove_all(app_inst.wlist);
+	file_list_defer_layout(app_inst.wlist, False);
+	if(!rp_data.init_done) return False;
+	
+	rp_data.stale = True;
+	set_status_text("Checking %s for changes...", app_inst.location);
+	
+	return True;
+}
+
+/*
+ * Saves the current listing on disk, if it has savedListingMin items
+ * or more. The directory's attributes are passed in st.
+ */
+static void save_snapshot(const struct stat *st)
+{
+	struct dsnap_writer w;
+	struct file_list_item fli;
+	struct msg_data msg;
+	unsigned int i;
+	int res;
+	
+	/* there's nothing new in a listing restored from it just now */
+	if(!dsnap_enabled() || rp_data.stale ||
+		app_inst.nfiles_shown < app_res.saved_listing_min) return;
+	
+	res = dsnap_create(&w, app_inst.location, st, snapshot_key());
+	if(res) {
+		dbg_printf("dsnap_create: %s\n", strerror(res));
+		return;
+	}
+	
+	memset(&msg, 0, sizeof(struct msg_data));
+	msg.reason = MSG_ADD;
+	
+	for(i = 0; file_list_get_item_at(app_inst.wlist, i, &fli); i++) {
+		msg.flags = (fli.is_symlink ? MF_SYMLINK : 0) |
+			((fli.user_flags & FLI_MNTPOINT) ? MF_MPOINT : 0) |
+			((fli.user_flags & FLI_MOUNTED) ? MF_MOUNTED : 0);
+		msg.mode = fli.mode;
+		msg.ctime = fli.ctime;
+		msg.mtime = fli.mtime;
+		msg.uid = fli.uid;
+		msg.gid = fli.gid;
+		msg.size = fli.size;
+		msg.db_index = fli.db_type;
+		msg.icon = FLI_ICON(fli.user_flags);
+		dsnap_add(&w, &msg, fli.name);
+	}
+	
+	memset(&msg, 0, sizeof(struct msg_data));
+	msg.reason = MSG_EOD;
+	msg.fields = MF_TOTALS;
+	msg.files_total = app_inst.nfiles_shown;
+	msg.files_skipped = app_inst.nfiles_hidden;
+	msg.size_total = app_inst.size_shown;
+	
+	res = dsnap_commit(&w, &msg);
+	if(res) dbg_printf("dsnap_commit: %s\n", strerror(res));
+}
+
+void save_listing(void)
+{
+	if(!dsnap_enabled() || !app_inst.location ||
+		!rp_data.init_done || rp_data.partial) return;
+	
+	save_snapshot(&rp_data.loc_st);
+}
+
+/*
+ * Returns the key snapshots are saved with. Type DB indexes and filter
+ * settings decide what's in a listing, so these are part of the key.
+ */
+static unsigned int snapshot_key(void)
+{
+	static unsigned int db_key;
+	static Boolean db_hashed = False;
+	
+	/* the DB is loaded once, at startup */
+	if(!db_hashed) {
+		db_key = db_hash(&app_inst.type_db);
+		db_hashed = True;
+	}
+	
+	return dsnap_key(db_key, (app_res.show_all ? CF_SHOW_ALL : 0) |
+		(app_res.filter_dirs ? CF_FILTER_DIRS : 0), app_inst.filter);
+}
+
+/*
+ * Called with the name of the directory selected in the file list, or
+ * NULL if the selection is anything else. The directory, and the parent
+ * of the current one, are prefetched if the selection stays put for
+ * prefetchDelay milliseconds.
+ */
+void prefetch_selection(const char *name)
+{
+	if(!app_res.prefetch_delay) return;
+	
+	if(pf_data.selected) {
+		free(pf_data.selected);
+		pf_data.selected = NULL;
+	}
+	if(name) pf_data.selected = strdup(name);
+	
+	pf_data.hover = False;
+	set_dwell_timer();
+}
+
+/*
+ * (Re)starts the prefetch dwell timer
+ */
+static void set_dwell_timer(void)
+{
+	if(pf_data.dwell_iid) XtRemoveTimeOut(pf_data.dwell_iid);
+
+	pf_data.dwell_iid = XtAppAddTimeOut(app_inst.context,
+		app_res.prefetch_delay, dwell_timeout_cb, NULL);
+}
+
+/*
+ * File list pointer motion handler. Directories the pointer rests
+ * on are prefetched, much like selected ones.
+ */
+static void pointer_motion_handler(Widget w,
+	XtPointer client_data, XEvent *evt, Boolean *cont)
+{
+	if(evt->type == MotionNotify) {
+		pf_data.ptr_x = evt->xmotion.x;
+		pf_data.ptr_y = evt->xmotion.y;
+		pf_data.hover = True;
+		set_dwell_timer();
+	} else if(evt->type == LeaveNotify && pf_data.hover &&
+		pf_data.dwell_iid) {
+		XtRemoveTimeOut(pf_data.dwell_iid);
+		pf_data.dwell_iid = None;
+	}
+}
+
+/*
+ * Called once the pointer or selection stayed put for prefetchDelay.
+ * Starts prefetching the directory under the pointer, or selected,
+ * followed by the parent directory.
+ */
+static void dwell_timeout_cb(XtPointer data, XtIntervalId *iid)
+{
+	struct file_list_item fli;
+	const char *name = NULL;
+	char *path;
+	
+	pf_data.dwell_iid = None;
+	if(!app_inst.location) return;
+	
+	/* don't compete with the reader */
+	if(!rp_data.init_done) {
+		set_dwell_timer();
+		return;
+	}
+	
+	if(pf_data.hover) {
+		if(file_list_get_item_at_xy(app_inst.wlist,
+			pf_data.ptr_x, pf_data.ptr_y, &fli) && S_ISDIR(fli.mode))
+			name = fli.name;
+	} else {
+		name = pf_data.selected;
+	}
+	
+	if(pf_data.next_path) {
+		free(pf_data.next_path);
+		pf_data.next_path = NULL;
+	}
+	
+	if(strcmp(app_inst.location, "/")) {
+		path = strdup(app_inst.location);
+		if(path) pf_data.next_path = trim_path(path, 1);
+	}
+	
+	if(name) {
+		path = malloc(strlen(app_inst.location) + strlen(name) + 2);
+		if(path) {
+			sprintf(path, "%s/%s", app_inst.location, name);
+			strip_path(path);
+			start_prefetch(path);
 			return;
 		}
-		fname_buf = new_ptr;
+	}
+	start_next_prefetch();
+}
+
+/*
+ * Forks off a low priority process that reads the directory at path,
+ * and registers its output with Xt. Directories that are cached, or being
+ * prefetched already, are skipped. Path is owned by the routine.
+ */
+static void start_prefetch(char *path)
+{
+	sigset_t sigmask;
+	int fds[2];
+	pid_t pid;
+	
+	if(pf_data.path && !strcmp(pf_data.path, path)) {
+		free(path);
+		return;
+	}
+	stop_prefetch();
+	
+	/* not stat'ed here, since it may be on a file system that
+	 * doesn't respond; the prefetch process fails on non-directories */
+	if(!strcmp(path, app_inst.location) || dcache_has(path) ||
+		!(pf_data.listing = dlist_create())) {
+		free(path);
+		start_next_prefetch();
+		return;
+	}
+
+	if(pipe(fds)) {
+		free(path);
+		stop_prefetch();
+		return;
+	}
+	
+	sigemptyset(&sigmask);
+	sigaddset(&sigmask, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &sigmask, NULL);
+	
+	pid = fork();
+	if(pid == (-1)) {
+		sigprocmask(SIG_UNBLOCK, &sigmask, NULL);
+		close(fds[0]);
+		close(fds[1]);
+		free(path);
+		stop_prefetch();
+		return;
+	}
+	
+	if(!pid) {
+		close(XConnectionNumber(app_inst.display));
+		close(fds[0]);
+		if(rp_data.in_fd != -1) close(rp_data.in_fd);
+		if(rp_data.cmd_fd != -1) close(rp_data.cmd_fd);
+		if(ds_data.cmd_fd != -1) close(ds_data.cmd_fd);
+		
+		_exit(prefetch_main(path, fds[1]));
+	}
+
+	pf_data.pid = pid;
+	sigprocmask(SIG_UNBLOCK, &sigmask, NULL);
+	
+	dbg_printf("%d: prefetching %s\n", pid, path);
+	
+	close(fds[1]);
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+	
+	pf_data.fd = fds[0];
+	pf_data.path = path;
+	rdm_reset_receiver(&pf_data.in);
+	
+	pf_data.iid = XtAppAddInput(app_inst.context, pf_data.fd,
+		(XtPointer)XtInputReadMask, prefetch_input_proc, NULL);
+}
+
+/*
+ * Starts prefetching the directory queued, if any
+ */
+static void start_next_prefetch(void)
+{
+	char *path = pf_data.next_path;
+	
+	pf_data.next_path = NULL;
+	if(path) start_prefetch(path);
+}
+
+/*
+ * Kills the prefetch process, if any, and discards whatever it sent
+ */
+static void stop_prefetch(void)
+{
+	if(pf_data.pid) {
+		pid_t pid = pf_data.pid;
+		
+		/* reaped by the SIGCHLD handler */
+		pf_data.pid = 0;
+		kill(pid, SIGKILL);
+	}
+	
+	if(pf_data.iid) {
+		XtRemoveInput(pf_data.iid);
+		pf_data.iid = None;
+	}
+	
+	if(pf_data.fd != -1) {
+		close(pf_data.fd);
+		pf_data.fd = -1;
+	}
+	
+	if(pf_data.listing) {
+		dlist_free(pf_data.listing);
+		pf_data.listing = NULL;
+	}
+	
+	if(pf_data.path) {
+		free(pf_data.path);
+		pf_data.path = NULL;
+	}
+}
+
+/*
+ * Stops prefetching, and discards anything queued to be prefetched
+ */
+static void cancel_prefetch(void)
+{
+	if(pf_data.dwell_iid) {
+		XtRemoveTimeOut(pf_data.dwell_iid);
+		pf_data.dwell_iid = None;
+	}
+	
+	if(pf_data.next_path) {
+		free(pf_data.next_path);
+		pf_data.next_path = NULL;
+	}
+	
+	stop_prefetch();
+}
+
+/*
+ * Sets the directory identity fields of st (those listings are keyed with)
+ * to the MF_DIRID fields of an end-of-data message
+ */
+static void get_dir_id(const struct msg_data *msg, struct stat *st)
+{
+	memset(st, 0, sizeof(struct stat));
+	st->st_dev = msg->dir_dev;
+	st->st_ino = msg->dir_ino;
+	st->st_mtim = msg->dir_mtime;
+}
+
+/*
+ * Reads messages sent by the prefetch process. The listing is put into
+ * the listing cache once it's complete, and the next one is started.
+ */
+static void prefetch_input_proc(XtPointer p, int *fd, XtInputId *id)
+{
+	struct msg_data msg;
+	const char *name;
+	int res, n;
+	
+	res = rdm_receive(&pf_data.in, pf_data.fd);
+	
+	while((n = rdm_next(&pf_data.in, &msg, &name)) > 0) {
+		if(msg.reason == MSG_ADD && name) {
+			if(dlist_add(pf_data.listing, &msg, name) ||
+				dlist_size(pf_data.listing) / 1024 > app_res.listing_cache) {
+				n = -1;
+				break;
+			}
+		} else if(msg.reason == MSG_EOD && (msg.fields & MF_DIRID)) {
+			struct stat st;
+			
+			get_dir_id(&msg, &st);
+			pf_data.listing->totals = msg;
+			dcache_put_listing(pf_data.path, &st, pf_data.listing);
+			pf_data.listing = NULL;
+			break;
+		} else {
+			/* error, or the directory wasn't worth prefetching */
+			n = -1;
+			break;
+		}
+	}
+	
+	if(!pf_data.listing || n < 0 || res) {
+		stop_prefetch();
+		start_next_prefetch();
+	}
+}
+
+/*
+ * Tells the sizing process to size subdirectories of the current
+ * location, starting it first if necessary. Those in view go first.
+ */
+static void start_dir_sizes(void)
+{
+	struct msg_data msg;
+	char *path;
+	int res;
+	
+	if(ds_data.in_fd == -1 && start_dirsize_proc()) return;
+	if(!(path = get_working_dir())) return;
+	
+	if(++ds_data.tag > 0xFFFF) ds_data.tag = 1;
+	rdm_retag(ds_data.cmd, ds_data.tag);
+	
+	memset(&msg, 0, sizeof(struct msg_data));
+	msg.reason = CMD_SIZE_BASE;
+	msg.flags = (app_res.show_all ? CF_SHOW_ALL : 0) |
+		((app_inst.dir_sizes == DSIZE_TOTAL) ? CF_RECURSIVE : 0);
+	res = rdm_put(ds_data.cmd, &msg, path);
+	free(path);
+	if(res) return;
+	
+	ds_data.active = True;
+	ds_data.vis_first = ds_data.vis_end = 0;
+	request_visible_sizes();
+	
+	if(rdm_flush(ds_data.cmd)) return;
+	write_dirsize_commands();
+
+	if(!ds_data.vis_iid) {
+		ds_data.vis_iid = XtAppAddTimeOut(app_inst.context,
+			DS_VISIBLE_INT, dirsize_visible_cb, NULL);
+	}
+}
+
+/*
+ * Tells the sizing process to stop sizing the current location.
+ * Anything it sent for it in the meantime is dropped on arrival.
+ */
+static void stop_dir_sizes(void)
+{
+	struct msg_data msg;
+	
+	if(ds_data.vis_iid) {
+		XtRemoveTimeOut(ds_data.vis_iid);
+		ds_data.vis_iid = None;
+	}
+
+	if(!ds_data.active) return;
+	ds_data.active = False;
+	
+	if(++ds_data.tag > 0xFFFF) ds_data.tag = 1;
+	rdm_retag(ds_data.cmd, ds_data.tag);
+	
+	memset(&msg, 0, sizeof(struct msg_data));
+	msg.reason = CMD_SIZE_BASE;
+	if(rdm_put(ds_data.cmd, &msg, NULL) || rdm_flush(ds_data.cmd)) return;
+	write_dirsize_commands();
+}
+
+/*
+ * Asks for the named subdirectory to be (re)sized next
+ */
+static void request_dir_size(const char *name)
+{
+	struct msg_data msg;
+	
+	memset(&msg, 0, sizeof(struct msg_data));
+	msg.reason = CMD_SIZE;
+	msg.flags = CF_RECHECK;
+	if(rdm_put(ds_data.cmd, &msg, name) || rdm_flush(ds_data.cmd)) return;
+	write_dirsize_commands();
+}
+
+/*
+ * Asks for subdirectories in view to be sized next, unless these
+ * were asked for already. Those sized already are skipped by the
+ * sizing process.
+ */
+static void request_visible_sizes(void)
+{
+	struct file_list_item fli;
+	struct msg_data msg;
+	unsigned int i, first, end;
+	int res = 0;
+	
+	file_list_get_visible(app_inst.wlist, &first, &end);
+	if(first == ds_data.vis_first && end == ds_data.vis_end) return;
+
+	ds_data.vis_first = first;
+	ds_data.vis_end = end;
+
+	memset(&msg, 0, sizeof(struct msg_data));
+	msg.reason = CMD_SIZE;
+	
+	for(i = first; !res && i < end &&
+		file_list_get_item_at(app_inst.wlist, i, &fli); i++) {
+		if(S_ISDIR(fli.mode) && !fli.partial)
+			res = rdm_put(ds_data.cmd, &msg, fli.name);
+	}
+	
+	if(!res) res = rdm_flush(ds_data.cmd);
+	if(!res) write_dirsize_commands();
+}
+
+/*
+ * Checks whether the list was scrolled while sizing is underway
+ */
+static void dirsize_visible_cb(XtPointer cd, XtIntervalId *iid)
+{
+	ds_data.vis_iid = None;
+	if(!ds_data.active) return;
+	
+	request_visible_sizes();
+	ds_data.vis_iid = XtAppAddTimeOut(app_inst.context,
+		DS_VISIBLE_INT, dirsize_visible_cb, NULL);
+}
+
+/*
+ * Reads results sent by the sizing process and puts these into the list
+ */
+static void dirsize_input_proc(XtPointer p, int *fd, XtInputId *id)
+{
+	struct msg_data msg;
+	const char *name;
+	int res, n;
+	
+	res = rdm_receive(&ds_data.in, ds_data.in_fd);
+	
+	while((n = rdm_next(&ds_data.in, &msg, &name)) > 0) {
+		/* pertains to a location that was left */
+		if(rdm_tag(&ds_data.in) != ds_data.tag || !ds_data.active) continue;
+		
+		if(msg.reason == MSG_DIRSIZE && name) {
+			file_list_set_dir_size(app_inst.wlist, name, msg.files_total,
+				(msg.fields & MF_SIZE) ? msg.size : -1);
+		} else if(msg.reason == MSG_EOD) {
+			/* all done, until something changes */
+			if(ds_data.vis_iid) {
+				XtRemoveTimeOut(ds_data.vis_iid);
+				ds_data.vis_iid = None;
+			}
+		}
+	}
+	
+	if(n < 0 || res) {
+		dbg_trace("sizing process gone\n");
+		stop_dirsize_proc();
+	}
+}
+
+/*
+ * Writes out queued commands as far as the pipe takes these,
+ * same as write_commands does for the reader.
+ */
+static void write_dirsize_commands(void)
+{
+	struct rdm_sender *s = ds_data.cmd;
+
+	if(ds_data.cmd_fd == -1) {
+		rdm_drain(s, rdm_queued_len(s));
+		return;
+	}
+	
+	while(rdm_queued_len(s)) {
+		ssize_t n = write(ds_data.cmd_fd, rdm_queued(s), rdm_queued_len(s));
+		
+		if(n == -1) {
+			if(errno == EINTR) continue;
+			if(errno != EAGAIN && errno != EWOULDBLOCK) {
+				dbg_trace("write: %s\n", strerror(errno));
+				rdm_drain(s, rdm_queued_len(s));
+			}
+			break;
+		}
+		rdm_drain(s, n);
+	}
+	
+	if(rdm_queued_len(s) && !ds_data.cmd_iid) {
+		ds_data.cmd_iid = XtAppAddInput(app_inst.context, ds_data.cmd_fd,
+			(XtPointer)XtInputWriteMask, dirsize_write_proc, NULL);
+	} else if(!rdm_queued_len(s) && ds_data.cmd_iid) {
+		XtRemoveInput(ds_data.cmd_iid);
+		ds_data.cmd_iid = None;
+	}
+}
+
+static void dirsize_write_proc(XtPointer cd, int *pfd, XtInputId *iid)
+{
+	write_dirsize_commands();
+}
+
+/*
+ * Forks off the sizing process and registers communication pipes
+ * with Xt. Returns zero on success, errno otherwise.
+ */
+static int start_dirsize_proc(void)
+{
+	sigset_t sigmask;
+	int out_fds[2];
+	int cmd_fds[2];
+	pid_t pid;
+	
+	if(pipe(out_fds)) return errno;
+	if(pipe(cmd_fds)) {
+		int res = errno;
+		close(out_fds[0]);
+		close(out_fds[1]);
+		return res;
+	}
+	
+	sigemptyset(&sigmask);
+	sigaddset(&sigmask, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &sigmask, NULL);
+	
+	pid = fork();
+	if(pid == (-1)) {
+		int res = errno;
+		
+		sigprocmask(SIG_UNBLOCK, &sigmask, NULL);
+		close(out_fds[0]);
+		close(out_fds[1]);
+		close(cmd_fds[0]);
+		close(cmd_fds[1]);
+		return res;
+	}
+	
+	if(!pid) {
+		close(XConnectionNumber(app_inst.display));
+		close(out_fds[0]);
+		close(cmd_fds[1]);
+		if(rp_data.in_fd != -1) close(rp_data.in_fd);
+		if(rp_data.cmd_fd != -1) close(rp_data.cmd_fd);
+		if(pf_data.fd != -1) close(pf_data.fd);
+		
+		_exit(dsize_main(cmd_fds[0], out_fds[1]) ? 1 : 0);
+	}
+	
+	ds_data.pid = pid;
+	sigprocmask(SIG_UNBLOCK, &sigmask, NULL);
+	
+	dbg_printf("%d: sizing process started\n", pid);
+	
+	close(out_fds[1]);
+	close(cmd_fds[0]);
+	fcntl(out_fds[0], F_SETFL, O_NONBLOCK);
+	fcntl(out_fds[0], F_SETFD, FD_CLOEXEC);
+	fcntl(cmd_fds[1], F_SETFL, O_NONBLOCK);
+	fcntl(cmd_fds[1], F_SETFD, FD_CLOEXEC);
+	
+	ds_data.in_fd = out_fds[0];
+	ds_data.cmd_fd = cmd_fds[1];
+	rdm_reset_receiver(&ds_data.in);
+	
+	ds_data.iid = XtAppAddInput(app_inst.context, ds_data.in_fd,
+		(XtPointer)XtInputReadMask, dirsize_input_proc, NULL);
+	return 0;
+}
+
+/*
+ * Kills the sizing process, if any; it's started again when needed
+ */
+static void stop_dirsize_proc(void)
+{
+	if(ds_data.pid) {
+		pid_t pid = ds_data.pid;
+		
+		/* reaped by the SIGCHLD handler */
+		ds_data.pid = 0;
+		kill(pid, SIGKILL);
+	}
+	
+	if(ds_data.iid) {
+		XtRemoveInput(ds_data.iid);
+		ds_data.iid = None;
+	}
+	
+	if(ds_data.cmd_iid) {
+		XtRemoveInput(ds_data.cmd_iid);
+		ds_data.cmd_iid = None;
+	}
+
+	if(ds_data.vis_iid) {
+		XtRemoveTimeOut(ds_data.vis_iid);
+		ds_data.vis_iid = None;
+	}
+	
+	if(ds_data.in_fd != -1) {
+		close(ds_data.in_fd);
+		ds_data.in_fd = -1;
+	}
+	
+	if(ds_data.cmd_fd != -1) {
+		close(ds_data.cmd_fd);
+		ds_data.cmd_fd = -1;
+	}
+	
+	rdm_drain(ds_data.cmd, rdm_queued_len(ds_data.cmd));
+	ds_data.active = False;
+}
+
+/*
+ * Tells the directory reader to stop reading/watching the current location
+ */
+void stop_read_proc(void)
+{
+	if(xt_update_iid) {
+		XtRemoveTimeOut(xt_update_iid);
+		xt_update_iid = None;
+	}
+
+	if(rp_data.pid) {
+		next_scan_id();
+		send_command(CMD_STOP);
+	}
+	reset_context_data();
+}
+
+
+/*
+ * Called periodically to update status bar text while a directory is read
+ */
+static void status_timeout_cb(XtPointer data, XtIntervalId *iid)
+{
+	xt_update_iid = None;
+	if(rp_data.init_done) return;
+	
+	/* show what was read so far, and let the user go elsewhere */
+	if(app_res.read_timeout && !rp_data.stalled &&
+		!msecs_until(&rp_data.stall_time)) {
+		dbg_trace("reader stalled on %s\n", app_inst.location);
+		rp_data.stalled = True;
+		if(!rp_data.progressive) {
+			rp_data.progressive = True;
+			file_list_show_contents(app_inst.wlist, True);
+		}
+		set_ui_sensitivity(UIF_DIR);
+	}
+	
+	/* lay out whatever was added since */
+	if(rp_data.progressive) {
+		file_list_defer_layout(app_inst.wlist, False);
+		file_list_defer_layout(app_inst.wlist, True);
+	}
+	
+	if(rp_data.stalled) {
+		set_status_text("Stalled reading %s (%u items), still trying...",
+			app_inst.location, app_inst.nfiles_read);
+	} else {
+		set_status_text("Reading %s (%u items)",
+			app_inst.location, app_inst.nfiles_read);
+	}
+	xt_update_iid = XtAppAddTimeOut(app_inst.context,
+		STATUS_UPDATE_INT, status_timeout_cb, NULL);
+}
+
+/*
+ * Called when there is data from the directory reader to be read
+ */
+static void reader_callback_proc(XtPointer cd, int *pfd, XtInputId *iid)
+{
+	if(drain_messages() && !rp_data.drain_wpid) {
+		rp_data.drain_wpid = XtAppAddWorkProc(app_inst.context,
+			drain_work_proc, NULL);
+	}
+}
+
+/*
+ * Carries on processing messages that were left over once the event
+ * queue is empty. Returns True (done) when there's nothing left.
+ */
+static Boolean drain_work_proc(XtPointer cd)
+{
+	if(drain_messages()) return False;
+
+	rp_data.drain_wpid = None;
+	return True;
+}
+
+/*
+ * Reads and processes messages sent by the directory reader until the
+ * pipe is empty, or RP_DRAIN_TIME is up, so that a large directory
+ * doesn't lock up the UI. Returns True if there is more data buffered.
+ */
+static Boolean drain_messages(void)
+{
+	struct msg_data msg;
+	const char *name;
+	struct timespec deadline;
+	unsigned int count = 0;
+	Boolean more = False;
+	size_t buffered;
+	int res;
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	add_msecs(&deadline, RP_DRAIN_TIME);
+	
+	/* lay out and redraw once for everything processed, or
+	 * periodically while reading progressively (see status_timeout_cb) */
+	file_list_defer_layout(app_inst.wlist, True);
+
+	for(;;) {
+		while((res = rdm_next(&rp_data.in, &msg, &name)) > 0) {
+			/* left over from a scan that was superseded */
+			if(rdm_tag(&rp_data.in) != rp_data.scan_id) continue;
+
+			/* returns False if the reader was stopped */
+			if(!process_message(&msg, name)) break;
+
+			if(!(++count % RP_DRAIN_CHECK) && !msecs_until(&deadline)) {
+				more = True;
+				break;
+			}
+		}
+		if(res) break;
+		
+		/* the reader is gone, SIGCHLD handler deals with that */
+		if(!rp_data.iid) break;
+
+		buffered = rdm_buffered(&rp_data.in);
+		res = rdm_receive(&rp_data.in, rp_data.in_fd);
+
+		if(res == EPIPE) {
+			/* process whatever was read before EOF */
+			XtRemoveInput(rp_data.iid);
+			rp_data.iid = None;
+		} else if(res) {
+			read_error_msg(app_inst.location, strerror(res), False);
+			kill_read_proc();
+			stop_read_proc();
+			more = False;
+			break;
+		}
+		
+		if(rdm_buffered(&rp_data.in) == buffered) break;
+	}
+	
+	/* the reader is making progress */
+	if(count) {
+		set_stall_time();
+		rp_data.stalled = False;
+	}
+	
+	/* show the first batch of items read right away, rather
+	 * than waiting for the whole directory to be read */
+	if(!rp_data.init_done && !rp_data.progressive &&
+		app_inst.nfiles_read && res >= 0) {
+		rp_data.progressive = True;
+		file_list_show_contents(app_inst.wlist, True);
+	}
+	
+	if(!rp_data.progressive)
+		file_list_defer_layout(app_inst.wlist, False);
+
+	if(res < 0) {
+		read_error_msg(app_inst.location,
+			"Invalid data received from the reader process", False);
+		kill_read_proc();
+		stop_read_proc();
+		more = False;
+	}
+	return more;
+}
+
+/*
+ * Processes a single directory reader message.
+ * Returns False if the reader had to be stopped due to an error.
+ */
+static Boolean process_message(const struct msg_data *msg, const char *name)
+{
+	struct file_list_item fli;
+	Pixmap pm_icon;
+	Pixmap pm_mask;
+	Boolean update = False;
+	int db_index;
+	int res;
+
+	if(msg->reason != MSG_EOD && msg->reason != MSG_ERROR && !name) {
+		read_error_msg(app_inst.location,
+			"Invalid data received from the reader process", False);
+		stop_read_proc();
+		return False;
+	}
+
+	switch(msg->reason) {
+		case MSG_EOD: {
+			Boolean changed = 
+				(app_inst.nfiles_hidden != msg->files_skipped ||
+				app_inst.nfiles_shown != msg->files_total ||
+				app_inst.size_shown.size != msg->size_total.size ||
+				app_inst.size_shown.exp != msg->size_total.exp)
+				
+				? True : False;
+
+			app_inst.nfiles_hidden = msg->files_skipped;
+			app_inst.nfiles_shown = msg->files_total;
+			app_inst.size_shown = msg->size_total;
+			
+			/* the listing is as recent as that, at least */
+			if(msg->fields & MF_DIRID) get_dir_id(msg, &rp_data.loc_st);
+			
+			/* the saved listing was brought up to date */
+			if(rp_data.stale) {
+				rp_data.stale = False;
+				changed = True;
+			}
+
+			if(!rp_data.init_done) {
+				rp_data.init_done = True;
+				rp_data.progressive = False;
+				changed = True;
+				if(xt_update_iid) {
+					XtRemoveTimeOut(xt_update_iid);
+					xt_update_iid = None;
+				}
+
+				set_ui_sensitivity(UIF_DIR);
+				file_list_show_contents(app_inst.wlist, True);
+				update_shell_title(app_inst.location);
+				#ifdef DEBUG
+				report_throughput();
+				#endif
+			}
+			
+			/* names only so far; items keep their place while
+			 * attributes arrive, and are sorted once these are in */
+			rp_data.partial = (msg->flags & MF_PARTIAL) ? True : False;
+			file_list_defer_sort(app_inst.wlist, rp_data.partial);
+			
+			/* subdirectories are sized once all are known */
+			if(!rp_data.partial && !ds_data.active &&
+				app_inst.dir_sizes != DSIZE_NONE) start_dir_sizes();
+
+			if(changed) show_selection_stats();
+
+		} break;
+		
+		case MSG_UPDATE:
+		update = True; /* ...and fall through */
+		case MSG_ADD:
+		
+		db_index = (msg->fields & MF_DBINDEX) ? msg->db_index : DB_UNKNOWN;
+		if(!get_entry_icon(msg, &pm_icon, &pm_mask))
+			pm_icon = pm_mask = None;
+		
+		fli.name = (char*)name;
+		fli.title = (char*)name;
+		fli.db_type = db_index;
+		fli.size = msg->size;
+		fli.mode = msg->mode;
+		fli.uid = msg->uid;
+		fli.gid = msg->gid;
+		fli.ctime = msg->ctime;
+		fli.mtime = msg->mtime;
+		fli.icon = pm_icon;
+		fli.icon_mask = pm_mask;
+		fli.is_symlink = (msg->flags & MF_SYMLINK) ? True : False;
+		fli.partial = (msg->flags & MF_PARTIAL) ? True : False;
+		fli.user_flags = ((msg->flags & MF_MPOINT) ? FLI_MNTPOINT : 0) |
+			((msg->flags & MF_MOUNTED) ? FLI_MOUNTED : 0) |
+			(((msg->fields & MF_ICON) ? msg->icon : MI_FILE) << FLI_ICON_SHIFT);
+		
+		res = file_list_add(app_inst.wlist, &fli, update);
+		
+		if(!update) app_inst.nfiles_read++;
+		
+		if(res)	{
+			read_error_msg(app_inst.location, strerror(res), False);
+			stop_read_proc();
+			return False;
+		}
+		
+		/* created or changed since sizing started */
+		if(ds_data.active && S_ISDIR(msg->mode) && !fli.partial)
+			request_dir_size(name);
+		break;
+		
+		case MSG_REMOVE:
+		file_list_remove(app_inst.wlist, name);
+		break;
+
+		case MSG_ERROR:
+		/* the reader gave up on this one and is waiting for the next */
+		if(xt_update_iid) {
+			XtRemoveTimeOut(xt_update_iid);
+			xt_update_iid = None;
+		}
+		read_error_msg(app_inst.location,
+			read_proc_error(msg->stat_errno), False);
+		reset_context_data();
+		return False;
+	}
+	return True;
+}
+
+/*
+ * Retrieves the icon for a MSG_ADD/UPDATE message; the type's own icon
+ * if there is one, or the built-in one for the icon class the reader
+ * decided on. Pixmaps are looked up once and cached in tables indexed
+ * by the type DB index and icon class. Returns False if none is found.
+ */
+static Boolean get_entry_icon(const struct msg_data *msg,
+	Pixmap *image, Pixmap *mask)
+{
+	struct icon_pixmaps *ip;
+	int icon;
+
+	if((msg->fields & MF_DBINDEX) && DB_DEFINED(msg->db_index) &&
+		msg->db_index < app_inst.type_db.count) {
+		struct file_type_rec *ft = &app_inst.type_db.recs[msg->db_index];
+		
+		if(!type_icons) {
+			type_icons = calloc(app_inst.type_db.count,
+				sizeof(struct icon_pixmaps));
+		}
+		
+		if(type_icons && ft->icon_name) {
+			ip = &type_icons[msg->db_index];
+
+			if(ip->state == IPS_UNKNOWN) {
+				ip->state = get_icon_pixmap(ft->icon_name,
+					app_inst.icon_size_id, &ip->image, &ip->mask) ?
+					IPS_LOADED : IPS_FAILED;
+			}
+			if(ip->state == IPS_LOADED) {
+				*image = ip->image;
+				*mask = ip->mask;
+				return True;
+			}
+		}
+	}
+
+	icon = (msg->fields & MF_ICON) ? msg->icon : MI_FILE;
+	if(icon >= NUM_MSG_ICONS) icon = MI_FILE;
+
+	ip = &class_icons[icon];
+	if(ip->state == IPS_UNKNOWN) {
+		ip->state = get_icon_pixmap(class_icon_names[icon],
+			app_inst.icon_size_id, &ip->image, &ip->mask) ?
+			IPS_LOADED : IPS_FAILED;
+	}
+	if(ip->state == IPS_FAILED) return False;
+
+	*image = ip->image;
+	*mask = ip->mask;
+	return True;
+}
+
+#ifdef DEBUG
+/*
+ * Prints message transfer statistics for the scan just completed
+ */
+static void report_throughput(void)
+{
+	struct timespec now;
+	double secs;
+	
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	secs = (now.tv_sec - rp_data.scan_start.tv_sec) +
+		(now.tv_nsec - rp_data.scan_start.tv_nsec) / 1.0e9;
+	if(secs <= 0) secs = 1.0e-9;
+	
+	dbg_printf("%s: %lu records, %lu KB through the pipe, %lu KB "
+		"through the ring in %.3fs (%.0f rec/s, %.1f MB/s)\n",
+		app_inst.location, rp_data.in.nrecs_total,
+		rp_data.in.pipe_bytes / 1024, rp_data.in.ring_bytes / 1024, secs,
+		rp_data.in.nrecs_total / secs,
+		(rp_data.in.pipe_bytes + rp_data.in.ring_bytes) / secs / 1048576.0);
+}
+#endif /* DEBUG */
+
+/*
+ * Reader error message reporting convenience routine.
+ */
+static void read_error_msg(const char *path, const char *estr, Boolean blocking)
+{
+	char tmpl[] = "Error reading %s\n%s.";
+	char *buffer;
+
+	if(!estr) estr = "Unexpected error";
+	buffer = malloc(snprintf(NULL, 0, tmpl, path, estr) + 1);
+	sprintf(buffer, tmpl, path, estr);
+	message_box(app_inst.wshell,
+		(blocking ? MB_ERROR : MB_ERROR_NB), APP_TITLE, buffer);
+	free(buffer);
+}
+
+/*
+ * Returns True if file_name should be displayed. Sets db_index if the
+ * entry had to be matched against the type database to tell.
+ */
+static Boolean filter(const char *file_name,
+	const struct stat *st, int *db_index)
+{
+	struct filter_ent ent;
+	
+	if(file_name[0] == '.' && !app_res.show_all)
+		return False;
+
+	if(S_ISDIR(st->st_mode) && !app_res.filter_dirs)
+		return True;
+
+	/* show entries that couldn't be stat'ed unless the name tells */
+	ent.name = file_name;
+	ent.st = st->st_mode ? st : NULL;
+	ent.db_index = FILTER_NO_DB;
+	ent.name_only = sniff_contents() ? 0 : 1;
+	
+	if(!filter_eval(&app_inst.filter_prog, &ent)) return False;
+	
+	*db_index = ent.db_index;
+	return True;
+}
+
+
+/*
+ * Same as filter, but without stat data, and with the file type as
+ * reported by readdir, which may be zero (unknown) or a symlink.
+ * Returns 1 if file_name should be displayed, 0 if not, or -1 if that
+ * can't be told without stat.
+ */
+static int filter_type(const char *file_name, mode_t type)
+{
+	struct filter_ent ent;
+	int res;
+
+	if(file_name[0] == '.' && !app_res.show_all)
+		return 0;
+	
+	if(S_ISDIR(type) && !app_res.filter_dirs)
+		return 1;
+	
+	ent.name = file_name;
+	ent.st = NULL;
+	ent.db_index = FILTER_NO_DB;
+	ent.name_only = sniff_contents() ? 0 : 1;
+	res = filter_eval(&app_inst.filter_prog, &ent);
+	
+	/* only the (target's) type matters, and whether it's a directory,
+	 * which would be shown regardless unless filter_dirs is set */
+	if((!type || S_ISLNK(type)) && !app_res.filter_dirs && res != 1)
+		return -1;
+	
+	return res;
+}
+
+/*
+ * Returns True if types of entries may be told by their contents, which
+ * the file system policy must allow, and takes being in the directory
+ */
+static Boolean sniff_contents(void)
+{
+	return ((scan_policy->flags & FSP_SNIFF) && in_scan_dir) ? True : False;
+}
+
+/*
+ * Directory reader process entry point. The reader is started once, and
+ * reads directories as requested by the parent, watching the last one
+ * for changes until told otherwise. Returns on failure only.
+ */
+static int read_proc_main(int cmd_fd, int out_fd)
+{
+	struct watch_data wd;
+	int res;
+	
+	dbg_printf("%d: new read/watch process\n", getpid());
+	rsignal(SIGTERM, read_proc_sigterm, 0);
+	
+	memset(&wd, 0, sizeof(struct watch_data));
+	wd.cmd_fd = cmd_fd;
+	wd.notify_fd = -1;
+	wd.notify_wd = -1;
+	wd.watchd_fd = -1;
+	wd.state = RS_IDLE;
+
+	wd.out = malloc(sizeof(struct rdm_sender));
+	if(!wd.out || dtab_init(&wd.list) || lcache_init(&wd.links) ||
+		rdm_init_receiver(&wd.in))
+		return RP_ENOMEM;
+	rdm_init_sender(wd.out, out_fd);
+	rdm_sender_ring(wd.out, rp_data.ring);
+	
+	#ifdef __linux__
+	wd.notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	#endif
+	
+	/* where there's no mount table, paths are probed with stat */
+	res = mtab_open();
+	if(res) dbg_printf("%d: mtab_open: %s\n", getpid(), strerror(res));
+	
+	for(;;) {
+		if(wd.state == RS_READ) {
+			wd.rescan = False;
+			res = read_contents(&wd);
+			if(!res) {
+				wd.state = RS_WATCH;
+				schedule_poll(&wd, True);
+			}
+		} else if(wd.state == RS_WATCH && wd.rescan) {
+			wd.rescan = False;
+			res = rescan_directory(&wd);
+			if(!res) schedule_poll(&wd, True);
+		} else {
+			res = wait_events(&wd);
+		}
+		
+		/* the scan in progress was superseded by a new one */
+		if(res == RP_ABORT) res = read_commands(&wd, False);
+		
+		if(res) {
+			send_error(&wd, res);
+			end_scan(&wd);
+		}
+	}
+	return RP_SUCCES;
+}
+
+/*
+ * Prefetch process entry point. Reads the directory at path once, at low
+ * CPU and I/O priority, and sends its contents as MSG_ADD messages followed
+ * by MSG_EOD. Remote file systems aren't worth the trouble, and nothing is
+ * sent for these. Returns RP_* code.
+ */
+static int prefetch_main(const char *path, int out_fd)
+{
+	struct watch_data wd;
+	int res;
+	
+	if(nice(PF_NICE) == -1) dbg_printf("%d: nice failed\n", getpid());
+	#if defined(__linux__) && defined(SYS_ioprio_set)
+	syscall(SYS_ioprio_set, PF_IOPRIO_WHO_PROCESS, 0, PF_IOPRIO_IDLE);
+	#endif
+	
+	memset(&wd, 0, sizeof(struct watch_data));
+	wd.cmd_fd = -1;
+	wd.notify_fd = -1;
+	wd.notify_wd = -1;
+	wd.watchd_fd = -1;
+	wd.state = RS_IDLE;
+	
+	/* read once, not watched */
+	app_res.watcher_daemon = False;
+	
+	wd.out = malloc(sizeof(struct rdm_sender));
+	if(!wd.out || dtab_init(&wd.list) || lcache_init(&wd.links))
+		return RP_ENOMEM;
+	rdm_init_sender(wd.out, out_fd);
+	mtab_open();
+	
+	res = begin_scan(&wd, path, 0);
+	if(res || wd.fs_class == FSC_REMOTE || wd.fs_class == FSC_FUSE)
+		return res;
+	
+	/* everything in the directory is new to an empty watch list */
+	return rescan_directory(&wd);
+}
+
+/*
+ * Waits for commands from the parent, and while watching the directory,
+ * for changes in it, processing whichever comes first.
+ * Returns zero on success, RP_* error code otherwise.
+ */
+static int wait_events(struct watch_data *wd)
+{
+	struct pollfd pfd[3];
+	nfds_t nfds = 1;
+	nfds_t mtab_pfd = 0;
+	nfds_t notify_pfd = 0;
+	nfds_t watchd_pfd = 0;
+	int timeout = -1;
+	int res;
+	
+	pfd[0].fd = wd->cmd_fd;
+	pfd[0].events = POLLIN;
+	pfd[0].revents = 0;
+	
+	/* while paused, changes pile up until watching is resumed */
+	if(wd->state == RS_WATCH && !wd->paused) {
+		if(mtab_fd() != -1) {
+			mtab_pfd = nfds++;
+			pfd[mtab_pfd].fd = mtab_fd();
+			pfd[mtab_pfd].events = POLLPRI;
+			pfd[mtab_pfd].revents = 0;
+		}
+
+		#ifdef __linux__
+		if(wd->notify_wd != -1) {
+			notify_pfd = nfds++;
+			pfd[notify_pfd].fd = wd->notify_fd;
+			pfd[notify_pfd].events = POLLIN;
+			pfd[notify_pfd].revents = 0;
+		} else
+		#endif
+		if(wd->subscribed) {
+			watchd_pfd = nfds++;
+			pfd[watchd_pfd].fd = wd->watchd_fd;
+			pfd[watchd_pfd].events = POLLIN;
+			pfd[watchd_pfd].revents = 0;
+			
+			/* heartbeats stop coming if it's stuck on a file system */
+			if(app_res.read_timeout)
+				timeout = msecs_until(&wd->watchd_deadline);
+		} else {
+			/* no notifications; reread it when due (see schedule_poll) */
+			timeout = msecs_until(&wd->next_poll);
+		}
+	}
+	
+	res = poll(pfd, nfds, timeout);
+	if(res == -1) return (errno == EINTR) ? 0 : RP_IOFAIL;
+
+	if(res == 0) {
+		unsigned int nchanges = wd->nchanges;
+		
+		if(watchd_pfd) {
+			dbg_printf("%d: the watcher daemon doesn't respond\n", getpid());
+			return drop_watchd(wd);
+		}
+
+		res = poll_directory(wd);
+		if(!res) schedule_poll(wd, (wd->nchanges != nchanges));
+		return res;
+	}
+	
+	if(pfd[0].revents) {
+		res = read_commands(wd, False);
+		if(res) return res;
+	}
+	
+	/* the scan may have ended, or been superseded by now */
+	if(wd->state != RS_WATCH) return 0;
+
+	if(mtab_pfd && pfd[mtab_pfd].revents) {
+		res = update_mounts(wd);
+		if(res) return res;
+	}
+
+	#ifdef __linux__
+	if(notify_pfd && pfd[notify_pfd].revents) return read_events(wd);
+	#endif
+
+	if(watchd_pfd && pfd[watchd_pfd].revents) return read_watchd_events(wd);
+
+	return 0;
+}
+
+/*
+ * Reads and processes commands from the parent. If reading is True,
+ * a directory is being read, and commands pertaining to a new scan are
+ * left in the buffer, so that the read can be abandoned first; RP_ABORT
+ * is returned then. Returns zero on success, RP_* error code otherwise.
+ */
+static int read_commands(struct watch_data *wd, Boolean reading)
+{
+	struct msg_data msg;
+	const char *name;
+	unsigned int tag;
+	int res;
+	
+	res = rdm_receive(&wd->in, wd->cmd_fd);
+	if(res == EPIPE) _exit(RP_SUCCES); /* the parent exited */
+	if(res) return RP_IOFAIL;
+	
+	while(rdm_peek_tag(&wd->in, &tag)) {
+		if(tag != wd->tag) {
+			if(reading) return RP_ABORT;
+
+			/* anything queued for the previous scan is of no use now */
+			end_scan(wd);
+			wd->tag = tag;
+			rdm_retag(wd->out, tag);
+		}
+
+		res = rdm_next(&wd->in, &msg, &name);
+		if(res == 0) break;
+		if(res < 0) _exit(RP_IOFAIL); /* there's no way to resync */
+		
+		switch(msg.reason) {
+			case CMD_FILTER:
+			app_res.show_all = (msg.flags & CF_SHOW_ALL) ? True : False;
+			app_res.filter_dirs =
+				(msg.flags & CF_FILTER_DIRS) ? True : False;
+			set_filter(name);
+			break;
+			
+			case CMD_SORT:
+			wd->sort_names = True;
+			wd->sort_flags = msg.flags;
+			break;
+			
+			case CMD_SCAN:
+			res = begin_scan(wd, name, msg.flags);
+			if(res) {
+				send_error(wd, res);
+				end_scan(wd);
+			}
+			break;
+			
+			case CMD_PRIME:
+			if(wd->state != RS_PRIME) break;
+
+			if(!name) {
+				wd->state = RS_READ;
+			} else if(prime_entry(wd, name, &msg)) {
+				send_error(wd, RP_ENOMEM);
+				end_scan(wd);
+			}
+			break;
+			
+			case CMD_RESCAN:
+			if(wd->state == RS_READ || wd->state == RS_WATCH)
+				wd->rescan = True;
+			break;
+			
+			case CMD_STOP:
+			end_scan(wd);
+			break;
+			
+			case CMD_PAUSE:
+			wd->paused = True;
+			break;
+			
+			case CMD_RESUME:
+			wd->paused = False;
+			if(wd->state != RS_WATCH) break;
+
+			/* inotify events that piled up are picked up by wait_events;
+			 * otherwise poll now if it's overdue, and start over with
+			 * the base interval either way */
+			if(wd->notify_wd == -1 && !wd->subscribed &&
+				msecs_until(&wd->next_poll) == 0)
+				wd->rescan = True;
+			else
+				schedule_poll(wd, True);
+			break;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Checks for commands from the parent while the directory is being read.
+ * Returns RP_ABORT if the read is to be abandoned, zero otherwise.
+ */
+static int check_commands(struct watch_data *wd)
+{
+	struct pollfd pfd;
+	
+	pfd.fd = wd->cmd_fd;
+	pfd.events = POLLIN;
+	
+	if(poll(&pfd, 1, 0) < 1) return 0;
+	
+	return read_commands(wd, True);
+}
+
+/*
+ * Sets up a scan of path. Unless the parent is to send the list of entries
+ * it's showing already (CF_PRIMED), the directory is read right away.
+ * Returns zero on success, RP_* error code otherwise.
+ */
+static int begin_scan(struct watch_data *wd,
+	const char *path, unsigned int flags)
+{
+	char *p;
+
+	if(!path) return RP_IOFAIL;
+
+	p = strdup(path);
+	if(!p) return RP_ENOMEM;
+	if(wd->path) free(wd->path);
+	wd->path = p;
+	
+	/* changes are picked up in wait_events only while watching */
+	if(mtab_fd() != -1) {
+		struct pollfd pfd;
+		
+		pfd.fd = mtab_fd();
+		pfd.events = POLLPRI;
+		if(poll(&pfd, 1, 0) == 1) mtab_update(NULL, NULL);
+	}
+	
+	wd->has_mpts = (has_fstab_entries(wd->path) ||
+		mtab_has_mounts(wd->path) == 1) ? True : False;
+	
+	if(open_directory(wd)){
+		dbg_printf("%d: can't opendir %s\n", getpid(), wd->path);
+		return RP_ENOACC;
+	}
+	wd->fs_class = get_fs_class(dirfd(wd->dir));
+	scan_policy = &fs_policies[wd->fs_class];
+	dbg_trace("%s is on a %s file system\n",
+		wd->path, fsp_class_name(wd->fs_class));
+	
+	/* the watch must be in place before the directory is read,
+	 * so that nothing that happens in between is missed */
+	#ifdef __linux__
+	set_notify_watch(wd);
+	#endif
+	
+	/* rather than polling it here, along with other instances */
+	if(wd->notify_wd == -1) set_watchd_watch(wd);
+	
+	wd->primed = (flags & CF_PRIMED) ? True : False;
+	wd->state = wd->primed ? RS_PRIME : RS_READ;
+
+	return 0;
+}
+
+/*
+ * Adds an entry the parent restored from the listing cache to the watch
+ * list, so that it can be compared with what's in the directory now.
+ */
+static int prime_entry(struct watch_data *wd,
+	const char *name, const struct msg_data *msg)
+{
+	struct dir_rec *rec;
+	
+	rec = dtab_find(&wd->list, name);
+	if(!rec) rec = dtab_add(&wd->list, name);
+	if(!rec) return RP_ENOMEM;
+		
+	rec->flags = DRF_SHOWN;
+	if(msg->flags & MF_PARTIAL) rec->flags |= DRF_PARTIAL;
+	if(msg->flags & MF_MPOINT) rec->flags |= DRF_MPOINT;
+	rec->mtime = msg->mtime;
+	rec->ctime = msg->ctime;
+	rec->size = msg->size;
+	
+	/* not known for things mounted on it */
+	rec->device = (msg->flags & MF_MOUNTED) ? 0 : wd->device;
+	
+	return 0;
+}
+
+/*
+ * Stops watching the directory and empties the watch list,
+ * retaining its memory for the next scan.
+ */
+static void end_scan(struct watch_data *wd)
+{
+	#ifdef __linux__
+	if(wd->notify_wd != -1) {
+		inotify_rm_watch(wd->notify_fd, wd->notify_wd);
+		wd->notify_wd = -1;
+	}
+	#endif
+	
+	if(wd->subscribed) {
+		wd->subscribed = False;
+		if(watchd_unwatch(wd->watchd_fd)) {
+			close(wd->watchd_fd);
+			wd->watchd_fd = -1;
+		}
+	}
+	
+	if(wd->dir) {
+		closedir(wd->dir);
+		wd->dir = NULL;
+	}
+	
+	/* so that it isn't kept busy */
+	if(in_scan_dir) {
+		in_scan_dir = False;
+		if(chdir("/")) dbg_trace("chdir: %s\n", strerror(errno));
+	}
+	
+	dtab_clear(&wd->list);
+	wd->state = RS_IDLE;
+	wd->primed = False;
+	wd->rescan = False;
+}
+
+/*
+ * Reads the directory the scan was set up for and sends its contents,
+ * or if the parent is showing a cached listing, changes to it only.
+ */
+static int read_contents(struct watch_data *wd)
+{
+	int res;
+
+	if(wd->primed) return rescan_directory(wd);
+
+	res = scan_directory(wd, True);
+	if(res) return res;
+
+	return send_totals(wd);
+}
+
+/*
+ * Sets the time the directory is to be polled for changes next (unless
+ * there are inotify notifications). The interval is doubled each time
+ * nothing changed, up to RP_BACKOFF_MAX times the base interval, and
+ * reset to the base interval on changes or any other activity.
+ */
+static void schedule_poll(struct watch_data *wd, Boolean activity)
+{
+	long base = app_res.refresh_int * 1000L * scan_policy->interval;
+	
+	if(activity || !wd->interval) {
+		wd->interval = base;
+	} else if(wd->interval < base * RP_BACKOFF_MAX) {
+		wd->interval *= 2;
+		if(wd->interval > base * RP_BACKOFF_MAX)
+			wd->interval = base * RP_BACKOFF_MAX;
+	}
+	
+	clock_gettime(CLOCK_MONOTONIC, &wd->next_poll);
+	add_msecs(&wd->next_poll, wd->interval);
+}
+
+static void add_msecs(struct timespec *ts, long ms)
+{
+	ts->tv_sec += ms / 1000;
+	ts->tv_nsec += (ms % 1000) * 1000000L;
+	if(ts->tv_nsec >= 1000000000L) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000L;
+	}
+}
+
+/*
+ * Returns milliseconds left until ts (CLOCK_MONOTONIC), zero if it's past
+ */
+static long msecs_until(const struct timespec *ts)
+{
+	struct timespec now;
+	long ms;
+	
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	
+	ms = (ts->tv_sec - now.tv_sec) * 1000L +
+		(ts->tv_nsec - now.tv_nsec) / 1000000L;
+	
+	return (ms > 0) ? ms : 0;
+}
+
+/*
+ * Rereads the mount table after it changed, and sends updates for
+ * mount points in the watched directory that were affected.
+ */
+static int update_mounts(struct watch_data *wd)
+{
+	int res;
+	
+	res = mtab_update(mount_changed, wd);
+	if(res) {
+		dbg_printf("%d: mtab_update: %s\n", getpid(), strerror(res));
+		return 0;
+	}
+
+	wd->has_mpts = (has_fstab_entries(wd->path) ||
+		mtab_has_mounts(wd->path) == 1) ? True : False;
+	
+	return send_totals(wd);
+}
+
+/*
+ * mtab_update callback. If path is in the watched directory, restats it,
+ * so that the parent gets its mount point flags updated.
+ */
+static void mount_changed(const char *path, void *data)
+{
+	struct watch_data *wd = (struct watch_data*)data;
+	size_t len = strlen(wd->path);
+	const char *name;
+	struct dir_rec *rec;
+	
+	if(len == 1) len = 0; /* root */
+	
+	if(strncmp(path, wd->path, len) || path[len] != '/') return;
+	name = path + len + 1;
+	if(*name == '\0' || strchr(name, '/')) return;
+	
+	rec = dtab_find(&wd->list, name);
+	if(!rec || !(rec->flags & DRF_SHOWN)) return;
+	
+	/* have its attributes sent over again, whether changed or not */
+	rec->flags |= DRF_PARTIAL;
+	process_entry(wd, name, 0, False);
+}
+
+#ifdef __linux__
+/*
+ * Moves the inotify watch to the directory being scanned.
+ * If that fails, the directory is polled for changes instead.
+ */
+static void set_notify_watch(struct watch_data *wd)
+{
+	if(wd->notify_fd == -1) return;
+	
+	if(wd->notify_wd != -1) {
+		inotify_rm_watch(wd->notify_fd, wd->notify_wd);
+		wd->notify_wd = -1;
+	}
+	
+	/* polled instead (see wait_events) */
+	if(!(scan_policy->flags & FSP_NOTIFY)) return;
+	
+	wd->notify_wd = inotify_add_watch(wd->notify_fd, wd->path, NOTIFY_MASK);
+	if(wd->notify_wd == -1) {
+		dbg_printf("%d: inotify_add_watch: %s\n",
+			getpid(), strerror(errno));
+	}
+}
+
+/*
+ * Processes pending inotify events, updating entries affected only.
+ * On event queue overflow the directory is reread in full.
+ * Returns zero on success, RP_* error code otherwise.
+ */
+static int read_events(struct watch_data *wd)
+{
+	char buffer[NOTIFY_BUFSIZ]
+		__attribute__ ((aligned(__alignof__(struct inotify_event))));
+	Boolean changed = False;
+	Boolean overflow = False;
+	ssize_t len;
+	char *p;
+	int res;
+
+	while((len = read(wd->notify_fd, buffer, NOTIFY_BUFSIZ)) > 0) {
+
+		for(p = buffer; p < buffer + len; ) {
+			struct inotify_event *evt = (struct inotify_event*)p;
+			
+			p += sizeof(struct inotify_event) + evt->len;
+
+			if(evt->mask & IN_Q_OVERFLOW) {
+				dbg_trace("update: event queue overflow\n");
+				overflow = True;
+			} else if(evt->wd != wd->notify_wd) {
+				/* left over from a directory watched previously */
+				continue;
+			} else if(evt->mask &
+				(IN_DELETE_SELF | IN_MOVE_SELF | IN_UNMOUNT)) {
+				return RP_ENOACC;
+			} else if(evt->len && !overflow) {
+				/* process_entry figures out what actually happened,
+				 * since events may be stale by the time we get them */
+				res = process_entry(wd, evt->name, 0, False);
+				if(res) return res;
+				changed = True;
+			}
+		}
+	}
+	if(len == -1 && errno != EAGAIN && errno != EINTR)
+		return RP_IOFAIL;
+
+	if(overflow) return rescan_directory(wd);
+	
+	if(changed) return send_totals(wd);
+
+	return 0;
+}
+#endif /* __linux__ */
+
+/*
+ * Has the watcher daemon watch the directory, if it's running and that's
+ * allowed. The connection is made on first use, and again after the daemon
+ * went away or stopped responding, since it may be back by now.
+ */
+static void set_watchd_watch(struct watch_data *wd)
+{
+	int res;
+
+	if(!app_res.watcher_daemon) return;
+
+	if(wd->watchd_fd == -1) {
+		wd->watchd_fd = watchd_connect();
+		if(wd->watchd_fd == -1) return;
+		dbg_trace("%d: connected to the watcher daemon\n", getpid());
+	}
+
+	res = watchd_watch(wd->watchd_fd, wd->path);
+	if(res) {
+		dbg_printf("%d: watchd_watch: %s\n", getpid(), strerror(res));
+		close(wd->watchd_fd);
+		wd->watchd_fd = -1;
+		return;
+	}
+	wd->subscribed = True;
+	set_watchd_deadline(wd);
+}
+
+/*
+ * Sets the time by which anything, a heartbeat at least, is to be received
+ * from the watcher daemon, or else the directory is polled here again.
+ * That's readTimeout, but no less than a couple of heartbeats.
+ */
+static void set_watchd_deadline(struct watch_data *wd)
+{
+	long ms = app_res.read_timeout * 1000L;
+
+	if(ms < WATCHD_HEARTBEAT * 2) ms = WATCHD_HEARTBEAT * 2;
+
+	clock_gettime(CLOCK_MONOTONIC, &wd->watchd_deadline);
+	add_msecs(&wd->watchd_deadline, ms);
+}
+
+/*
+ * Processes events sent by the watcher daemon. The daemon doesn't say
+ * what changed, so the directory is reread. If the daemon went away,
+ * the directory is watched here from now on.
+ * Returns zero on success, RP_* error code otherwise.
+ */
+static int read_watchd_events(struct watch_data *wd)
+{
+	int res;
+
+	res = watchd_read_events(wd->watchd_fd);
+	if(res == -1) {
+		dbg_printf("%d: the watcher daemon went away\n", getpid());
+		return drop_watchd(wd);
+	}
+
+	set_watchd_deadline(wd);
+	if(res == 0) return 0;
+
+	res = rescan_directory(wd);
+	if(!res) schedule_poll(wd, True);
+	return res;
+}
+
+/*
+ * Closes the watcher daemon connection, and has the directory watched here
+ * from now on. The connection is made again for the next scan.
+ * Returns zero on success, RP_* error code otherwise.
+ */
+static int drop_watchd(struct watch_data *wd)
+{
+	int res;
+
+	close(wd->watchd_fd);
+	wd->watchd_fd = -1;
+	wd->subscribed = False;
+	#ifdef __linux__
+	set_notify_watch(wd);
+	#endif
+
+	/* picks up anything that changed while it was unheard from */
+	res = rescan_directory(wd);
+	if(!res) schedule_poll(wd, True);
+	return res;
+}
+
+/*
+ * (Re)opens the watched directory. Entries are looked up relative to
+ * its descriptor, so that paths don't have to be resolved over again,
+ * and it's made the working directory for sniffing file types.
+ * Returns zero on success, errno otherwise.
+ */
+static int open_directory(struct watch_data *wd)
+{
+	struct stat st;
+	time_t now = time(NULL);
+	DIR *dir;
+
+	dir = opendir(wd->path);
+	if(!dir) return errno;
+	
+	if(fstat(dirfd(dir), &st) == -1) {
+		int errv = errno;
+		closedir(dir);
+		return errv;
+	}
+
+	if(wd->dir) closedir(wd->dir);
+	wd->dir = dir;
+	in_scan_dir = fchdir(dirfd(dir)) ? False : True;
+	wd->device = st.st_dev;
+	wd->dir_ino = st.st_ino;
+	wd->dir_mtime = st.st_mtime;
+	wd->dir_mtime_ns = st.st_mtim.tv_nsec;
+	wd->dir_ctime = st.st_ctime;
+	wd->dir_time = now;
+	wd->npolls = 0;
+	return 0;
+}
+
+/*
+ * Rereads the directory in full, updating the watch list and
+ * notifying the parent process of any changes.
+ */
+static int rescan_directory(struct watch_data *wd)
+{
+	size_t i;
+	int res;
+
+	if(open_directory(wd)) return RP_ENOACC;
+	
+	/* records not seen in this generation are gone */
+	dtab_new_gen(&wd->list);
+	
+	res = scan_directory(wd, False);
+	if(res) return res;
+
+	/* check for deleted files */
+	for(i = 0; i < wd->list.nrecs; ) {
+		struct dir_rec *rec = &wd->list.recs[i];
+
+		if(!dtab_stale(&wd->list, rec)) {
+			i++;
+			continue;
+		}
+		dbg_trace("update: \'%s\' was removed\n",
+			dtab_name(&wd->list, rec));
+		
+		if(rec->flags & DRF_SHOWN) {
+			res = send_removal(wd, dtab_name(&wd->list, rec));
+			if(res) return res;
+		}
+		/* moves the last record to i */
+		dtab_remove(&wd->list, rec);
+	}
+
+	return send_totals(wd);
+}
+
+/*
+ * Polls the watched directory for changes. If its times say that entries
+ * were neither added nor removed, only attributes of a slice of entries
+ * are checked, and of those that changed recently, rotating through the
+ * watch list over subsequent polls. The directory is reread otherwise.
+ */
+static int poll_directory(struct watch_data *wd)
+{
+	struct stat st;
+	unsigned int nchanges = wd->nchanges;
+	size_t i, nslice, nchecked = 0;
+	int res;
+	
+	/* times are only as precise as a second, so a change made in the
+	 * same second as these were taken may have gone unnoticed */
+	if(++wd->npolls >= RP_POLL_FULL || stat(wd->path, &st) == -1 ||
+		st.st_ino != wd->dir_ino || st.st_dev != wd->device ||
+		st.st_mtime != wd->dir_mtime || st.st_ctime != wd->dir_ctime ||
+		wd->dir_mtime >= wd->dir_time || wd->dir_ctime >= wd->dir_time)
+		return rescan_directory(wd);
+	
+	if(!wd->list.nrecs) return 0;
+
+	if(wd->poll_next >= wd->list.nrecs) wd->poll_next = 0;
+	nslice = (wd->list.nrecs < RP_POLL_SLICE) ?
+		wd->list.nrecs : RP_POLL_SLICE;
+	
+	for(i = 0; i < wd->list.nrecs; ) {
+		struct dir_rec *rec = &wd->list.recs[i];
+		struct entry_info ei;
+		size_t nrecs = wd->list.nrecs;
+		unsigned int n = wd->nchanges;
+		
+		/* records at poll_next and on, wrapping around */
+		if(!rec->hot && ((i + nrecs - wd->poll_next) % nrecs) >= nslice) {
+			i++;
+			continue;
+		}
+		
+		stat_entry(dirfd(wd->dir), dtab_name(&wd->list, rec), 0, &ei);
+		res = apply_entry(wd, dtab_name(&wd->list, rec), &ei, False);
+		if(res) return res;
+		nchecked++;
+
+		/* removed, and the last record moved to i */
+		if(wd->list.nrecs != nrecs) continue;
+		
+		if(wd->nchanges == n && rec->hot) rec->hot--;
+		i++;
+	}
+	wd->poll_next += nslice;
+	
+	dbg_trace("poll: %lu of %lu entries checked\n",
+		(unsigned long)nchecked, (unsigned long)wd->list.nrecs);
+	
+	return (wd->nchanges != nchanges) ? send_totals(wd) : 0;
+}
+
+/*
+ * Reads the watched directory, processing all entries in it.
+ * The initial read is done in two passes: names and types, as reported by
+ * readdir, are sent off first, so that these can be displayed right away,
+ * and attributes are sent as updates after.
+ */
+static int scan_directory(struct watch_data *wd, Boolean initial)
+{
+	struct scan_pool *sp = &wd->sp;
+	int res;
+	
+	/* buffers are retained from previous scans */
+	sp->dfd = dirfd(wd->dir);
+	sp->nents = 0;
+	sp->next = 0;
+	sp->cancel = False;
+	
+	/* parent directories of link targets must be checked over again */
+	lcache_forget_dirs(&wd->links);
+	
+	res = read_entries(wd, sp);
+
+	if(!res && initial) res = send_names(wd, sp);
+	
+	if(!res) res = stat_entries(wd, sp, initial);
+	
+	return res;
+}
+
+/*
+ * Reads directory entry names and types into the scan pool
+ */
+static int read_entries(struct watch_data *wd, struct scan_pool *sp)
+{
+	struct dirent *ent;
+	size_t names_len = 0;
+	int res;
+
+	while((ent = readdir(wd->dir))){
+		size_t len;
+		
+		if(!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
+			continue;
+		
+		if(!(sp->nents % RP_CMD_CHECK) && (res = check_commands(wd)))
+			return res;
+
+		len = strlen(ent->d_name) + 1;
+		
+		if(sp->nents == sp->ents_size) {
+			struct scan_ent *p;
+
+			p = realloc(sp->ents,
+				(sp->ents_size + 1024) * sizeof(struct scan_ent));
+			if(!p) return RP_ENOMEM;
+			sp->ents = p;
+			sp->ents_size += 1024;
+		}
+		
+		if(names_len + len > sp->names_size) {
+			size_t size = sp->names_size + ((len > 16384) ? len : 16384);
+			char *p;
+			
+			p = realloc(sp->names, size);
+			if(!p) return RP_ENOMEM;
+			sp->names = p;
+			sp->names_size = size;
+		}
+		
+		sp->ents[sp->nents].ino = ent->d_ino;
+		sp->ents[sp->nents].type = entry_type(ent);
+		sp->ents[sp->nents].name = names_len;
+		sp->ents[sp->nents].done = False;
+		memcpy(sp->names + names_len, ent->d_name, len);
+		names_len += len;
+		sp->nents++;
+	}
+	return 0;
+}
+
+/*
+ * First pass of the initial read. Adds entries that can be filtered by
+ * type alone to the watch list, and sends these off as partial (name and
+ * type only), followed by a partial end-of-data message. Entries are
+ * marked so that attributes are sent once these are stat'ed.
+ */
+static int send_names(struct watch_data *wd, struct scan_pool *sp)
+{
+	struct sort_key *keys;
+	struct msg_data msg;
+	size_t i;
+	int res = 0;
+	
+	/* NULL if not sorted; the parent sorts these then */
+	keys = sort_names(wd, sp);
+	
+	for(i = 0; i < sp->nents; i++) {
+		size_t n = keys ? keys[i].index : i;
+		const char *name = sp->names + sp->ents[n].name;
+		mode_t type = sp->ents[n].type;
+		struct dir_rec *rec;
+		int shown;
+		
+		/* those of unknown type are sent once stat'ed */
+		shown = filter_type(name, type);
+		if(shown == -1 || (shown && !type)) continue;
+		
+		rec = dtab_add(&wd->list, name);
+		if(!rec) {
+			res = RP_ENOMEM;
+			break;
+		}
+
+		if(!shown) continue;
+		rec->flags = DRF_SHOWN | DRF_PARTIAL;
+		
+		memset(&msg, 0, sizeof(struct msg_data));
+		msg.reason = MSG_ADD;
+		msg.fields = MF_MODE | MF_ICON;
+		msg.mode = type;
+		msg.flags = MF_PARTIAL | (S_ISLNK(type) ? MF_SYMLINK : 0);
+		msg.icon = icon_class(type, DB_UNKNOWN, 0, 0, False);
+		
+		res = send_message(wd, &msg, name);
+		if(res) break;
+	}
+	
+	if(keys) {
+		if(!(wd->sort_flags & CF_CASE_SENS)) {
+			for(i = 0; i < sp->nents; i++) {
+				if(keys[i].name != sp->names + sp->ents[keys[i].index].name)
+					free((char*)keys[i].name);
+			}
+		}
+		free(keys);
+	}
+	if(res) return res;
+	
+	get_totals(wd, &msg);
+	msg.flags = MF_PARTIAL;
+	
+	if(rdm_put(wd->out, &msg, NULL)) return RP_IOFAIL;
+	
+	return flush_messages(wd);
+}
+
+/*
+ * Stats entries in the scan pool and updates the watch list accordingly.
+ * Large directories are stat'ed by a pool of worker threads (readerThreads,
+ * unless the file system policy says otherwise) in inode order, which makes
+ * a big difference on high latency (network) file systems. Results are
+ * processed in the same order, as they become available.
+ */
+static int stat_entries(struct watch_data *wd,
+	struct scan_pool *sp, Boolean initial)
+{
+	pthread_t *threads = NULL;
+	unsigned int nthreads = 0;
+	unsigned int max_threads;
+	sigset_t sigs, old_sigs;
+	size_t i;
+	int res = 0;
+	
+	max_threads = scan_policy->threads ?
+		scan_policy->threads : app_res.reader_threads;
+	
+	if(max_threads > 1 && sp->nents >= RP_PAR_SCAN_MIN) {
+		qsort(sp->ents, sp->nents, sizeof(struct scan_ent), scan_ent_cmp);
+		threads = malloc(sizeof(pthread_t) * max_threads);
+	}
+
+	if(threads) {
+		pthread_mutex_init(&sp->lock, NULL);
+		pthread_cond_init(&sp->cond, NULL);
+
+		/* signals are to be handled by the main thread */
+		sigfillset(&sigs);
+		pthread_sigmask(SIG_BLOCK, &sigs, &old_sigs);
+
+		for(i = 0; i < max_threads; i++) {
+			if(pthread_create(&threads[nthreads], NULL,
+				scan_worker, sp)) break;
+			nthreads++;
+		}
+		pthread_sigmask(SIG_SETMASK, &old_sigs, NULL);
 	}
 
-	if(msg.name_len) {
-		if(readn(*pfd, fname_buf, msg.name_len) == -1) {
-			read_error_msg(app_inst.location, strerror(errno), False);
-			stop_read_proc();
-			return;
-		}			
-		fname_buf[msg.name_len] = '\0';
+	for(i = 0; i < sp->nents; i++) {
+		struct scan_ent *se = &sp->ents[i];
+		
+		if(!(i % RP_CMD_CHECK) && (res = check_commands(wd))) break;
+		
+		if(nthreads) {
+			pthread_mutex_lock(&sp->lock);
+			while(!se->done)
+				pthread_cond_wait(&sp->cond, &sp->lock);
+			pthread_mutex_unlock(&sp->lock);
+		} else {
+			stat_entry(sp->dfd, sp->names + se->name,
+				se->type, &se->info);
+		}
+		
+		res = apply_entry(wd, sp->names + se->name, &se->info, initial);
+		if(res) break;
 	}
 	
-	switch(msg.reason) {
-		case MSG_EOD: {
-			Boolean changed = 
-				(app_inst.nfiles_hidden != msg.files_skipped ||
-				app_inst.nfiles_shown != msg.files_total ||
-				app_inst.size_shown.size != msg.size_total.size ||
-				app_inst.size_shown.exp != msg.size_total.exp)
-				
-				? True : False;
+	if(threads) {
+		pthread_mutex_lock(&sp->lock);
+		sp->cancel = True;
+		pthread_mutex_unlock(&sp->lock);
 
-			app_inst.nfiles_hidden = msg.files_skipped;
-			app_inst.nfiles_shown = msg.files_total;
-			app_inst.size_shown = msg.size_total;
+		for(i = 0; i < nthreads; i++)
+			pthread_join(threads[i], NULL);
 
-			if(!rp_data.init_done) {
-				rp_data.init_done = True;
-				changed = True;
-				if(xt_update_iid) {
-					XtRemoveTimeOut(xt_update_iid);
-					xt_update_iid = None;
-				}
+		pthread_cond_destroy(&sp->cond);
+		pthread_mutex_destroy(&sp->lock);
+		free(threads);
+	}
+	return res;
+}
 
-				set_ui_sensitivity(UIF_DIR);
-				file_list_show_contents(app_inst.wlist, True);
-				update_shell_title(app_inst.location);
-			}
+/*
+ * Scan worker thread. Takes entries off the pool in order, stats these
+ * and signals the main thread as each one is done.
+ */
+static void* scan_worker(void *arg)
+{
+	struct scan_pool *sp = (struct scan_pool*)arg;
+	
+	for(;;) {
+		struct scan_ent *se;
+		
+		pthread_mutex_lock(&sp->lock);
+		if(sp->cancel || sp->next == sp->nents) {
+			pthread_mutex_unlock(&sp->lock);
+			break;
+		}
+		se = &sp->ents[sp->next++];
+		pthread_mutex_unlock(&sp->lock);
+		
+		stat_entry(sp->dfd, sp->names + se->name, se->type, &se->info);
 
-			if(changed) show_selection_stats();
+		pthread_mutex_lock(&sp->lock);
+		se->done = True;
+		pthread_cond_signal(&sp->cond);
+		pthread_mutex_unlock(&sp->lock);
+	}
+	return NULL;
+}
 
-		} break;
-		
-		case MSG_UPDATE:
-		update = True; /* ...and fall through */
-		case MSG_ADD:
+static int scan_ent_cmp(const void *pa, const void *pb)
+{
+	const struct scan_ent *a = (const struct scan_ent*)pa;
+	const struct scan_ent *b = (const struct scan_ent*)pb;
 
-		if(DB_DEFINED(msg.db_index)) {
-			ft = &app_inst.type_db.recs[msg.db_index];
-		}
+	return (a->ino > b->ino) ? 1 : ((a->ino < b->ino) ? -1 : 0);
+}
 
-		/* figure out what icon to use if no DB match, or pixmap is missing */
-		if(!ft || !ft->icon_name ||
-			!get_icon_pixmap(ft->icon_name,
-				app_inst.icon_size_id, &pm_icon, &pm_mask)) {
-
-			char *icon_name;
-
-			if(msg.is_symlink && msg.stat_errno) {
-				icon_name = ICON_DLNK;
-			} else {
-				switch(msg.mode & S_IFMT) {
-					case S_IFREG:
-						if(DB_ISTEXT(msg.db_index))
-							icon_name = ICON_TEXT;
-						else if(DB_ISBIN(msg.db_index))
-							icon_name = ICON_BIN;
-						else
-							icon_name = ICON_FILE;
-					break;
-					
-					case S_IFDIR:
-						if(access(fname_buf, R_OK | X_OK)) {
-							icon_name = ICON_NXDIR;
-						} else if(msg.is_mpoint) {
-							if(msg.is_mounted)
-								icon_name = ICON_MPT;
-							else
-								icon_name = ICON_MPTI;
-						} else {
-							icon_name = ICON_DIR;
-						}
-					break;
-					
-					default:
-						icon_name = ICON_FILE;
-					break;
-				}
-			}
-			get_icon_pixmap(icon_name,
-				app_inst.icon_size_id, &pm_icon, &pm_mask);
-		}
-		
-		fli.name = fname_buf;
-		fli.title = fname_buf;
-		fli.db_type = msg.db_index;
-		fli.size = msg.size;
-		fli.mode = msg.mode;
-		fli.uid = msg.uid;
-		fli.gid = msg.gid;
-		fli.ctime = msg.ctime;
-		fli.mtime = msg.mtime;
-		fli.icon = pm_icon;
-		fli.icon_mask = pm_mask;
-		fli.is_symlink = msg.is_symlink;
-		fli.user_flags = (msg.is_mpoint ? FLI_MNTPOINT : 0) |
-			(msg.is_mounted ? FLI_MOUNTED : 0);
-		
-		res = file_list_add(app_inst.wlist, &fli, update);
-		
-		app_inst.nfiles_read = msg.files_total;
+/*
+ * Sorts scan pool entries, for the names pass, as the parent's list widget
+ * would sort these by name and type alone, so that it has little sorting
+ * left to do. Returns the sort key array, in order, or NULL if the parent
+ * didn't tell how to sort or there isn't enough memory.
+ */
+static struct sort_key* sort_names(struct watch_data *wd,
+	struct scan_pool *sp)
+{
+	struct sort_key *keys;
+	size_t i;
+
+	if(!wd->sort_names || sp->nents < 2) return NULL;
+	
+	keys = malloc(sizeof(struct sort_key) * sp->nents);
+	if(!keys) return NULL;
+	
+	for(i = 0; i < sp->nents; i++) {
+		const char *name = sp->names + sp->ents[i].name;
 		
-		if(res)	{
-			read_error_msg(app_inst.location, strerror(res), False);
-			stop_read_proc();
-		}		
-		break;
+		keys[i].index = i;
+		keys[i].dir = S_ISDIR(sp->ents[i].type) ? True : False;
 		
-		case MSG_REMOVE:
-		file_list_remove(app_inst.wlist, fname_buf);
-		break;
+		if(wd->sort_flags & CF_CASE_SENS) {
+			keys[i].name = name;
+		} else {
+			keys[i].name = mbs_tolower(name);
+			if(!keys[i].name) keys[i].name = name;
+		}
 	}
+
+	sort_key_flags = wd->sort_flags;
+	qsort(keys, sp->nents, sizeof(struct sort_key), sort_key_cmp);
+	
+	return keys;
 }
 
 /*
- * Reader error message reporting convenience routine.
+ * Compares sort keys the way list widget's compare functions do, for
+ * entries that have no attributes other than name and type yet.
  */
-static void read_error_msg(const char *path, const char *estr, Boolean blocking)
+static int sort_key_cmp(const void *pa, const void *pb)
 {
-	char tmpl[] = "Error reading %s\n%s.";
-	char *buffer;
+	const struct sort_key *a = (const struct sort_key*)pa;
+	const struct sort_key *b = (const struct sort_key*)pb;
+	int (*cmp)(const char*, const char*) =
+		(sort_key_flags & CF_NUMBERED) ? mbs_numcmp : strcmp;
+	Boolean des = (sort_key_flags & CF_DESCEND) ? True : False;
+	int order = sort_key_flags & CF_SORT_ORDER;
+	int r;
+	
+	r = b->dir - a->dir;
+	if(r) return r;
+	
+	if(order == XfSUFFIX || order == XfTYPE) {
+		const char *sa = strrchr(a->name, '.');
+		const char *sb = strrchr(b->name, '.');
 
-	if(!estr) estr = "Unexpected error";
-	buffer = malloc(snprintf(NULL, 0, tmpl, path, estr) + 1);
-	sprintf(buffer, tmpl, path, estr);
-	message_box(app_inst.wshell,
-		(blocking ? MB_ERROR : MB_ERROR_NB), APP_TITLE, buffer);
-	free(buffer);
+		if(sa && sb)
+			r = des ? cmp(sa + 1, sb + 1) : cmp(sb + 1, sa + 1);
+		else if(sa || sb)
+			r = des ? (sa ? 1 : -1) : (sb ? -1 : 1);
+		if(r) return r;
+	}
+	return des ? cmp(a->name, b->name) : cmp(b->name, a->name);
 }
 
 /*
- * Returns True if file_name should be displayed
+ * Returns file type bits for a directory entry, as reported by readdir,
+ * or zero if the file system doesn't tell.
  */
-static Boolean filter(const char *file_name, mode_t mode)
+static mode_t entry_type(const struct dirent *ent)
 {
-	int i;
-	
-	if(file_name[0] == '.' && !app_res.show_all)
-		return False;
+	#ifdef DT_UNKNOWN
+	switch(ent->d_type) {
+		case DT_REG: return S_IFREG;
+		case DT_DIR: return S_IFDIR;
+		case DT_LNK: return S_IFLNK;
+		case DT_CHR: return S_IFCHR;
+		case DT_BLK: return S_IFBLK;
+		case DT_FIFO: return S_IFIFO;
+		case DT_SOCK: return S_IFSOCK;
+	}
+	#endif
+	return 0;
+}
 
-	if(S_ISDIR(mode) && !app_res.filter_dirs)
-		return True;
+/*
+ * Stats the named entry in the directory referred to by dfd.
+ * The type, if known (i.e. reported by readdir), lets us skip stat
+ * for entries that are filtered out regardless of what it would return.
+ * Called from scan worker threads, so it must not touch the watch list.
+ */
+static void stat_entry(int dfd, const char *name,
+	mode_t type, struct entry_info *ei)
+{
+	memset(ei, 0, sizeof(struct entry_info));
 
-	for(i = 0; app_inst.filter_pat && app_inst.filter_pat[i]; i++) {
-		if(fnmatch(app_inst.filter_pat[i], file_name, 0) == 0) {
-			return app_inst.filter_neg ? True : False;
-		}
+	/* readdir says it exists, so there's no need to stat it
+	 * if it isn't going to be shown */
+	if(filter_type(name, type) == 0) {
+		ei->skipped = True;
+		return;
 	}
-	return app_inst.filter_neg ? False : True;
+	
+	if(fstatat(dfd, name, &ei->st, AT_SYMLINK_NOFOLLOW) == -1) {
+		ei->stat_errno = errno;
+		memset(&ei->st, 0, sizeof(struct stat));
+	} else if(S_ISLNK(ei->st.st_mode)) {
+		off_t lnk_size = ei->st.st_size;
+		
+		ei->is_symlink = True;
+		ei->link.dev = ei->st.st_dev;
+		ei->link.ino = ei->st.st_ino;
+		ei->link.ctime = ei->st.st_ctime;
+		
+		/* shown as is, with no idea what it points to */
+		if(!(scan_policy->flags & FSP_LINKS)) return;
+		
+		if(fstatat(dfd, name, &ei->st, 0) == -1)
+			ei->stat_errno = errno;
+		ei->st.st_size = lnk_size;
+	}
+	
+	if(S_ISDIR(ei->st.st_mode) && faccessat(dfd, name, R_OK | X_OK, 0))
+		ei->no_access = True;
 }
 
+/*
+ * Stats the named entry in the watched directory and updates
+ * the watch list accordingly (see apply_entry).
+ */
+static int process_entry(struct watch_data *wd,
+	const char *name, mode_t type, Boolean initial)
+{
+	struct entry_info ei;
+	
+	stat_entry(dirfd(wd->dir), name, type, &ei);
+	return apply_entry(wd, name, &ei, initial);
+}
 
 /*
- * Directory reader process entry point.
- * Reads the CWD, then enters the 'watch' routine.
+ * Compares stat data for the named entry with the watch list, adding,
+ * updating or removing the record and notifying the parent accordingly.
+ * The initial flag is True while the directory is first read.
+ * Returns zero on success, RP_* error code otherwise.
  */
-static int read_proc_main(pid_t parent_pid, int pipe_fd)
+static int apply_entry(struct watch_data *wd, const char *name,
+	struct entry_info *ei, Boolean initial)
 {
-	char *cur_path;
-	DIR *dir = NULL;
-	struct dirent *ent;
-	struct stat st;
+	struct dir_rec *rec = NULL;
+	struct stat *st = &ei->st;
 	struct msg_data msg;
-	struct watch_rec *file_list = NULL;
-	size_t list_size = 0;
-	size_t nfiles = 0;
-	unsigned int files_total = 0;
-	unsigned int files_skipped = 0;
-	struct fsize size_total = { 0 };
-	Boolean has_mpts;
-	ssize_t out;
-	
-	dbg_printf("%d: new read/watch process\n", getpid());
-	rsignal(SIGALRM, read_proc_sigalrm, 0);
-	rsignal(SIGTERM, read_proc_sigterm, 0);
+	Boolean shown;
+	Boolean dev_changed = False;
+	Boolean is_mounted = False;
+	Boolean is_symlink = ei->is_symlink;
+	Boolean partial;
+	int db_index = FILTER_NO_DB;
 	
-	cur_path = get_working_dir();
-	if(!cur_path) return RP_ENOMEM;
+	rec = dtab_find(&wd->list, name);
+	if(rec) dtab_touch(&wd->list, rec);
+
+	if(ei->skipped) {
+		if(!rec) {
+			rec = dtab_add(&wd->list, name);
+			return rec ? 0 : RP_ENOMEM;
+		}
+		if(!(rec->flags & DRF_SHOWN)) return 0;
+		
+		/* changed in a way that affects filtering */
+		rec->flags = 0;
+		return send_removal(wd, name);
+	}
 	
-	has_mpts = (has_fstab_entries(cur_path) ? True : False);
+	if(ei->stat_errno == ENOENT && !is_symlink) {
+		/* gone before we got to it */
+		if(!rec) return 0;
 
-	if(!(dir = opendir(cur_path))){
-		dbg_printf("%d: can't opendir cwd\n", getpid());
-		return RP_ENOACC;
+		dbg_trace("update: \'%s\' was removed\n", name);
+		if(rec->flags & DRF_SHOWN) {
+			int res = send_removal(wd, name);
+			if(res) return res;
+		}
+		dtab_remove(&wd->list, rec);
+		return 0;
+	}
+
+	memset(&msg, 0, sizeof(struct msg_data));
+	
+	if(ei->stat_errno) {
+		msg.stat_errno = ei->stat_errno;
+		msg.fields |= MF_ERRNO;
 	}
+	
+	shown = filter(name, st, &db_index);
+
+	if(!rec) {
+		/* new file */
+		rec = dtab_add(&wd->list, name);
+		if(!rec) return RP_ENOMEM;
+
+		rec->mtime = st->st_mtime;
+		rec->ctime = st->st_ctime;
+		rec->size = st->st_size;
+		rec->device = st->st_dev;
+
+		if(!shown) return 0;
+		rec->flags = DRF_SHOWN;
+
+		if(S_ISDIR(st->st_mode) && is_mount_point(wd, name,
+			ei, &is_mounted)) rec->flags |= DRF_MPOINT;
+		if(!initial) dbg_trace("update: \'%s\' was created\n", name);
+		msg.reason = MSG_ADD;
 
-	while((ent = readdir(dir))){
-		Boolean is_mpoint = False;
-		Boolean is_mounted = False;
-		msg.stat_errno = 0;
+	} else if(((rec->flags & DRF_SHOWN) ? True : False) != shown) {
+		/* changed in a way that affects filtering */
+		rec->flags = (shown ? DRF_SHOWN : 0);
+		rec->mtime = st->st_mtime;
+		rec->ctime = st->st_ctime;
+		rec->size = st->st_size;
+		rec->device = st->st_dev;
 		
-		if(!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
-			continue;
+		if(!shown) return send_removal(wd, name);
 		
-		memset(&msg, 0, sizeof(struct msg_data));
+		if(S_ISDIR(st->st_mode) && is_mount_point(wd, name,
+			ei, &is_mounted)) rec->flags |= DRF_MPOINT;
+		msg.reason = MSG_ADD;
+
+	} else if( (partial = (rec->flags & DRF_PARTIAL) ? True : False) ||
+		(rec->mtime != st->st_mtime) ||
+		(rec->ctime != st->st_ctime) ||
+		(rec->size != st->st_size) ||
+		(S_ISDIR(st->st_mode) && (rec->device != st->st_dev)) ) {
 		
-		if(lstat(ent->d_name, &st) == -1) {
-			msg.stat_errno = errno;
-			memset(&st, 0, sizeof(struct stat));
-		} else if(S_ISLNK(st.st_mode)) {
-			off_t lnk_size = st.st_size;
-			
-			msg.is_symlink = True;
-			if(stat(ent->d_name, &st) == -1) {
-				msg.stat_errno = errno;
-			}
-			
-			st.st_size = lnk_size;
-		} else {
-			msg.is_symlink = False;
+		/* file was modified, or its attributes weren't sent yet */
+		if(!partial) dbg_trace("update: \'%s\' was changed\n", name);
+		rec->flags &= ~DRF_PARTIAL;
+		rec->mtime = st->st_mtime;
+		rec->ctime = st->st_ctime;
+		rec->size = st->st_size;
+		if(rec->device != st->st_dev) {
+			dev_changed = True;
+			rec->device = st->st_dev;
 		}
-
-		if( !filter(ent->d_name, st.st_mode) ) {
-			files_skipped++;
-			continue;
+		if(!shown) return 0;
+		
+		if(S_ISDIR(st->st_mode) &&
+			((rec->flags & DRF_MPOINT) || dev_changed || partial)) {
+			if(is_mount_point(wd, name, ei, &is_mounted))
+				rec->flags |= DRF_MPOINT;
+			else
+				rec->flags &= ~DRF_MPOINT;
 		}
+		msg.reason = MSG_UPDATE;
 
-		files_total++;
-		add_fsize(&size_total, st.st_size);
+	} else {
+		return 0; /* nothing changed */
+	}
 	
-		/* file list for the watch routine */
-		if(list_size < (nfiles + 1)) {
-			size_t new_size = list_size + FILE_LIST_GROW_BY;
-			file_list = realloc(file_list, sizeof(struct watch_rec) * new_size);
-			if(!file_list) return RP_ENOMEM;
-			list_size = new_size;
-		}
-		file_list[nfiles].name = strdup(ent->d_name);
-		file_list[nfiles].mtime = st.st_mtime;
-		file_list[nfiles].ctime = st.st_ctime;
-		file_list[nfiles].device = st.st_dev;
-		file_list[nfiles].touched = False;
-		
-		/* is it a mount point ? */
-		if(S_ISDIR(st.st_mode)) {
-			char cur_fqn[strlen(cur_path) + strlen(ent->d_name) + 2];
-			char *link_target = NULL;
-			
-			sprintf(cur_fqn, "%s/%s", cur_path, ent->d_name);
-			if(msg.is_symlink) get_link_target(cur_fqn, &link_target);
-
-			if(path_mounted(link_target ? link_target : cur_fqn)) {
-				is_mpoint = True;
-				is_mounted = True;
-			} else if(link_target || has_mpts) {
-				is_mpoint = (is_in_fstab(link_target ?
-					link_target : cur_fqn) ? True : False);
-			}
-			if(link_target) free(link_target);
-		}
-		file_list[nfiles].is_mpoint = is_mpoint;
-
-		nfiles++;
-		
-		/* message */
-		if(S_ISREG(st.st_mode)) {
-			msg.db_index = db_match(ent->d_name, &app_inst.type_db);
-		} else {
-			msg.db_index = DB_UNKNOWN;
-		}
-		msg.name_len = strlen(ent->d_name);
-		msg.size = st.st_size;
-		msg.mode = st.st_mode;
-		msg.ctime = st.st_ctime;
-		msg.mtime = st.st_mtime;
-		msg.gid = st.st_gid;
-		msg.uid = st.st_uid;
-		msg.reason = MSG_ADD;
-		msg.files_total = files_total;
-		msg.files_skipped = files_skipped;
-		msg.size_total = size_total;
-		msg.is_mpoint = is_mpoint;
-		msg.is_mounted = is_mounted;
-		
-		out = writen(pipe_fd, &msg, sizeof(struct msg_data));
-		out += writen(pipe_fd, ent->d_name, msg.name_len);
-		if(out < (sizeof(struct msg_data) + msg.name_len))
-				return RP_IOFAIL;
+	if(is_symlink) msg.flags |= MF_SYMLINK;
+	if(is_mounted) msg.flags |= MF_MOUNTED;
+	if(rec->flags & DRF_MPOINT) msg.flags |= MF_MPOINT;
+	
+	/* likely to change again soon (see poll_directory) */
+	if(!initial) rec->hot = RP_HOT_POLLS;
+	
+	if(S_ISREG(st->st_mode)) {
+		if(db_index != FILTER_NO_DB)
+			msg.db_index = db_index;
+		else if(sniff_contents())
+			msg.db_index = db_match(name, &app_inst.type_db);
+		else
+			msg.db_index = db_match_name(name, &app_inst.type_db);
+		if(msg.db_index != DB_UNKNOWN) msg.fields |= MF_DBINDEX;
 	}
-	closedir(dir);
-
-	memset(&msg, 0, sizeof(struct msg_data));
-	msg.reason = MSG_EOD;
-	msg.files_total = files_total;
-	msg.files_skipped = files_skipped;
-	msg.size_total = size_total;
-	out = writen(pipe_fd, &msg, sizeof(struct msg_data));
-	if(out < sizeof(struct msg_data))
-		return RP_IOFAIL;
 	
-	/* read_proc_watch returns on failure only */
- 	return read_proc_watch(cur_path, parent_pid, pipe_fd,
-		file_list, list_size, nfiles, has_mpts);
+	msg.icon = icon_class(st->st_mode, msg.db_index,
+		ei->stat_errno, msg.flags, ei->no_access);
+	msg.fields |= MF_ICON;
+	
+	if(st->st_mode) {
+		msg.fields |= (MF_MODE | MF_TIMES | MF_OWNER | MF_SIZE);
+		msg.size = st->st_size;
+		msg.mode = st->st_mode;
+		msg.ctime = st->st_ctime;
+		msg.mtime = st->st_mtime;
+		msg.gid = st->st_gid;
+		msg.uid = st->st_uid;
+	}
+	
+	return send_message(wd, &msg, name);
 }
 
 /*
- * Directory reader process watch routine.
- * Checks for changes in file_list (modifying it accordingly)
- * at regular intervals and notifies the parent process of these.
- * Returns on failure only.
+ * Returns the built-in icon class (MI_*) for an entry with the mode, type
+ * DB index, stat error and MF_* flags given, as shown if its type doesn't
+ * have an icon of its own.
  */
-static int read_proc_watch(const char *path, pid_t parent_pid,
-	int pipe_fd, struct watch_rec *file_list,
-	size_t list_size, size_t nfiles, Boolean has_mpts)
+static int icon_class(mode_t mode, int db_index,
+	int stat_errno, unsigned int flags, Boolean no_access)
 {
-	struct msg_data msg;
-	DIR *dir;
-	struct dirent *ent;
-	struct stat st;
-	size_t i;
-	ssize_t out;
-	
-	nice(WATCH_PROC_NICE);
+	if((flags & MF_SYMLINK) && stat_errno) return MI_DLNK;
 	
-	/* Loop until signaled or reparented, watching for directory changes,
-	 * sleeping refresh_int secs between iterations */
-	while(getppid() == parent_pid) {
-		unsigned int files_total = 0;
-		unsigned int files_skipped = 0;
-		struct fsize size_total = { 0 };
-	
-		dir = opendir(path);
-		if(!dir) return RP_ENOACC;
+	switch(mode & S_IFMT) {
+		case S_IFREG:
+		if(DB_ISTEXT(db_index)) return MI_TEXT;
+		if(DB_ISBIN(db_index)) return MI_BIN;
+		break;
 		
-		while((ent = readdir(dir))){
-			Boolean is_mpoint = False;
-			Boolean is_mounted = False;
-			Boolean dev_changed = False;
+		case S_IFDIR:
+		if(no_access) return MI_NXDIR;
+		if(flags & MF_MPOINT)
+			return (flags & MF_MOUNTED) ? MI_MPT : MI_MPTI;
+		return MI_DIR;
+	}
+	return MI_FILE;
+}
 
-			if(!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
-				continue;
+/*
+ * Checks whether the named directory in the watched directory is a mount
+ * point. Sets *mounted to True if something is mounted on it. The ei
+ * argument must point to what stat_entry returned for it.
+ */
+static Boolean is_mount_point(struct watch_data *wd, const char *name,
+	const struct entry_info *ei, Boolean *mounted)
+{
+	char fqn[strlen(wd->path) + strlen(name) + 2];
+	const struct stat *st = &ei->st;
+	Boolean is_symlink = ei->is_symlink;
+	const char *path = fqn;
+	Boolean is_mpoint = False;
+	int res;
 
-			for(i = 0; i < nfiles; i++) {
-				if(!strcmp(file_list[i].name, ent->d_name)) {
-					file_list[i].touched = True;
-					break;
-				}
-			}
-			
-			memset(&msg, 0, sizeof(struct msg_data));
+	/* a directory on a different device than its parent is mounted on;
+	 * symlinks need to be resolved, since the target may be elsewhere */
+	if(!is_symlink) {
+		*mounted = (st->st_dev != wd->device) ? True : False;
+		if(*mounted) return True;
+		if(!wd->has_mpts) return False;
+	}
 
-			if(lstat(ent->d_name, &st) == -1) {
-				msg.stat_errno = errno;
-				memset(&st, 0, sizeof(struct stat));
-			} else if(S_ISLNK(st.st_mode)) {
-				off_t lnk_size = st.st_size;
-				
-				msg.is_symlink = True;
-				if(stat(ent->d_name, &st) == -1) {
-					msg.stat_errno = errno;
-				}
-				st.st_size = lnk_size;
-			} else {
-				msg.is_symlink = False;
-			}
+	*mounted = False;
 
-			if( !filter(ent->d_name, st.st_mode) ) {
-				files_skipped++;
-				continue;
-			}
+	/* wd->path is canonical, as the mount table and fstab lookups need;
+	 * link targets are resolved once and kept (see lnkcache.h) */
+	if(is_symlink) {
+		path = lcache_resolve(&wd->links, dirfd(wd->dir),
+			wd->path, name, &ei->link, st);
+		if(!path) return False;
+	} else {
+		sprintf(fqn, "%s/%s", (wd->path[1] ? wd->path : ""), name);
+	}
+	
+	res = mtab_is_mounted(path);
+	if(res == -1) res = path_mounted(path);
+	
+	if(res) {
+		is_mpoint = True;
+		*mounted = True;
+	} else if(is_symlink || wd->has_mpts) {
+		is_mpoint = (is_fstab_mount_point(path) ? True : False);
+	}
 
-			files_total++;
-			add_fsize(&size_total, st.st_size);
-			
-			/* new file */
-			if(i == nfiles) {
-				if(list_size < (nfiles + 1)) {
-					size_t new_size = list_size + FILE_LIST_GROW_BY;
-					file_list = realloc(file_list,
-						sizeof(struct watch_rec) * new_size);
-					if(!file_list) return RP_ENOMEM;
-					list_size = new_size;
-				}
-				file_list[nfiles].name = strdup(ent->d_name);
-				file_list[nfiles].mtime = st.st_mtime;
-				file_list[nfiles].ctime = st.st_ctime;
-				file_list[nfiles].touched = True;
-				
-				/* is it a mount point ? */
-				if(S_ISDIR(st.st_mode)) {
-					char cur_fqn[strlen(path) + strlen(ent->d_name)+2];
-					char *link_target = NULL;
-					
-					sprintf(cur_fqn, "%s/%s", path, ent->d_name);
-					if(msg.is_symlink) get_link_target(cur_fqn, &link_target);
-					
-					if(path_mounted(link_target ? link_target : cur_fqn)) {
-						is_mpoint = True;
-						is_mounted = True;
-					} else if(link_target || has_mpts) {
-						is_mpoint = (is_in_fstab(link_target ?
-							link_target : cur_fqn) ? True : False);
-					}
-					if(link_target) free(link_target);
-				}
-				file_list[nfiles].is_mpoint = is_mpoint;
+	return is_mpoint;
+}
 
-				nfiles++;
-				
-				dbg_trace("update: \'%s\' was created\n", ent->d_name);
-				msg.reason = MSG_ADD;		
-				msg.files_total = files_total;
-				msg.files_skipped = files_skipped;
-				msg.size_total = size_total;
-			
-			} else if( (file_list[i].mtime != st.st_mtime) ||
-				(file_list[i].ctime != st.st_ctime) ||
-				(S_ISDIR(st.st_mode) && (file_list[i].device != st.st_dev)) ) {
-				dbg_trace("update: \'%s\' was changed\n", ent->d_name);
-				/* file was modified */
-				file_list[i].mtime = st.st_mtime;
-				file_list[i].ctime = st.st_ctime;
-				if(file_list[i].device != st.st_dev) {
-					dev_changed = True;
-					file_list[i].device = st.st_dev;
-				}
-				msg.reason = MSG_UPDATE;
+/*
+ * Queues a message and name (may be NULL) to be sent to the parent.
+ * Queued messages are sent off once the frame buffer is full, or
+ * RP_FLUSH_INT has passed since the first one was queued.
+ */
+static int send_message(struct watch_data *wd,
+	struct msg_data *msg, const char *name)
+{
+	if(rdm_put(wd->out, msg, name)) return RP_IOFAIL;
+	
+	wd->nchanges++;
 
-			} else continue; /* nothing changed */
-			
-			/* send add/update message */
-			if(S_ISREG(st.st_mode)) {
-				msg.db_index = db_match(ent->d_name, &app_inst.type_db);
-			} else if(S_ISDIR(st.st_mode)) {
-				if(file_list[i].is_mpoint || dev_changed) {
-					char *ltgt = NULL;
-					char fqn[strlen(path) + strlen(ent->d_name) + 2];
-					
-					sprintf(fqn, "%s/%s", path, ent->d_name);
-					if(msg.is_symlink) get_link_target(fqn, &ltgt);
-					
-					is_mounted = (Boolean)path_mounted(ltgt ? ltgt : fqn);
-					is_mpoint = (is_mounted) ? True : file_list[i].is_mpoint;
-					
-					if(ltgt) free(ltgt);
-				}
-				msg.db_index = DB_UNKNOWN;
-			} else {
-				msg.db_index = DB_UNKNOWN;
-			}
+	if(rdm_pending(wd->out) == 1) {
+		clock_gettime(CLOCK_MONOTONIC, &wd->flush_time);
+		add_msecs(&wd->flush_time, RP_FLUSH_INT);
+	} else if(!msecs_until(&wd->flush_time)) {
+		return flush_messages(wd);
+	}
+	return 0;
+}
 
-			msg.size = st.st_size;
-			msg.name_len = strlen(ent->d_name);
-			msg.mode = st.st_mode;
-			msg.ctime = st.st_ctime;
-			msg.mtime = st.st_mtime;
-			msg.gid = st.st_gid;
-			msg.uid = st.st_uid;
-			msg.is_mpoint = is_mpoint;
-			msg.is_mounted = is_mounted;
-	
-			out = writen(pipe_fd, &msg, sizeof(struct msg_data));
-			out += writen(pipe_fd, ent->d_name, msg.name_len);
-			if(out < (sizeof(struct msg_data) + msg.name_len))
-				return RP_IOFAIL;
-			
-		}
-		closedir(dir);
+/*
+ * Sends off any queued messages
+ */
+static int flush_messages(struct watch_data *wd)
+{
+	return rdm_flush(wd->out) ? RP_IOFAIL : 0;
+}
 
-		/* check for deleted files */
-		for(i = 0; i < nfiles; ) {
-			size_t delta;
-		
-			if(file_list[i].touched) {
-				file_list[i].touched = False;
-				
-				i++;
-				continue;
-			}
-			dbg_trace("update: \'%s\' was removed\n", file_list[i].name);
-			
-			/* send removal message */
-			memset(&msg, 0, sizeof(struct msg_data));
-			msg.reason = MSG_REMOVE;
-			msg.name_len = strlen(file_list[i].name);
-
-			out = writen(pipe_fd, &msg, sizeof(struct msg_data));
-			out += writen(pipe_fd, file_list[i].name, msg.name_len);
-			if(out < (sizeof(struct msg_data) + msg.name_len))
-				return RP_IOFAIL;
-
-			/* remove it from the watch list */
-			delta = (nfiles - 1) - i;
-
-			if(delta) {
-				memmove(&file_list[i], &file_list[i + 1],
-					sizeof(struct watch_rec) * delta);
-			}
-			nfiles--;
-		}
-		memset(&msg, 0, sizeof(struct msg_data));
-		msg.reason = MSG_EOD;
-		msg.files_total = files_total;
-		msg.files_skipped = files_skipped;
-		msg.size_total = size_total;
+static int send_removal(struct watch_data *wd, const char *name)
+{
+	struct msg_data msg;
+	
+	memset(&msg, 0, sizeof(struct msg_data));
+	msg.reason = MSG_REMOVE;
+	
+	return send_message(wd, &msg, name);
+}
 
-		out = writen(pipe_fd, &msg, sizeof(struct msg_data));
-		if(out < sizeof(struct msg_data)) return RP_IOFAIL;
-						
-		sleep(app_res.refresh_int);
-	}
+/*
+ * Tells the parent that the scan failed, and is over. Since there's
+ * nothing else to be done if the parent can't be told, exits then.
+ */
+static void send_error(struct watch_data *wd, int code)
+{
+	struct msg_data msg;
+
+	memset(&msg, 0, sizeof(struct msg_data));
+	msg.reason = MSG_ERROR;
+	msg.fields = MF_ERRNO;
+	msg.stat_errno = code;
+
+	if(rdm_put(wd->out, &msg, NULL) || rdm_flush(wd->out))
+		_exit(RP_IOFAIL);
+}
+
+/*
+ * Computes directory totals from the watch list and sends the
+ * end-of-data message, along with anything queued, to the parent
+ */
+static int send_totals(struct watch_data *wd)
+{
+	struct msg_data msg;
 
-	return RP_SUCCES; /* reached if parent process exits */
+	get_totals(wd, &msg);
+	
+	if(rdm_put(wd->out, &msg, NULL)) return RP_IOFAIL;
+	
+	return flush_messages(wd);
 }
 
-static void read_proc_sigalrm(int sig)
+/*
+ * Initializes an end-of-data message with totals from the watch list.
+ * The directory's attributes as of when it was opened are sent along,
+ * which the parent keys the listing with, since it's at least as recent.
+ */
+static void get_totals(struct watch_data *wd, struct msg_data *msg)
 {
-	/* we use SIGALRM to force refresh */
+	size_t i;
+
+	memset(msg, 0, sizeof(struct msg_data));
+	msg->reason = MSG_EOD;
+	msg->fields = MF_TOTALS;
+	
+	if(wd->dir) {
+		msg->fields |= MF_DIRID;
+		msg->dir_dev = wd->device;
+		msg->dir_ino = wd->dir_ino;
+		msg->dir_mtime.tv_sec = wd->dir_mtime;
+		msg->dir_mtime.tv_nsec = wd->dir_mtime_ns;
+	}
+
+	for(i = 0; i < wd->list.nrecs; i++) {
+		if(wd->list.recs[i].flags & DRF_SHOWN) {
+			msg->files_total++;
+			add_fsize(&msg->size_total, wd->list.recs[i].size);
+		} else {
+			msg->files_skipped++;
+		}
+	}
 }
 
 static void read_proc_sigterm(int sig)
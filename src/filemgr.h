@@ -11,7 +11,10 @@
 int initialize(void);
 
 /* Reads directory specified; if absolute is False path is appended
- * to the current location. Returns 0 on success, errno otherwise. */
+ * to the current location. The location is checked asynchronously, so
+ * this returns 0 once that has been started, errno if it couldn't be.
+ * Errors accessing the location are reported later, and the path field
+ * is reset to the current location then. */
 int set_location(const char *path, Boolean absolute);
 
 /* Rereads current directory */
@@ -39,11 +42,27 @@ Boolean read_proc_sigchld(pid_t pid, int status);
 /* Force the watcher process to check for changes */
 void force_update(void);
 
-/* Kills the directory reader/watcher process if one exists */
+/* Stops the directory reader/watcher reading the current location */
 void stop_read_proc(void);
 
+/*
+ * Saves the listing of the current location on disk, so that it can be
+ * shown right away next time xfile is started there (see dirsnap.h).
+ */
+void save_listing(void);
+
+/*
+ * Schedules the named directory in the current location, if not NULL,
+ * and the parent directory to be prefetched into the listing cache.
+ */
+void prefetch_selection(const char *name);
+
 /* user flags for file list items */
 #define FLI_MNTPOINT	0x01
 #define FLI_MOUNTED		0x02
 
+/* built-in icon class (MI_*) the item was shown with, in the upper bits */
+#define FLI_ICON_SHIFT	8
+#define FLI_ICON(f) ((f) >> FLI_ICON_SHIFT)
+
 #endif /* FILEMGR_H */
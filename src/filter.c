@@ -0,0 +1,633 @@
+/*
+ * Copyright (C) 2026 alx@fastestcode.org
+ * This software is distributed under the terms of the X/MIT license.
+ * See the included COPYING file for further information.
+ */
+
+/*
+ * File filter; see filter.h. The expression grammar is:
+ *
+ *   expr  := ['!'] or
+ *   or    := and { '|' and }
+ *   and   := unary { '&' unary }
+ *   unary := '!' unary | '(' or ')' | term
+ *   term  := key cmp value | pattern
+ *
+ * where key is one of name, size, mtime, owner or type. A leading '!'
+ * negates the whole expression. For compatibility with plain pattern
+ * lists, "!!" at the start and "||" stand for literal '!' and '|'.
+ * A backslash escapes any character within a term.
+ *
+ * Input that makes no use of the expression syntax, or that doesn't parse
+ * and has no key terms, is taken for a plain '|' separated pattern list,
+ * as it was before, with blanks and the characters above kept verbatim.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <fnmatch.h>
+#include <pwd.h>
+#include "filter.h"
+
+/* Maximum nesting depth of parenthesized expressions */
+#define DEPTH_MAX 32
+
+/* Node array growth increment */
+#define NODES_GROW_BY 16
+
+/* Parser state */
+struct parser {
+	const char *p;
+	char *d; /* current position in the string pool */
+	struct filter_prog *fp;
+	unsigned int depth;
+	int bang; /* the first term is a pattern starting with '!' */
+	int ops; /* operators or parentheses were found */
+	int keys; /* key terms were found */
+	int error;
+};
+
+/* Term keys */
+enum { KEY_NAME, KEY_SIZE, KEY_MTIME, KEY_OWNER, KEY_TYPE, NKEYS };
+static const char *key_names[NKEYS] = {
+	"name", "size", "mtime", "owner", "type"
+};
+
+/* Size (bytes by default) and age (days by default) units */
+static const char size_units[] = "bkmgt";
+static const unsigned long long size_mul[] = {
+	1, 1ULL << 10, 1ULL << 20, 1ULL << 30, 1ULL << 40
+};
+static const char age_units[] = "smhdw";
+static const unsigned long long age_mul[] = {
+	1, 60, 3600, 86400, 86400 * 7
+};
+
+/* Local prototypes */
+static int compile_plain(struct filter_prog*, const char*);
+static unsigned int parse_or(struct parser*);
+static unsigned int parse_and(struct parser*);
+static unsigned int parse_unary(struct parser*);
+static unsigned int parse_term(struct parser*);
+static void parse_key(struct parser*, int*, int*);
+static char* scan_value(struct parser*);
+static void set_pattern(struct filter_node*, char*);
+static int set_predicate(struct filter_prog*,
+	struct filter_node*, int key, char *value);
+static int parse_number(const char*, const char *units,
+	const unsigned long long *mul, char def_unit, unsigned long long*);
+static unsigned int add_node(struct parser*, int op,
+	unsigned int left, unsigned int right);
+static int is_term_end(const char*);
+static int has_wildcards(const char*, size_t);
+static int eval_node(const struct filter_prog*,
+	unsigned int, struct filter_ent*);
+static int compare(unsigned long long, int cmp, unsigned long long);
+
+#define skip_blanks(s) while(*(s) == ' ' || *(s) == '\t') (s)++
+
+int filter_compile(struct filter_prog *fp,
+	const char *expr, struct file_type_db *db)
+{
+	struct parser ps;
+	int negate = 0;
+
+	memset(fp, 0, sizeof(struct filter_prog));
+	fp->db = db;
+
+	memset(&ps, 0, sizeof(struct parser));
+	ps.fp = fp;
+	ps.p = expr;
+
+	if(*ps.p == '!') {
+		/* the second one is taken for a part of the pattern */
+		if(ps.p[1] == '!')
+			ps.bang = 1;
+		else
+			negate = 1;
+		ps.p++;
+	}
+
+	if(!*ps.p) return 0;
+
+	/* terms are no longer than the expression, which has
+	 * an operator or the terminating NUL after each */
+	fp->pool = malloc(strlen(ps.p) + 1);
+	if(!fp->pool) return ENOMEM;
+	ps.d = fp->pool;
+
+	fp->root = parse_or(&ps);
+	if(!ps.error && *ps.p) ps.error = EINVAL; /* unbalanced ')' */
+
+	if((ps.error == EINVAL && !ps.keys) || (!ps.error && !ps.ops)) {
+		filter_free(fp);
+		fp->db = db;
+		return compile_plain(fp, expr);
+	}
+
+	if(negate) fp->root = add_node(&ps, FOP_NOT, fp->root, 0);
+
+	if(ps.error) {
+		filter_free(fp);
+		return ps.error;
+	}
+	return 0;
+}
+
+void filter_free(struct filter_prog *fp)
+{
+	free(fp->nodes);
+	free(fp->pool);
+	memset(fp, 0, sizeof(struct filter_prog));
+}
+
+int filter_eval(const struct filter_prog *fp, struct filter_ent *ent)
+{
+	if(!fp->nnodes) return 1;
+	return eval_node(fp, fp->root, ent);
+}
+
+/*
+ * Compiles a plain '|' separated pattern list, optionally negated as a whole
+ * with a leading '!'. Doubled '!' and '|' stand for literal characters.
+ */
+static int compile_plain(struct filter_prog *fp, const char *expr)
+{
+	struct parser ps;
+	const char *p = expr;
+	unsigned int n;
+	int negate = 0;
+	int nterms = 0;
+	char *s;
+
+	memset(&ps, 0, sizeof(struct parser));
+	ps.fp = fp;
+
+	if(*p == '!') {
+		if(p[1] != '!') negate = 1;
+		p++;
+	}
+
+	/* separators make up for terminating NULs */
+	fp->pool = malloc(strlen(p) + 1);
+	if(!fp->pool) return ENOMEM;
+	s = ps.d = fp->pool;
+
+	for( ; ; ) {
+		if(*p == '|' && p[1] == '|') {
+			*ps.d++ = '|';
+			p += 2;
+			continue;
+		}
+
+		if(*p == '|' || *p == '\0') {
+			if(ps.d > s) {
+				*ps.d = '\0';
+				n = add_node(&ps, FOP_EXACT, 0, 0);
+				if(ps.error) break;
+				set_pattern(&fp->nodes[n], s);
+				fp->root = nterms++ ?
+					add_node(&ps, FOP_OR, fp->root, n) : n;
+				s = ++ps.d;
+			}
+			if(*p == '\0') break;
+			p++;
+			continue;
+		}
+		*ps.d++ = *p++;
+	}
+
+	if(negate && nterms) fp->root = add_node(&ps, FOP_NOT, fp->root, 0);
+
+	if(ps.error) {
+		filter_free(fp);
+		return ps.error;
+	}
+	return 0;
+}
+
+static unsigned int parse_or(struct parser *ps)
+{
+	unsigned int left = parse_and(ps);
+
+	while(!ps->error && *ps->p == '|') {
+		ps->p++;
+		left = add_node(ps, FOP_OR, left, parse_and(ps));
+	}
+	return left;
+}
+
+static unsigned int parse_and(struct parser *ps)
+{
+	unsigned int left = parse_unary(ps);
+
+	while(!ps->error && *ps->p == '&') {
+		ps->ops = 1;
+		ps->p++;
+		left = add_node(ps, FOP_AND, left, parse_unary(ps));
+	}
+	return left;
+}
+
+static unsigned int parse_unary(struct parser *ps)
+{
+	unsigned int n;
+
+	if(ps->error) return 0;
+	skip_blanks(ps->p);
+
+	if(ps->bang) return parse_term(ps);
+
+	if(*ps->p == '!') {
+		ps->ops = 1;
+		ps->p++;
+		n = parse_unary(ps);
+		return add_node(ps, FOP_NOT, n, 0);
+	}
+
+	if(*ps->p == '(') {
+		ps->ops = 1;
+		if(++ps->depth > DEPTH_MAX) {
+			ps->error = EINVAL;
+			return 0;
+		}
+		ps->p++;
+		n = parse_or(ps);
+		if(!ps->error && *ps->p != ')') ps->error = EINVAL;
+		if(ps->error) return 0;
+		ps->p++;
+		ps->depth--;
+		skip_blanks(ps->p);
+		return n;
+	}
+
+	return parse_term(ps);
+}
+
+static unsigned int parse_term(struct parser *ps)
+{
+	struct filter_node *node;
+	unsigned int n;
+	char *value;
+	int key = KEY_NAME;
+	int cmp = FCMP_EQ;
+
+	if(!ps->bang) parse_key(ps, &key, &cmp);
+	ps->bang = 0;
+
+	value = scan_value(ps);
+	n = add_node(ps, FOP_EXACT, 0, 0);
+	if(ps->error) return 0;
+	node = &ps->fp->nodes[n];
+
+	if(key == KEY_NAME) {
+		set_pattern(node, value);
+		if(cmp == FCMP_NE) n = add_node(ps, FOP_NOT, n, 0);
+	} else {
+		ps->error = set_predicate(ps->fp, node, key, value);
+		node->cmp = cmp;
+	}
+
+	return n;
+}
+
+/*
+ * Checks if the term starts with a key and comparison operator,
+ * and if so, sets these and advances past them.
+ */
+static void parse_key(struct parser *ps, int *key, int *cmp)
+{
+	const char *p = ps->p;
+	size_t len;
+	int i;
+
+	while(isalpha((unsigned char)*p)) p++;
+	len = p - ps->p;
+	skip_blanks(p);
+
+	if(!len) return;
+
+	for(i = 0; i < NKEYS; i++) {
+		if(strlen(key_names[i]) == len &&
+			!strncasecmp(ps->p, key_names[i], len)) break;
+	}
+	if(i == NKEYS) return; /* a pattern */
+
+	if(p[0] == '!' && p[1] == '=') {
+		*cmp = FCMP_NE;
+		p += 2;
+	} else if(p[0] == '<') {
+		*cmp = (p[1] == '=') ? FCMP_LE : FCMP_LT;
+		p += (p[1] == '=') ? 2 : 1;
+	} else if(p[0] == '>') {
+		*cmp = (p[1] == '=') ? FCMP_GE : FCMP_GT;
+		p += (p[1] == '=') ? 2 : 1;
+	} else if(p[0] == '=') {
+		*cmp = FCMP_EQ;
+		p += (p[1] == '=') ? 2 : 1;
+	} else {
+		return;
+	}
+
+	/* strings can only be compared for equality */
+	if((i == KEY_NAME || i == KEY_OWNER || i == KEY_TYPE) &&
+		*cmp != FCMP_EQ && *cmp != FCMP_NE) ps->error = EINVAL;
+
+	*key = i;
+	ps->p = p;
+	ps->keys = 1;
+	ps->ops = 1;
+}
+
+/*
+ * Copies the term value to the string pool, up to the next operator,
+ * with surrounding blanks removed. Returns the NUL terminated copy.
+ */
+static char* scan_value(struct parser *ps)
+{
+	char *start = ps->d;
+	char *end;
+
+	skip_blanks(ps->p);
+
+	while(!is_term_end(ps->p)) {
+		if(ps->p[0] == '\\' && ps->p[1]) {
+			*ps->d++ = *ps->p++;
+		} else if(ps->p[0] == '|') {
+			/* "||" */
+			ps->p++;
+		}
+		*ps->d++ = *ps->p++;
+	}
+
+	/* trailing blanks, unless escaped */
+	end = ps->d;
+	while(end > start && (end[-1] == ' ' || end[-1] == '\t') &&
+		!(end - start > 1 && end[-2] == '\\')) end--;
+	*end = '\0';
+	ps->d = end + 1;
+
+	if(end == start && !ps->error) ps->error = EINVAL;
+
+	return start;
+}
+
+static int is_term_end(const char *p)
+{
+	return (!*p || *p == '&' || *p == ')' || (*p == '|' && p[1] != '|'));
+}
+
+/*
+ * Sets up a name pattern node, picking the cheapest way to match it
+ */
+static void set_pattern(struct filter_node *node, char *pattern)
+{
+	size_t len = strlen(pattern);
+	char *lit = pattern;
+	size_t lit_len = len;
+	int leading = 0;
+	int trailing = 0;
+
+	if(lit_len && lit[0] == '*') {
+		leading = 1;
+		lit++;
+		lit_len--;
+	}
+	if(lit_len && lit[lit_len - 1] == '*') {
+		trailing = 1;
+		lit_len--;
+	}
+
+	if(has_wildcards(lit, lit_len)) {
+		node->op = FOP_GLOB;
+		node->str = pattern;
+		node->len = len;
+		return;
+	}
+
+	/* the trailing asterisk isn't needed anymore */
+	lit[lit_len] = '\0';
+
+	if(leading && trailing)
+		node->op = FOP_CONTAINS;
+	else if(leading)
+		node->op = FOP_SUFFIX;
+	else if(trailing)
+		node->op = FOP_PREFIX;
+	else
+		node->op = FOP_EXACT;
+
+	node->str = lit;
+	node->len = lit_len;
+}
+
+/*
+ * Sets up a stat data dependent node. Returns zero or EINVAL.
+ */
+static int set_predicate(struct filter_prog *fp,
+	struct filter_node *node, int key, char *value)
+{
+	unsigned int i;
+
+	fp->need_stat = 1;
+	node->str = value;
+	node->len = strlen(value);
+
+	switch(key) {
+		case KEY_SIZE:
+		node->op = FOP_SIZE;
+		return parse_number(value, size_units, size_mul, 'b', &node->num);
+
+		case KEY_MTIME:
+		node->op = FOP_AGE;
+		return parse_number(value, age_units, age_mul, 'd', &node->num);
+
+		case KEY_OWNER:
+		node->op = FOP_OWNER;
+		for(i = 0; isdigit((unsigned char)value[i]); i++);
+		if(!value[i]) {
+			node->num = strtoul(value, NULL, 10);
+		} else {
+			struct passwd *pw = getpwnam(value);
+			if(!pw) return EINVAL;
+			node->num = pw->pw_uid;
+		}
+		break;
+
+		case KEY_TYPE:
+		node->op = FOP_TYPE;
+		if(!fp->db) break;
+		for(i = 0; i < fp->db->count; i++) {
+			if(!strcasecmp(fp->db->recs[i].name, value)) break;
+		}
+		if(i == fp->db->count) return EINVAL;
+		break;
+	}
+	return 0;
+}
+
+/*
+ * Parses a number, optionally followed by a single character unit from
+ * the units string (case insensitive), and multiplies it by the unit's
+ * multiplier in mul. Returns zero on success, EINVAL otherwise.
+ */
+static int parse_number(const char *s, const char *units,
+	const unsigned long long *mul, char def_unit, unsigned long long *ret)
+{
+	unsigned long long n;
+	const char *u;
+	char *end;
+
+	if(!isdigit((unsigned char)*s)) return EINVAL;
+
+	errno = 0;
+	n = strtoull(s, &end, 10);
+	if(errno) return EINVAL;
+
+	skip_blanks(end);
+	if(end[0] && end[1]) return EINVAL;
+
+	u = strchr(units, end[0] ? tolower((unsigned char)end[0]) : def_unit);
+	if(!u || !*u) return EINVAL;
+
+	*ret = n * mul[u - units];
+	return 0;
+}
+
+static unsigned int add_node(struct parser *ps,
+	int op, unsigned int left, unsigned int right)
+{
+	struct filter_prog *fp = ps->fp;
+	struct filter_node *node;
+
+	if(ps->error) return 0;
+
+	if(!(fp->nnodes % NODES_GROW_BY)) {
+		void *p = realloc(fp->nodes, sizeof(struct filter_node) *
+			(fp->nnodes + NODES_GROW_BY));
+		if(!p) {
+			ps->error = ENOMEM;
+			return 0;
+		}
+		fp->nodes = p;
+	}
+
+	node = &fp->nodes[fp->nnodes];
+	memset(node, 0, sizeof(struct filter_node));
+	node->op = op;
+	node->left = left;
+	node->right = right;
+
+	return fp->nnodes++;
+}
+
+static int has_wildcards(const char *s, size_t len)
+{
+	size_t i;
+
+	for(i = 0; i < len; i++) {
+		if(s[i] == '*' || s[i] == '?' || s[i] == '[' || s[i] == '\\')
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Evaluates the node with three-valued logic; -1 meaning unknown until
+ * stat data is available. Operands of AND and OR are evaluated left to
+ * right, and only as far as necessary, so that costly terms (type) may
+ * be avoided by putting these last.
+ */
+static int eval_node(const struct filter_prog *fp,
+	unsigned int i, struct filter_ent *ent)
+{
+	const struct filter_node *node = &fp->nodes[i];
+	const struct stat *st = ent->st;
+	size_t name_len;
+	int a, b;
+
+	switch(node->op) {
+		case FOP_EXACT:
+		return !strcmp(ent->name, node->str);
+
+		case FOP_PREFIX:
+		return !strncmp(ent->name, node->str, node->len);
+
+		case FOP_SUFFIX:
+		name_len = strlen(ent->name);
+		return (name_len >= node->len && !memcmp(ent->name +
+			(name_len - node->len), node->str, node->len));
+
+		case FOP_CONTAINS:
+		return (strstr(ent->name, node->str) != NULL);
+
+		case FOP_GLOB:
+		return !fnmatch(node->str, ent->name, 0);
+
+		case FOP_SIZE:
+		if(!st) return -1;
+		return compare(st->st_size, node->cmp, node->num);
+
+		case FOP_AGE: {
+			time_t now;
+
+			if(!st) return -1;
+			now = time(NULL);
+			return compare((now > st->st_mtime) ?
+				(now - st->st_mtime) : 0, node->cmp, node->num);
+		}
+
+		case FOP_OWNER:
+		if(!st) return -1;
+		return compare(st->st_uid, node->cmp, node->num);
+
+		case FOP_TYPE:
+		if(!st) return -1;
+		if(ent->db_index == FILTER_NO_DB) {
+			if(!S_ISREG(st->st_mode) || !fp->db)
+				ent->db_index = DB_UNKNOWN;
+			else if(ent->name_only)
+				ent->db_index = db_match_name(ent->name, fp->db);
+			else
+				ent->db_index = db_match(ent->name, fp->db);
+		}
+		a = (DB_DEFINED(ent->db_index) &&
+			!strcasecmp(fp->db->recs[ent->db_index].name, node->str));
+		return (node->cmp == FCMP_NE) ? !a : a;
+
+		case FOP_NOT:
+		a = eval_node(fp, node->left, ent);
+		return (a == -1) ? -1 : !a;
+
+		case FOP_AND:
+		a = eval_node(fp, node->left, ent);
+		if(a == 0) return 0;
+		b = eval_node(fp, node->right, ent);
+		if(b == 0) return 0;
+		return (a == 1 && b == 1) ? 1 : -1;
+
+		case FOP_OR:
+		a = eval_node(fp, node->left, ent);
+		if(a == 1) return 1;
+		b = eval_node(fp, node->right, ent);
+		if(b == 1) return 1;
+		return (a == 0 && b == 0) ? 0 : -1;
+	}
+	return 0;
+}
+
+static int compare(unsigned long long a, int cmp, unsigned long long b)
+{
+	switch(cmp) {
+		case FCMP_NE: return a != b;
+		case FCMP_LT: return a < b;
+		case FCMP_GT: return a > b;
+		case FCMP_LE: return a <= b;
+		case FCMP_GE: return a >= b;
+	}
+	return a == b;
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2026 alx@fastestcode.org
+ * This software is distributed under the terms of the X/MIT license.
+ * See the included COPYING file for further information.
+ */
+
+/*
+ * File filter. The filter expression, as specified by the user, is
+ * compiled once into a tree of terms; name patterns are mostly matched
+ * with plain string comparisons rather than being reinterpreted by
+ * fnmatch for each file name, and terms that depend on stat data
+ * can be told apart, so that entries can be filtered before stat.
+ */
+
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "typedb.h"
+
+/* Filter node kinds */
+enum filter_op {
+	FOP_EXACT,		/* name without wildcards */
+	FOP_PREFIX,		/* abc* */
+	FOP_SUFFIX,		/* *abc */
+	FOP_CONTAINS,	/* *abc* */
+	FOP_GLOB,		/* anything else, matched with fnmatch */
+	FOP_SIZE,		/* these need stat data */
+	FOP_AGE,
+	FOP_OWNER,
+	FOP_TYPE,
+	FOP_NOT,
+	FOP_AND,
+	FOP_OR
+};
+
+/* Comparison operators */
+enum filter_cmp {
+	FCMP_EQ,
+	FCMP_NE,
+	FCMP_LT,
+	FCMP_GT,
+	FCMP_LE,
+	FCMP_GE
+};
+
+struct filter_node {
+	unsigned char op;
+	unsigned char cmp;
+	unsigned int left;	/* operand node indices */
+	unsigned int right;
+	const char *str;	/* literal part, or the whole pattern for FOP_GLOB */
+	size_t len;
+	unsigned long long num; /* size, age in seconds, or uid */
+};
+
+/* Compiled filter */
+struct filter_prog {
+	struct filter_node *nodes;
+	unsigned int nnodes;
+	unsigned int root;
+	int need_stat; /* has terms that depend on stat data */
+	struct file_type_db *db;
+	char *pool; /* term strings */
+};
+
+/* Entry data a filter is evaluated against */
+struct filter_ent {
+	const char *name;
+	const struct stat *st; /* NULL if not stat'ed (yet) */
+	int db_index; /* FILTER_NO_DB until matched against the type DB */
+	int name_only; /* match types by name alone (see db_match_name) */
+};
+
+#define FILTER_NO_DB (-0x100)
+
+/*
+ * Compiles the filter expression (see the Filter section in the manual).
+ * The type database is used to resolve type names, and may be NULL if
+ * the expression contains none. Input that isn't an expression is compiled
+ * as a plain pattern list (see filter.c). Returns zero on success, EINVAL if
+ * the expression is malformed, or errno otherwise. An expression that
+ * contains no terms compiles into a filter that matches anything.
+ */
+int filter_compile(struct filter_prog*, const char *expr,
+	struct file_type_db *db);
+
+/* Frees data allocated by filter_compile, leaving an empty filter */
+void filter_free(struct filter_prog*);
+
+/*
+ * Evaluates the filter. Returns 1 if the entry passes, 0 if it doesn't,
+ * or -1 if that can't be told without stat data. Sets ent->db_index if
+ * the entry had to be matched against the type database.
+ */
+int filter_eval(const struct filter_prog*, struct filter_ent *ent);
+
+#endif /* FILTER_H */
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2026 alx@fastestcode.org
+ * This software is distributed under the terms of the X/MIT license.
+ * See the included COPYING file for further information.
+ */
+
+/*
+ * Directory scanning policies by file system class
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include "fspolicy.h"
+#include "const.h"
+
+/* Built-in defaults. Content sniffing is too expensive over the network,
+ * and reading pseudo files in /proc and such may block, or have side
+ * effects. inotify only sees changes made locally on remote file systems,
+ * so these are polled instead, though less often. */
+struct fs_policy fs_policies[NUM_FS_CLASSES] = {
+	/* FSC_LOCAL */
+	{ FSP_SNIFF | FSP_NOTIFY | FSP_LINKS, 1, 0 },
+	/* FSC_REMOTE */
+	{ FSP_LINKS, 4, 0 },
+	/* FSC_FUSE */
+	{ FSP_LINKS, 4, 0 },
+	/* FSC_MEMORY (stat is cheap, threads wouldn't help) */
+	{ FSP_SNIFF | FSP_NOTIFY | FSP_LINKS, 1, 1 },
+	/* FSC_VIRTUAL (inotify doesn't report changes there) */
+	{ FSP_LINKS, 1, 1 }
+};
+
+static const char *class_names[NUM_FS_CLASSES] = {
+	"local", "remote", "fuse", "memory", "virtual"
+};
+
+/* Policy string flag words */
+static const struct {
+	const char *name;
+	unsigned int flag;
+} flag_words[] = {
+	{ "sniff", FSP_SNIFF },
+	{ "notify", FSP_NOTIFY },
+	{ "links", FSP_LINKS },
+	{ NULL, 0 }
+};
+
+/* Local prototypes */
+static int parse_number(const char *str, size_t len,
+	unsigned int min, unsigned int max, unsigned int *ret);
+
+int fsp_parse(struct fs_policy *fsp, const char *spec)
+{
+	struct fs_policy tmp = *fsp;
+	const char *p = spec;
+
+	while(*p) {
+		size_t len;
+		int neg = 0;
+		int i;
+
+		while(*p && (isspace((unsigned char)*p) || *p == ',')) p++;
+		if(!*p) break;
+
+		for(len = 0; p[len] && !isspace((unsigned char)p[len]) &&
+			p[len] != ','; len++);
+
+		if(len > 9 && !strncmp(p, "interval=", 9)) {
+			if(parse_number(p + 9, len - 9, 1, 1000, &tmp.interval))
+				return EINVAL;
+		} else if(len > 8 && !strncmp(p, "threads=", 8)) {
+			if(parse_number(p + 8, len - 8, 0,
+				MAX_READER_THREADS, &tmp.threads)) return EINVAL;
+		} else {
+			const char *word = p;
+			size_t wlen = len;
+
+			if(len > 2 && !strncmp(p, "no", 2)) {
+				neg = 1;
+				word += 2;
+				wlen -= 2;
+			}
+
+			for(i = 0; flag_words[i].name; i++) {
+				if(strlen(flag_words[i].name) == wlen &&
+					!strncmp(flag_words[i].name, word, wlen)) break;
+			}
+			if(!flag_words[i].name) return EINVAL;
+
+			if(neg)
+				tmp.flags &= ~flag_words[i].flag;
+			else
+				tmp.flags |= flag_words[i].flag;
+		}
+		p += len;
+	}
+
+	*fsp = tmp;
+	return 0;
+}
+
+const char* fsp_class_name(int fs_class)
+{
+	if(fs_class < 0 || fs_class >= NUM_FS_CLASSES) return NULL;
+	return class_names[fs_class];
+}
+
+/*
+ * Parses a decimal number of len characters in the range specified.
+ * Returns zero on success, EINVAL otherwise.
+ */
+static int parse_number(const char *str, size_t len,
+	unsigned int min, unsigned int max, unsigned int *ret)
+{
+	unsigned long val = 0;
+	size_t i;
+
+	for(i = 0; i < len; i++) {
+		if(!isdigit((unsigned char)str[i])) return EINVAL;
+		val = val * 10 + (str[i] - '0');
+		if(val > max) return EINVAL;
+	}
+	if(val < min) return EINVAL;
+
+	*ret = (unsigned int)val;
+	return 0;
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2026 alx@fastestcode.org
+ * This software is distributed under the terms of the X/MIT license.
+ * See the included COPYING file for further information.
+ */
+
+/*
+ * Directory scanning policies by file system class (see get_fs_class).
+ * Each class has built-in defaults, which may be overridden with a
+ * policy string given in the corresponding *FsPolicy resource.
+ */
+
+#ifndef FSPOLICY_H
+#define FSPOLICY_H
+
+#include "fsutil.h"
+
+/* Policy flags */
+#define FSP_SNIFF	0x01	/* open files to match contents against the DB */
+#define FSP_NOTIFY	0x02	/* watch for changes with inotify, if available */
+#define FSP_LINKS	0x04	/* resolve symlink targets */
+
+struct fs_policy {
+	unsigned int flags;
+	unsigned int interval;	/* polling interval, times refreshInterval */
+	unsigned int threads;	/* stat threads, 0 for readerThreads */
+};
+
+/* Policies by FSC_* class */
+extern struct fs_policy fs_policies[NUM_FS_CLASSES];
+
+/*
+ * Parses a policy string and applies it to the policy. The string consists
+ * of whitespace or comma separated words: sniff, nosniff, notify, nonotify,
+ * links, nolinks, interval=N and threads=N. Settings that aren't mentioned
+ * are left as they are. Returns zero on success, or EINVAL, in which case
+ * the policy is left unchanged.
+ */
+int fsp_parse(struct fs_policy*, const char *spec);
+
+/* Returns the name of the FSC_* file system class */
+const char* fsp_class_name(int fs_class);
+
+#endif /* FSPOLICY_H */
@@ -32,6 +32,8 @@ struct mnt_tab {
 	size_t size;
 	void *data;
 	time_t mtime;
+	size_t *index; /* mount point hash index, record + 1, zero if vacant */
+	size_t index_size;
 };
 
 /* Module globals */
@@ -42,30 +44,34 @@ static struct mnt_tab fstab = { 0 };
 static void update_fstab(void);
 static int read_tab(const char*, struct mnt_tab *tab);
 static void gronk_tab(struct mnt_tab *tab);
+static int build_index(struct mnt_tab *tab);
+static struct tab_rec* find_mpt(struct mnt_tab *tab, const char *mpt);
+static unsigned int hash_path(const char*);
 static char* skip_ws(const char*);
 static char* line(char*);
 static char* token(char*);
 
 int is_in_fstab(const char *path)
 {
-	size_t i;
 	char *real_path;
-	int exist = 0;
+	int exist;
 	
 	update_fstab();
 	
 	real_path = realpath(path, NULL);
 	if(!real_path) return 0;
 
-	for(i = 0; i < fstab.size; i++) {
-		if(!strcmp(fstab.recs[i].mpt, real_path))
-			exist = 1;
-	}
+	exist = find_mpt(&fstab, real_path) ? 1 : 0;
 	
 	free(real_path);
 	return exist;
 }
 
+int is_fstab_mount_point(const char *real_path)
+{
+	return find_mpt(&fstab, real_path) ? 1 : 0;
+}
+
 int has_fstab_entries(const char *path)
 {
 	size_t len;
@@ -94,7 +100,7 @@ int has_fstab_entries(const char *path)
 
 int get_mount_info(const char *path, char **dev, char **fs, char **opt)
 {
-	size_t i;
+	struct tab_rec *rec;
 	char *real_path;
 	int status = EINVAL;
 	
@@ -103,14 +109,12 @@ int get_mount_info(const char *path, char **dev, char **fs, char **opt)
 	real_path = realpath(path, NULL);
 	if(!real_path) return errno;
 	
-	for(i = 0; i < fstab.size; i++) {
-		if(!strcmp(fstab.recs[i].mpt, real_path)) {
-			*dev = fstab.recs[i].dev;
-			*fs = fstab.recs[i].fst;
-			*opt = fstab.recs[i].opt;
-			status = 1;
-			break;
-		}
+	rec = find_mpt(&fstab, real_path);
+	if(rec) {
+		*dev = rec->dev;
+		*fs = rec->fst;
+		*opt = rec->opt;
+		status = 1;
 	}
 	free(real_path);
 	
@@ -127,6 +131,7 @@ static void update_fstab(void)
 	} else if(st.st_mtime > fstab.mtime) {
 		gronk_tab(&fstab);
 		errv = read_tab(sz_fstab, &fstab);
+		if(!errv) errv = build_index(&fstab);
 		if(errv) stderr_msg("Error reading %s: %s\n",
 					sz_fstab, strerror(errv));
 	}
@@ -138,9 +143,69 @@ static void gronk_tab(struct mnt_tab *tab)
 		free(tab->recs);
 		free(tab->data);
 	}
+	if(tab->index) free(tab->index);
 	memset(tab, 0, sizeof(struct mnt_tab));
 }
 
+/*
+ * Builds the mount point hash index (open addressing, linear probing)
+ */
+static int build_index(struct mnt_tab *tab)
+{
+	size_t i;
+	
+	if(!tab->size) return 0;
+	
+	for(tab->index_size = 16; tab->index_size < tab->size * 2; )
+		tab->index_size *= 2;
+	
+	tab->index = calloc(tab->index_size, sizeof(size_t));
+	if(!tab->index) {
+		tab->index_size = 0;
+		return errno;
+	}
+	
+	for(i = 0; i < tab->size; i++) {
+		size_t n = hash_path(tab->recs[i].mpt) & (tab->index_size - 1);
+		
+		while(tab->index[n]) n = (n + 1) & (tab->index_size - 1);
+		tab->index[n] = i + 1;
+	}
+	return 0;
+}
+
+/*
+ * Returns the record for mount point mpt, or NULL if there is none
+ */
+static struct tab_rec* find_mpt(struct mnt_tab *tab, const char *mpt)
+{
+	size_t n;
+	
+	if(!tab->index_size) return NULL;
+	
+	n = hash_path(mpt) & (tab->index_size - 1);
+
+	while(tab->index[n]) {
+		struct tab_rec *rec = &tab->recs[tab->index[n] - 1];
+
+		if(!strcmp(rec->mpt, mpt)) return rec;
+		n = (n + 1) & (tab->index_size - 1);
+	}
+	return NULL;
+}
+
+/* FNV-1a */
+static unsigned int hash_path(const char *path)
+{
+	unsigned int h = 2166136261U;
+	
+	while(*path) {
+		h ^= (unsigned char)*path++;
+		h *= 16777619U;
+	}
+	return h;
+}
+
 static int read_tab(const char *file_name, struct mnt_tab *rtab)
 {
 	FILE *file;
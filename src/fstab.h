@@ -10,6 +10,13 @@
 /* Checks if path is a mount point in fstab */
 int is_in_fstab(const char *path);
 
+/*
+ * Same as is_in_fstab, but path must be canonical, and the table isn't
+ * checked for changes; has_fstab_entries is expected to be called before
+ * looking up entries of a directory.
+ */
+int is_fstab_mount_point(const char *real_path);
+
 /* Checks if any fstab mount points are sub-directories in path */
 int has_fstab_entries(const char *path);
 
@@ -13,6 +13,14 @@
 #include <unistd.h>
 #include <string.h>
 #include <math.h>
+#if defined(__linux__)
+#include <sys/vfs.h>
+#elif defined(__FreeBSD__) || defined(__OpenBSD__)
+#include <sys/param.h>
+#include <sys/mount.h>
+#elif defined(__NetBSD__) || defined(__sun)
+#include <sys/statvfs.h>
+#endif
 #include "path.h"
 #include "fsutil.h"
 #include "debug.h"
@@ -224,6 +232,98 @@ int path_mounted(const char *path)
 	return same;
 }
 
+/*
+ * Returns the class of the file system the file fd refers to is on
+ */
+int get_fs_class(int fd)
+{
+	#if defined(__linux__)
+	struct statfs sfs;
+
+	if(fstatfs(fd, &sfs) == -1) return FSC_LOCAL;
+
+	switch((unsigned long)sfs.f_type) {
+		case 0x6969:		/* NFS */
+		case 0x517B:		/* SMB */
+		case 0xFF534D42:	/* CIFS */
+		case 0xFE534D42:	/* SMB2 */
+		case 0x564C:		/* NCP */
+		case 0x5346414F:	/* AFS */
+		case 0x73757245:	/* Coda */
+		case 0x00C36400:	/* Ceph */
+		case 0x01021997:	/* 9P */
+		return FSC_REMOTE;
+		
+		case 0x65735546:	/* FUSE */
+		return FSC_FUSE;
+		
+		case 0x01021994:	/* tmpfs */
+		case 0x858458F6:	/* ramfs */
+		return FSC_MEMORY;
+		
+		case 0x9FA0:		/* proc */
+		case 0x62656572:	/* sysfs */
+		case 0x1CD1:		/* devpts */
+		case 0x64626720:	/* debugfs */
+		case 0x74726163:	/* tracefs */
+		case 0x73636673:	/* securityfs */
+		case 0x0027E0EB:	/* cgroup */
+		case 0x63677270:	/* cgroup2 */
+		case 0x62656570:	/* configfs */
+		case 0x6165676C:	/* pstore */
+		case 0xCAFE4A11:	/* bpf */
+		case 0xDE5E81E4:	/* efivarfs */
+		return FSC_VIRTUAL;
+	}
+	return FSC_LOCAL;
+
+	#elif defined(__FreeBSD__) || defined(__OpenBSD__) || \
+		defined(__NetBSD__) || defined(__sun)
+	/* matched by prefix, so that nfs4, fusefs.sshfs etc. are included */
+	static const struct {
+		const char *prefix;
+		int fs_class;
+	} classes[] = {
+		{ "nfs", FSC_REMOTE }, { "smbfs", FSC_REMOTE },
+		{ "cifs", FSC_REMOTE }, { "fuse", FSC_FUSE },
+		{ "puffs", FSC_FUSE }, { "tmpfs", FSC_MEMORY },
+		{ "mfs", FSC_MEMORY }, { "proc", FSC_VIRTUAL },
+		{ "linprocfs", FSC_VIRTUAL }, { "linsysfs", FSC_VIRTUAL },
+		{ "devfs", FSC_VIRTUAL }, { "fdescfs", FSC_VIRTUAL },
+		{ "kernfs", FSC_VIRTUAL }, { "ptyfs", FSC_VIRTUAL },
+		{ "ctfs", FSC_VIRTUAL }, { "objfs", FSC_VIRTUAL },
+		{ "mntfs", FSC_VIRTUAL }, { NULL, 0 }
+	};
+	const char *name;
+	int i;
+	#if defined(__sun)
+	struct statvfs sfs;
+	
+	if(fstatvfs(fd, &sfs) == -1) return FSC_LOCAL;
+	name = sfs.f_basetype;
+	#elif defined(__NetBSD__)
+	struct statvfs sfs;
+
+	if(fstatvfs(fd, &sfs) == -1) return FSC_LOCAL;
+	name = sfs.f_fstypename;
+	#else
+	struct statfs sfs;
+
+	if(fstatfs(fd, &sfs) == -1) return FSC_LOCAL;
+	name = sfs.f_fstypename;
+	#endif
+	
+	for(i = 0; classes[i].prefix; i++) {
+		if(!strncmp(name, classes[i].prefix, strlen(classes[i].prefix)))
+			return classes[i].fs_class;
+	}
+	return FSC_LOCAL;
+
+	#else
+	return FSC_LOCAL;
+	#endif
+}
+
 /*
  * Same as read(2), except it will resume reading if interrupted
  * until all requested data is read, or an error occurs.
@@ -42,6 +42,17 @@ char* get_working_dir(void);
 /* Returns 1 if path (must be fqn) appears to be mounted */
 int path_mounted(const char *path);
 
+/* File system classes (see get_fs_class) */
+#define FSC_LOCAL	0
+#define FSC_REMOTE	1	/* network file systems */
+#define FSC_FUSE	2
+#define FSC_MEMORY	3	/* tmpfs and such */
+#define FSC_VIRTUAL	4	/* proc, sysfs and such */
+#define NUM_FS_CLASSES 5
+
+/* Returns the class of the file system the file fd refers to is on */
+int get_fs_class(int fd);
+
 /* Same as read(2), except it will resume reading if interrupted
  * until all requested data is read, or an error occurs */
 ssize_t readn(int fd, void *pbuf, size_t len);
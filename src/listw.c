@@ -29,6 +29,9 @@
 #include "mbstr.h"
 #include "debug.h"
 
+/* Item compare function, as used with qsort */
+typedef int (*sort_proc_t)(const void*, const void*);
+
 /* Local routines */
 static void class_initialize(void);
 static void initialize(Widget, Widget, ArgList, Cardinal*);
@@ -49,15 +52,23 @@ static void default_render_table(Widget, int, XrmValue*);
 static void default_hspacing(Widget, int, XrmValue*);
 static void default_select_color(Widget, int, XrmValue*);
 static void free_item(struct item_rec*);
-static Boolean find_item(const struct file_list_part *fl,
+static Boolean find_item(struct file_list_part *fl,
 	const char *name, unsigned int *pindex);
+static void build_index(struct file_list_part *fl);
+static void insert_index(struct file_list_part *fl, unsigned int);
+static unsigned int hash_name(const char*);
+static void update_layout(Widget);
 static void draw_item(Widget, unsigned int index, Boolean);
 static void draw_rubber_bands(Widget);
 static void get_selection_rect(Widget, struct rectangle*);
 static Boolean make_labels(Widget, struct item_rec*);
 static void compute_item_extents(Widget, unsigned int);
 static void sort_list(Widget);
-static int compare_names(const char*, const char*);
+static Boolean merge_items(struct file_list_part*, sort_proc_t);
+static sort_proc_t get_sort_proc(struct file_list_part*);
+static Boolean sort_key_changed(struct file_list_part*,
+	const struct item_rec*, const struct item_rec*);
+static void reset_sort(struct file_list_part*);
 static int sort_by_name(const void*, const void*);
 static int sort_by_name_des(const void*, const void*);
 static int sort_by_time(const void*, const void*);
@@ -68,6 +79,7 @@ static int sort_by_suffix(const void*, const void*);
 static int sort_by_suffix_des(const void*, const void*);
 static int sort_by_size(const void*, const void*);
 static int sort_by_size_des(const void*, const void*);
+static int dir_size_cmp(const struct item_rec*, const struct item_rec*);
 static void compute_placement(Widget, Dimension, Dimension);
 static void update_sbar_range(Widget, Dimension, Dimension);
 static void update_sbar_visibility(Widget, Dimension, Dimension);
@@ -655,103 +667,160 @@ static void redraw_all(Widget w)
 }
 
 /*
- * Quick sorts the list
+ * Sorts the list. Only items added, or whose sort keys changed, since
+ * the list was last sorted are sorted here, and merged into the rest.
+ * Since these usually come in order already (the directory reader sorts
+ * them as the list would), most of the time that takes a single pass.
  */
 static void sort_list(Widget w)
 {
 	struct file_list_part *fl = FL_PART(w);
-	Boolean asc = (fl->sort_direction == XfASCEND) ? True : False;
+	sort_proc_t sort_proc = get_sort_proc(fl);
 
-	if(fl->num_items < 2) return;
+	if(fl->num_sorted == fl->num_items && !fl->num_unsorted) return;
 	
-	qsort_strcmp_fp = (fl->numbered_sort) ? compare_names : strcmp;
+	if(fl->num_sorted - fl->num_unsorted < 2 || !merge_items(fl, sort_proc)) {
+		unsigned int i;
+		
+		for(i = 1; i < fl->num_items; i++) {
+			if(sort_proc(&fl->items[i - 1], &fl->items[i]) > 0) break;
+		}
+		if(i < fl->num_items) {
+			qsort(fl->items, fl->num_items,
+				sizeof(struct item_rec), sort_proc);
+		}
+		for(i = 0; fl->num_unsorted && i < fl->num_sorted; i++) {
+			if(fl->items[i].unsorted) {
+				fl->items[i].unsorted = False;
+				fl->num_unsorted--;
+			}
+		}
+	}
+	fl->num_sorted = fl->num_items;
+	fl->num_unsorted = 0;
+	fl->index_valid = False;
+}
 
-	switch(fl->sort_order) {
-		case XfNAME:
-		qsort(fl->items, fl->num_items,
-			sizeof(struct item_rec),
-			asc ? sort_by_name : sort_by_name_des);
-		break;
+/*
+ * Merges items past num_sorted, and those flagged unsorted, into the
+ * sorted range. Returns False if there's not enough memory to do that.
+ */
+static Boolean merge_items(struct file_list_part *fl, sort_proc_t sort_proc)
+{
+	unsigned int nrun = fl->num_items - fl->num_sorted;
+	unsigned int nmerge = nrun + fl->num_unsorted;
+	unsigned int i, j, n, dest, last;
+	struct item_rec *run;
+	
+	run = malloc(sizeof(struct item_rec) * nmerge);
+	if(!run) return False;
+	
+	/* take unsorted items out of the sorted range, which stays in order */
+	for(i = 0, last = 0, j = 0; i < fl->num_sorted; i++) {
+		if(fl->items[i].unsorted) {
+			memcpy(&run[j], &fl->items[i], sizeof(struct item_rec));
+			run[j++].unsorted = False;
+		} else {
+			if(last != i) {
+				memcpy(&fl->items[last], &fl->items[i],
+					sizeof(struct item_rec));
+			}
+			last++;
+		}
+	}
+	memcpy(&run[j], &fl->items[fl->num_sorted],
+		sizeof(struct item_rec) * nrun);
+	
+	for(i = 1; i < nmerge; i++) {
+		if(sort_proc(&run[i - 1], &run[i]) > 0) break;
+	}
+	if(i < nmerge) qsort(run, nmerge, sizeof(struct item_rec), sort_proc);
+
+	/* merge from the back, looking up where each run item goes */
+	dest = fl->num_items;
+	for(j = nmerge; j > 0; j--) {
+		struct item_rec *r = &run[j - 1];
+		unsigned int lo = 0, hi = last;
 		
+		while(lo < hi) {
+			unsigned int mid = lo + (hi - lo) / 2;
+
+			if(sort_proc(&fl->items[mid], r) > 0)
+				hi = mid;
+			else
+				lo = mid + 1;
+		}
+		n = last - lo;
+		if(n) {
+			dest -= n;
+			memmove(&fl->items[dest], &fl->items[lo],
+				sizeof(struct item_rec) * n);
+		}
+		last = lo;
+		memcpy(&fl->items[--dest], r, sizeof(struct item_rec));
+	}
+	free(run);
+	
+	return True;
+}
+
+/*
+ * Returns the compare function for current sort order and direction
+ */
+static sort_proc_t get_sort_proc(struct file_list_part *fl)
+{
+	Boolean asc = (fl->sort_direction == XfASCEND) ? True : False;
+
+	qsort_strcmp_fp = (fl->numbered_sort) ? mbs_numcmp : strcmp;
+
+	switch(fl->sort_order) {
 		case XfTIME:
-		qsort(fl->items, fl->num_items,
-			sizeof(struct item_rec),
-			asc ? sort_by_time : sort_by_time_des);
-		break;
+		return asc ? sort_by_time : sort_by_time_des;
 		
 		case XfSUFFIX:
-		qsort(fl->items, fl->num_items,
-			sizeof(struct item_rec),
-			asc ? sort_by_suffix : sort_by_suffix_des);
-		break;
+		return asc ? sort_by_suffix : sort_by_suffix_des;
 		
 		case XfTYPE:
-		qsort(fl->items, fl->num_items,
-			sizeof(struct item_rec),
-			asc ? sort_by_type : sort_by_type_des);
-		break;
+		return asc ? sort_by_type : sort_by_type_des;
 
 		case XfSIZE:
-		qsort(fl->items, fl->num_items,
-			sizeof(struct item_rec),
-			asc ? sort_by_size : sort_by_size_des);
-		break;
-	};
+		return asc ? sort_by_size : sort_by_size_des;
+	}
+	return asc ? sort_by_name : sort_by_name_des;
 }
 
 /*
- * This is like strcmp, except it will compare
- * coinciding strings of digits numerically
+ * Returns True if replacing item a with b may change its place in the list
  */
-static int compare_names(const char *a, const char *b)
-{
-	int res = 0;
-
-	while(*a && *b) {
-		if(isdigit((int)*a) && isdigit((int)*b)) {
-			const char *sp_a = a;
-			const char *sp_b = b;
-			unsigned int ai = 0;
-			unsigned int bi = 0;
-			unsigned int fa = 1;
-			const char *p;
-
-			while(*sp_a && isdigit((int)*sp_a)) sp_a++;
-			while(*sp_b && isdigit((int)*sp_b)) sp_b++;
-
-			p = sp_a;
-
-			do {
-				p--;
-				ai += (*p - '0') * fa;
-				fa *= 10;
-			} while(p != a);
-
-			p = sp_b;
-			fa = 1;
-
-			do {
-				p--;
-				bi += (*p - '0') * fa;
-				fa *= 10;
-			} while(p != b);
-			
-			res = (ai - bi);
-			if(res)	return res;
-			
-			a = sp_a;
-			b = sp_b;
-		} else {
-			res = *a - *b;
-			if(res) return res;
-			
-			a++; b++;
-		}
-	}
+static Boolean sort_key_changed(struct file_list_part *fl,
+	const struct item_rec *a, const struct item_rec *b)
+{
+	if(S_ISDIR(a->mode) != S_ISDIR(b->mode)) return True;
 	
-	if(*a) res = 1; else if(*b) res = -1; else res = 0;
+	switch(fl->sort_order) {
+		case XfTIME: return (a->mtime != b->mtime);
+		case XfTYPE: return (a->db_type != b->db_type);
+		case XfSIZE: return (a->size != b->size ||
+			a->dir_size != b->dir_size || a->dir_count != b->dir_count);
+	}
+	return False;
+}
 
-	return res;
+/*
+ * Marks the whole list as to be sorted
+ */
+static void reset_sort(struct file_list_part *fl)
+{
+	unsigned int i;
+
+	for(i = 0; fl->num_unsorted && i < fl->num_sorted; i++) {
+		if(fl->items[i].unsorted) {
+			fl->items[i].unsorted = False;
+			fl->num_unsorted--;
+		}
+	}
+	fl->num_sorted = 0;
+	fl->num_unsorted = 0;
 }
 
 /*
@@ -872,6 +941,7 @@ static int sort_by_size_des(const void *aptr, const void *bptr)
 	const struct item_rec *a = (struct item_rec*)aptr;
 	const struct item_rec *b = (struct item_rec*)bptr;
 	r = S_ISDIR(b->mode) - S_ISDIR(a->mode);
+	if(!r && S_ISDIR(a->mode)) r = dir_size_cmp(b, a);
 	if(!r) r = (b->size - a->size);
 	if(!r) r = sort_by_name_des(aptr, bptr);
 
@@ -884,12 +954,25 @@ static int sort_by_size(const void *aptr, const void *bptr)
 	const struct item_rec *a = (struct item_rec*)aptr;
 	const struct item_rec *b = (struct item_rec*)bptr;
 	r = S_ISDIR(b->mode) - S_ISDIR(a->mode);
+	if(!r && S_ISDIR(a->mode)) r = dir_size_cmp(a, b);
 	if(!r) r = (a->size - b->size);
 	if(!r) r = sort_by_name(aptr, bptr);
 
 	return r;
 }
 
+/*
+ * Compares directories by total size, and entry count, where known
+ */
+static int dir_size_cmp(const struct item_rec *a, const struct item_rec *b)
+{
+	if(a->dir_size != b->dir_size)
+		return (a->dir_size < b->dir_size) ? -1 : 1;
+	if(a->dir_count != b->dir_count)
+		return (a->dir_count < b->dir_count) ? -1 : 1;
+	return 0;
+}
+
 /*
  * Frees all fields in an item_rec struct
  */
@@ -908,11 +991,31 @@ static void free_item(struct item_rec *in)
 /*
  * Retrieves item index from name. Returns True if found.
  */
-static Boolean find_item(const struct file_list_part *fl,
+static Boolean find_item(struct file_list_part *fl,
 	const char *name, unsigned int *pindex)
 {
 	unsigned int i;
 	
+	if(!fl->num_items) return False;
+	
+	if(!fl->index_valid) build_index(fl);
+	
+	if(fl->index_valid) {
+		i = hash_name(name) & (fl->index_size - 1);
+		
+		while(fl->index[i]) {
+			unsigned int n = fl->index[i] - 1;
+			
+			if(!strcmp(fl->items[n].name, name)) {
+				*pindex = n;
+				return True;
+			}
+			i = (i + 1) & (fl->index_size - 1);
+		}
+		return False;
+	}
+	
+	/* no index, due to lack of memory */
 	for(i = 0; i < fl->num_items; i++) {
 		if(!strcmp(fl->items[i].name, name)) {
 			*pindex = i;
@@ -922,6 +1025,56 @@ static Boolean find_item(const struct file_list_part *fl,
 	return False;
 }
 
+/*
+ * (Re)builds the name index. Since items move around when sorted and
+ * removed, it's invalidated then, and rebuilt on next lookup.
+ */
+static void build_index(struct file_list_part *fl)
+{
+	unsigned int size = INDEX_SIZE_MIN;
+	unsigned int i;
+	
+	/* keep the load factor at or below 1/2 */
+	while(size < fl->num_items * 2) size <<= 1;
+	
+	if(size != fl->index_size) {
+		if(fl->index) free(fl->index);
+		fl->index = malloc(sizeof(unsigned int) * size);
+		if(!fl->index) {
+			fl->index_size = 0;
+			fl->index_valid = False;
+			return;
+		}
+		fl->index_size = size;
+	}
+	memset(fl->index, 0, sizeof(unsigned int) * size);
+	
+	for(i = 0; i < fl->num_items; i++)
+		insert_index(fl, i);
+
+	fl->index_valid = True;
+}
+
+static void insert_index(struct file_list_part *fl, unsigned int n)
+{
+	unsigned int i = hash_name(fl->items[n].name) & (fl->index_size - 1);
+
+	while(fl->index[i]) i = (i + 1) & (fl->index_size - 1);
+	fl->index[i] = n + 1;
+}
+
+/* FNV-1a */
+static unsigned int hash_name(const char *name)
+{
+	unsigned int h = 2166136261U;
+	
+	while(*name) {
+		h ^= (unsigned char)*name++;
+		h *= 16777619U;
+	}
+	return h;
+}
+
 /*
  * Computes dimensions (width, height and lalbel offset) for the given item
  */
@@ -947,6 +1100,75 @@ static void compute_item_extents(Widget w, unsigned int index)
 	if(height > fl->item_height_max) fl->item_height_max = height;
 }
 
+/*
+ * Sorts the list (unless deferred), recomputes layout and redraws
+ * if contents are shown. Postponed while layout is deferred.
+ * The cursor stays on the same item, and so does the view if it's
+ * scrolled, when items are sorted in ahead of these.
+ */
+static void update_layout(Widget w)
+{
+	struct file_list_part *fl = FL_PART(w);
+	Dimension view_width, view_height;
+	Boolean anchored = False;
+	unsigned int top = 0;
+	int top_off = 0;
+
+	if(!fl->show_contents) return;
+	
+	if(fl->defer_layout) {
+		fl->layout_pending = True;
+		return;
+	}
+	
+	get_view_dimensions(w, True, &view_width, &view_height);
+	
+	if(!fl->defer_sort && fl->num_items > 1) {
+		const char *cursor_name = NULL;
+		const char *top_name = NULL;
+		unsigned int i, end;
+
+		/* name pointers identify items, since sorting only moves them */
+		if(fl->cursor < fl->num_items)
+			cursor_name = fl->items[fl->cursor].name;
+		
+		if(fl->yoff) {
+			get_visible_range(w, &top, &end);
+			if(top < fl->num_items) {
+				top_name = fl->items[top].name;
+				top_off = (int)fl->items[top].y - (int)fl->yoff;
+			}
+		}
+
+		sort_list(w);
+		
+		for(i = 0; i < fl->num_items && (cursor_name || top_name); i++) {
+			if(fl->items[i].name == cursor_name) {
+				fl->cursor = i;
+				fl->ext_position = i;
+				cursor_name = NULL;
+			}
+			if(fl->items[i].name == top_name) {
+				top = i;
+				top_name = NULL;
+				anchored = True;
+			}
+		}
+	}
+	compute_placement(w, view_width, view_height);
+	
+	if(anchored) {
+		/* update_sbar_range clamps this to list height */
+		int v = (int)fl->items[top].y - top_off;
+		fl->yoff = (v > 0) ? v : 0;
+	}
+	update_sbar_visibility(w, view_width, view_height);
+	get_view_dimensions(w, False, &view_width, &view_height);
+	update_sbar_range(w, view_width, view_height);
+	redraw_all(w);
+	fl->layout_pending = False;
+}
+
 /*
  * Computes item placement information
  */
@@ -1266,7 +1488,18 @@ static Boolean make_labels(Widget w, struct item_rec *irec)
 	field_widths[FL_FLABEL] = XmStringWidth(fl->label_rt, xms);
 	irec->label[FL_FLABEL] = xms;
 
-	get_size_string(irec->size, sz_tmp);
+	/* partial items have no attributes to show yet; directories
+	 * are shown with their total size, or entry count, if known */
+	if(irec->partial) {
+		sz_tmp[0] = '\0';
+	} else if(S_ISDIR(irec->mode) && irec->dir_size != -1) {
+		get_size_string(irec->dir_size, sz_tmp);
+	} else if(S_ISDIR(irec->mode) && irec->dir_count != -1) {
+		snprintf(sz_tmp, TMP_BUFSIZ, (irec->dir_count == 1) ?
+			"%ld item" : "%ld items", irec->dir_count);
+	} else {
+		get_size_string(irec->size, sz_tmp);
+	}
 	xms = XmStringGenerate(sz_tmp, NULL, XmCHARSET_TEXT, rend_tag);
 	if(!xms) {
 		XmStringFree(irec->label[FL_FLABEL]);
@@ -1276,10 +1509,12 @@ static Boolean make_labels(Widget w, struct item_rec *irec)
 	irec->label[FL_FSIZE] = xms;
 	
 	/* User/Group part */
-	gr = getgrgid(irec->gid);
-	pw = getpwuid(irec->uid);
+	gr = irec->partial ? NULL : getgrgid(irec->gid);
+	pw = irec->partial ? NULL : getpwuid(irec->uid);
 	
-	if(gr && pw) {
+	if(irec->partial) {
+		psz_tmp = strdup("");
+	} else if(gr && pw) {
 		len = strlen(gr->gr_name) + strlen(pw->pw_name);
 		psz_tmp = malloc(len + 3);
 		sprintf(psz_tmp, "%s:%s", pw->pw_name, gr->gr_name);
@@ -1301,7 +1536,10 @@ static Boolean make_labels(Widget w, struct item_rec *irec)
 	irec->label[FL_FOWNER] = xms;
 
 	/* Mode part */
-	get_mode_string(irec->mode, sz_tmp);
+	if(irec->partial)
+		sz_tmp[0] = '\0';
+	else
+		get_mode_string(irec->mode, sz_tmp);
 
 	xms = XmStringGenerate(sz_tmp, NULL, XmCHARSET_TEXT, rend_tag);
 
@@ -1316,8 +1554,12 @@ static Boolean make_labels(Widget w, struct item_rec *irec)
 	irec->label[FL_FMODE] = xms;
 
 	/* Time part */
-	localtime_r(&irec->mtime, &tm_file);
-	strftime(sz_time, TIME_BUFSIZ, TIME_FMT, &tm_file);
+	if(irec->partial) {
+		sz_time[0] = '\0';
+	} else {
+		localtime_r(&irec->mtime, &tm_file);
+		strftime(sz_time, TIME_BUFSIZ, TIME_FMT, &tm_file);
+	}
 	
 	xms = XmStringGenerate(sz_time, NULL, XmCHARSET_TEXT, rend_tag);
 
@@ -1800,6 +2042,14 @@ static void initialize(Widget wreq, Widget wnew,
 	fl->file_list.autoscrl_vec = 0;
 	fl->file_list.lookup_timeout = None;
 	fl->file_list.show_contents = False;
+	fl->file_list.index = NULL;
+	fl->file_list.index_size = 0;
+	fl->file_list.index_valid = False;
+	fl->file_list.num_sorted = 0;
+	fl->file_list.num_unsorted = 0;
+	fl->file_list.defer_sort = False;
+	fl->file_list.defer_layout = False;
+	fl->file_list.layout_pending = False;
 	fl->file_list.sz_lookup[0] = '\0';
 	fl->file_list.dragging = False;
 	fl->file_list.in_sb_update = False;
@@ -1956,6 +2206,7 @@ static Boolean set_values(Widget wcur, Widget wreq,
 
 	if(cur->file_list.sort_direction != set->file_list.sort_direction ||
 		cur->file_list.sort_order != set->file_list.sort_order) {
+		reset_sort(&set->file_list);
 		sort_list(wset);
 	}
 
@@ -2004,6 +2255,8 @@ static void destroy(Widget w)
 	}
 	fl->num_items = 0;
 	
+	if(fl->index) free(fl->index);
+	
 	if(fl->cur_sel.names) free(fl->cur_sel.names);
 	fl->cur_sel.count = 0;
 
@@ -2660,6 +2913,7 @@ static void default_action_handler(Widget w, unsigned int mod_mask)
 		fl->cur_sel.item.ctime = fl->items[i].ctime;
 		fl->cur_sel.item.mtime = fl->items[i].mtime;
 		fl->cur_sel.item.is_symlink = fl->items[i].is_symlink;
+		fl->cur_sel.item.partial = fl->items[i].partial;
 		fl->cur_sel.item.icon = fl->items[i].icon_image;
 		fl->cur_sel.item.icon_mask = fl->items[i].icon_mask;
 		fl->cur_sel.item.user_flags = fl->items[i].user_flags;
@@ -2763,6 +3017,7 @@ static void sel_change_handler(Widget w, Boolean initial)
 			fl->cur_sel.item.ctime = fl->items[i].ctime;
 			fl->cur_sel.item.mtime = fl->items[i].mtime;
 			fl->cur_sel.item.is_symlink = fl->items[i].is_symlink;
+			fl->cur_sel.item.partial = fl->items[i].partial;
 			fl->cur_sel.item.icon = fl->items[i].icon_image;
 			fl->cur_sel.item.icon_mask = fl->items[i].icon_mask;
 			fl->cur_sel.item.user_flags = fl->items[i].user_flags;
@@ -2851,6 +3106,51 @@ static void visibility_change_cb(Widget w,
 }
 
 
+int file_list_set_dir_size(Widget w, const char *name, long count, off_t size)
+{
+	struct file_list_part *fl = FL_PART(w);
+	Dimension width_max = fl->item_width_max[XfDETAILED];
+	struct item_rec tmp;
+	unsigned int i;
+	int j;
+
+	if(!find_item(fl, name, &i)) return ENOENT;
+	if(!S_ISDIR(fl->items[i].mode) || fl->items[i].partial) return EINVAL;
+	if(fl->items[i].dir_count == count && fl->items[i].dir_size == size)
+		return 0;
+
+	memcpy(&tmp, &fl->items[i], sizeof(struct item_rec));
+	tmp.dir_count = count;
+	tmp.dir_size = size;
+	if(!make_labels(w, &tmp)) return ENOMEM;
+
+	for(j = 0; j < NFIELDS; j++)
+		XmStringFree(fl->items[i].label[j]);
+
+	/* moved into place next time the list is sorted */
+	if(i < fl->num_sorted && !tmp.unsorted &&
+		sort_key_changed(fl, &fl->items[i], &tmp)) {
+		tmp.unsorted = True;
+		fl->num_unsorted++;
+	}
+	memcpy(&fl->items[i], &tmp, sizeof(struct item_rec));
+
+	/* only the item needs redrawing, unless it moves or the size
+	 * field got wider */
+	if(tmp.unsorted || fl->item_width_max[XfDETAILED] != width_max) {
+		update_layout(w);
+	} else if(fl->show_contents && !fl->defer_layout && XtIsRealized(w)) {
+		draw_item(w, i, True);
+	}
+
+	return 0;
+}
+
+void file_list_get_visible(Widget w, unsigned int *first, unsigned int *end)
+{
+	get_visible_range(w, first, end);
+}
+
 /*
  * Switches selection highlighting, redraws selected items
  */
@@ -2944,7 +3244,17 @@ int file_list_add(Widget w,
 	tmp.icon_image = its->icon;
 	tmp.icon_mask = its->icon_mask;
 	tmp.is_symlink = its->is_symlink;
+	tmp.partial = its->partial;
 	tmp.selected = selected;
+	tmp.dir_count = -1;
+	tmp.dir_size = -1;
+	
+	/* directory sizes stay valid as long as the directory is unchanged */
+	if(exists && !its->partial && S_ISDIR(its->mode) &&
+		S_ISDIR(fl->items[i].mode) && fl->items[i].mtime == its->mtime) {
+		tmp.dir_count = fl->items[i].dir_count;
+		tmp.dir_size = fl->items[i].dir_size;
+	}
 	
 	/* cache icon dimensions */
 	if(its->icon != None) {
@@ -2967,27 +3277,35 @@ int file_list_add(Widget w,
 	}
 
 	/* finally, merge temporary struct into the array */
-	if(replace)
+	if(replace) {
+		tmp.x = fl->items[i].x;
+		tmp.y = fl->items[i].y;
+		tmp.unsorted = fl->items[i].unsorted;
+
+		/* moved into place next time the list is sorted */
+		if(i < fl->num_sorted && !tmp.unsorted &&
+			sort_key_changed(fl, &fl->items[i], &tmp)) {
+			tmp.unsorted = True;
+			fl->num_unsorted++;
+		}
 		free_item(&fl->items[i]);
-	else
+		memcpy(&fl->items[i], &tmp, sizeof(struct item_rec));
+	} else {
+		memcpy(&fl->items[i], &tmp, sizeof(struct item_rec));
 		fl->num_items++;
 
-	memcpy(&fl->items[i], &tmp, sizeof(struct item_rec));
+		if(fl->index_valid) {
+			if(fl->num_items * 2 > fl->index_size)
+				build_index(fl);
+			else
+				insert_index(fl, i);
+		}
+	}
 
 	/* recompute layout and redraw if contents are shown */
 	compute_item_extents(w, i);
+	update_layout(w);
 	
-	if(fl->show_contents) {
-		Dimension view_width, view_height;
-		
-		get_view_dimensions(w, True, &view_width, &view_height);
-		sort_list(w);
-		compute_placement(w, view_width, view_height);
-		update_sbar_visibility(w, view_width, view_height);
-		get_view_dimensions(w, False, &view_width, &view_height);
-		update_sbar_range(w, view_width, view_height);
-		redraw_all(w);
-	}
 	if(selected) sel_change_handler(w, False);
 
 	return 0;
@@ -3003,6 +3321,11 @@ int file_list_remove(Widget w, const char *name)
 	
 	selected = fl->items[i].selected;
 	
+	if(i < fl->num_sorted) {
+		fl->num_sorted--;
+		if(fl->items[i].unsorted) fl->num_unsorted--;
+	}
+	
 	free_item(&fl->items[i]);
 	
 	if(fl->num_items > 1) {
@@ -3011,6 +3334,7 @@ int file_list_remove(Widget w, const char *name)
 	}
 	
 	fl->num_items--;
+	fl->index_valid = False;
 	
 	fl->item_width_max[XfCOMPACT] = 0;
 	fl->item_width_max[XfDETAILED] = 0;
@@ -3046,17 +3370,8 @@ int file_list_remove(Widget w, const char *name)
 	}
 	
 	/* recompute layout and redraw if contents are shown */
-	if(fl->show_contents) {
-		Dimension view_width, view_height;
-		
-		get_view_dimensions(w, True, &view_width, &view_height);
-		sort_list(w);
-		compute_placement(w, view_width, view_height);
-		update_sbar_visibility(w, view_width, view_height);
-		get_view_dimensions(w, False, &view_width, &view_height);
-		update_sbar_range(w, view_width, view_height);
-		redraw_all(w);
-	}
+	update_layout(w);
+
 	if(selected) sel_change_handler(w, False);	
 
 	return 0;
@@ -3187,16 +3502,39 @@ void file_list_show_contents(Widget w, Boolean show)
 	}
 
 	fl->show_contents = show;	
+	fl->layout_pending = False;
 	update_sbar_visibility(w, CORE_WIDTH(w), CORE_HEIGHT(w));
 	update_sbar_range(w, CORE_WIDTH(w), CORE_HEIGHT(w));
 	redraw_all(w);
 }
 
+void file_list_defer_layout(Widget w, Boolean defer)
+{
+	struct file_list_part *fl = FL_PART(w);
+
+	fl->defer_layout = defer;
+	if(!defer && fl->layout_pending) update_layout(w);
+}
+
+void file_list_defer_sort(Widget w, Boolean defer)
+{
+	struct file_list_part *fl = FL_PART(w);
+	
+	if(fl->defer_sort == defer) return;
+
+	fl->defer_sort = defer;
+	if(!defer) update_layout(w);
+}
+
 void file_list_remove_all(Widget w)
 {
 	struct file_list_part *fl = FL_PART(w);
 
 	fl->num_items = 0;
+	fl->index_valid = False;
+	fl->num_sorted = 0;
+	fl->num_unsorted = 0;
+	fl->layout_pending = False;
 	fl->cursor = 0;
 	fl->ext_position = 0;
 	fl->icon_width_max = 0;
@@ -3233,6 +3571,7 @@ struct file_list_selection* file_list_get_selection(Widget w)
 		fl->cur_sel.item.ctime = fl->items[i].ctime;
 		fl->cur_sel.item.mtime = fl->items[i].mtime;
 		fl->cur_sel.item.is_symlink = fl->items[i].is_symlink;
+		fl->cur_sel.item.partial = fl->items[i].partial;
 		fl->cur_sel.item.icon = fl->items[i].icon_image;
 		fl->cur_sel.item.icon_mask = fl->items[i].icon_mask;
 		fl->cur_sel.item.user_flags = fl->items[i].user_flags;
@@ -3249,3 +3588,144 @@ unsigned int file_list_count(Widget w)
 	struct file_list_part *fl = FL_PART(w);
 	return fl->num_items;
 }
+
+Boolean file_list_get_item_at(Widget w, unsigned int index,
+	struct file_list_item *ret)
+{
+	struct file_list_part *fl = FL_PART(w);
+	struct item_rec *r;
+
+	if(index >= fl->num_items) return False;
+	
+	r = &fl->items[index];
+	ret->name = r->name;
+	ret->title = r->title;
+	ret->db_type = r->db_type;
+	ret->size = r->size;
+	ret->mode = r->mode;
+	ret->uid = r->uid;
+	ret->gid = r->gid;
+	ret->ctime = r->ctime;
+	ret->mtime = r->mtime;
+	ret->is_symlink = r->is_symlink;
+	ret->partial = r->partial;
+	ret->icon = r->icon_image;
+	ret->icon_mask = r->icon_mask;
+	ret->user_flags = r->user_flags;
+
+	return True;
+}
+
+Boolean file_list_get_item_at_xy(Widget w, int x, int y,
+	struct file_list_item *ret)
+{
+	struct file_list_part *fl = FL_PART(w);
+	unsigned int i, end;
+
+	if(!fl->show_contents) return False;
+	
+	/* only visible items can be under the pointer */
+	get_visible_range(w, &i, &end);
+	
+	for( ; i < end && i < fl->num_items; i++) {
+		if(hit_test(w, x + fl->xoff, y + fl->yoff, i, NULL))
+			return file_list_get_item_at(w, i, ret);
+	}
+	return False;
+}
+
+struct file_list_snapshot* file_list_detach_items(Widget w)
+{
+	struct file_list_part *fl = FL_PART(w);
+	struct file_list_snapshot *snap;
+	unsigned int i;
+	
+	if(!fl->num_items) return NULL;
+
+	snap = malloc(sizeof(struct file_list_snapshot));
+	if(!snap) return NULL;
+	
+	snap->items = fl->items;
+	snap->items_size = fl->items_size;
+	snap->num_items = fl->num_items;
+	snap->size = sizeof(struct file_list_snapshot) +
+		sizeof(struct item_rec) * fl->items_size;
+	
+	for(i = 0; i < snap->num_items; i++) {
+		struct item_rec *r = &snap->items[i];
+
+		r->selected = False;
+		snap->size += strlen(r->name) + 1 + LABEL_SIZE_EST * NFIELDS;
+		if(r->title) snap->size += strlen(r->title) + 1;
+		if(r->tr_name != r->name) snap->size += strlen(r->tr_name) + 1;
+	}
+	
+	fl->items = NULL;
+	fl->items_size = 0;
+	file_list_remove_all(w);
+
+	return snap;
+}
+
+void file_list_attach_items(Widget w, struct file_list_snapshot *snap)
+{
+	struct file_list_part *fl = FL_PART(w);
+	unsigned int i;
+	int j;
+	
+	file_list_remove_all(w);
+	if(fl->items) free(fl->items);
+	
+	fl->items = snap->items;
+	fl->items_size = snap->items_size;
+	fl->num_items = snap->num_items;
+	free(snap);
+	
+	/* recompute maximums; labels are the same as before */
+	for(i = 0; i < fl->num_items; i++) {
+		struct item_rec *r = &fl->items[i];
+		
+		/* the order is checked when sorted next */
+		r->unsorted = False;
+
+		if(fl->icon_width_max < r->icon_width)
+			fl->icon_width_max = r->icon_width;
+		if(fl->icon_height_max < r->icon_height)
+			fl->icon_height_max = r->icon_height;
+		
+		for(j = 0; j < NFIELDS; j++) {
+			if(r->field_widths[j] > fl->field_widths[j])
+				fl->field_widths[j] = r->field_widths[j];
+		}
+	}
+
+	fl->item_width_max[XfDETAILED] = fl->icon_width_max +
+		fl->label_margin + fl->label_spacing * (NFIELDS - 1);
+	for(j = 0; j < NFIELDS; j++)
+		fl->item_width_max[XfDETAILED] += fl->field_widths[j];
+	
+	/* twice, since label offsets depend on the maximum height */
+	for(i = 0; i < fl->num_items * 2; i++) {
+		fl->items[i % fl->num_items].detail_width =
+			fl->item_width_max[XfDETAILED];
+		compute_item_extents(w, i % fl->num_items);
+	}
+
+	update_layout(w);
+}
+
+void file_list_free_snapshot(struct file_list_snapshot *snap)
+{
+	unsigned int i;
+	
+	for(i = 0; i < snap->num_items; i++)
+		free_item(&snap->items[i]);
+
+	free(snap->items);
+	free(snap);
+}
+
+size_t file_list_snapshot_size(const struct file_list_snapshot *snap)
+{
+	return snap->size;
+}
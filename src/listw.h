@@ -25,6 +25,7 @@ struct file_list_item {
 	time_t ctime;
 	time_t mtime;
 	Boolean is_symlink;
+	Boolean partial; /* only name and file type are known yet */
 	Pixmap icon;
 	Pixmap icon_mask;
 	unsigned int user_flags;	
@@ -172,6 +173,19 @@ struct file_list_selection* file_list_get_selection(Widget);
 void file_list_show_contents(Widget, Boolean show);
 
 
+/*
+ * Defers layout and redrawing while items are added, replaced or removed,
+ * until called again with defer set to False. Useful for batch updates.
+ */
+void file_list_defer_layout(Widget, Boolean defer);
+
+/*
+ * While deferred, items added or replaced aren't sorted into the list
+ * and replaced items keep their place; the list is sorted once when
+ * called again with defer set to False.
+ */
+void file_list_defer_sort(Widget, Boolean defer);
+
 /*
  * Retrieves file_list_item struct for the item name specified.
  * Returns True on success.
@@ -184,6 +198,59 @@ Boolean file_list_get_item(Widget, const char *name,
  */
 void file_list_remove_all(Widget);
 
+/*
+ * Retrieves file_list_item struct for the item at index.
+ * Returns True on success.
+ */
+Boolean file_list_get_item_at(Widget, unsigned int index,
+	struct file_list_item *ret);
+
+/*
+ * Retrieves file_list_item struct for the item at x, y (window
+ * coordinates). Returns False if there's no item there.
+ */
+Boolean file_list_get_item_at_xy(Widget, int x, int y,
+	struct file_list_item *ret);
+
+/* Opaque list contents snapshot */
+struct file_list_snapshot;
+
+/*
+ * Detaches all items, leaving the list empty, and returns these as a
+ * snapshot that may be attached later on. Returns NULL if there are no
+ * items or memory is low. Selection state is not preserved.
+ */
+struct file_list_snapshot* file_list_detach_items(Widget);
+
+/*
+ * Replaces list contents with items from the snapshot, which is consumed.
+ * The snapshot must have been detached from the same widget.
+ */
+void file_list_attach_items(Widget, struct file_list_snapshot*);
+
+/*
+ * Frees a snapshot that won't be attached
+ */
+void file_list_free_snapshot(struct file_list_snapshot*);
+
+/*
+ * Returns the approximate amount of memory used by a snapshot in bytes
+ */
+size_t file_list_snapshot_size(const struct file_list_snapshot*);
+
+/*
+ * Sets the number of entries in, and the total size of files in the named
+ * directory item (-1 if not known), which are shown instead of its size.
+ * The list is only resorted if it's sorted by size.
+ * Returns zero on success, errno otherwise.
+ */
+int file_list_set_dir_size(Widget, const char *name, long count, off_t size);
+
+/*
+ * Retrieves the range of item indices [*first, *end) in the viewing area
+ */
+void file_list_get_visible(Widget, unsigned int *first, unsigned int *end);
+
 /*
  * Changes selection highlighting state to convey whether
  * primary selection is owned (True) or lost (False)
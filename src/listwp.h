@@ -23,6 +23,9 @@
 /* Number of items to grow list storage by */
 #define LIST_GROW_BY	64
 
+/* Minimum size of the name index (must be a power of two) */
+#define INDEX_SIZE_MIN	256
+
 /* Max number of chars for incremental search and how much time
  * passes between key presses until we reset */
 #define LOOKUP_STR_MAX 64
@@ -90,7 +93,11 @@ struct item_rec {
 	time_t ctime;
 	time_t mtime;
 	unsigned long size;
+	long dir_count; /* entries in a directory, -1 if not known */
+	off_t dir_size; /* total size of files in it, -1 if not known */
 	Boolean is_symlink;
+	Boolean partial;
+	Boolean unsorted; /* sort key changed since last sorted */
 	
 	Pixmap icon_image;
 	Pixmap icon_mask;
@@ -106,6 +113,17 @@ struct item_rec {
 	unsigned short icon_height;
 };
 
+/* Detached list contents */
+struct file_list_snapshot {
+	struct item_rec *items;
+	unsigned int items_size;
+	unsigned int num_items;
+	size_t size;
+};
+
+/* Rough per-label memory usage estimate for snapshots */
+#define LABEL_SIZE_EST 48
+
 /* Used for rubber-banding */
 struct rectangle {
 	int x;
@@ -147,6 +165,21 @@ struct file_list_part {
 	unsigned int items_size; /* items array size in item_rec units */
 	unsigned int num_items; /* number of items containing data */
 	
+	/* name index, open addressing hash table of item index + 1 */
+	unsigned int *index;
+	unsigned int index_size;
+	Boolean index_valid;
+	
+	/* items [0, num_sorted) are in order, except for num_unsorted
+	 * of these flagged unsorted; the rest are merged in when sorted */
+	unsigned int num_sorted;
+	unsigned int num_unsorted;
+	
+	/* deferred sorting and layout state */
+	Boolean defer_sort;
+	Boolean defer_layout;
+	Boolean layout_pending;
+	
 	/* list and item dimensions */
 	unsigned int xoff;
 	unsigned int yoff;
@@ -0,0 +1,246 @@
+/*
+ * Copyright (C) 2026 alx@fastestcode.org
+ * This software is distributed under the terms of the X/MIT license.
+ * See the included COPYING file for further information.
+ */
+
+/*
+ * Symbolic link target cache
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "lnkcache.h"
+#include "debug.h"
+
+/* Initial number of slots (must be a power of two) */
+#define LC_INIT_SIZE 256
+
+/* The cache is emptied rather than grown beyond this many entries */
+#ifndef LC_MAX_ENTS
+#define LC_MAX_ENTS 16384
+#endif
+
+/* Local prototypes */
+static struct link_ent* find_ent(struct link_cache*, const struct link_id*);
+static int grow(struct link_cache*);
+static void clear(struct link_cache*);
+static int is_clean(const char*);
+static int is_canonical_dir(struct link_cache*, char *path, size_t len);
+static size_t hash_id(dev_t, ino_t);
+
+int lcache_init(struct link_cache *lc)
+{
+	memset(lc, 0, sizeof(struct link_cache));
+
+	lc->ents = calloc(LC_INIT_SIZE, sizeof(struct link_ent));
+	if(!lc->ents) return errno;
+	lc->size = LC_INIT_SIZE;
+
+	if(dtab_init(&lc->canon)) {
+		free(lc->ents);
+		lc->ents = NULL;
+		return ENOMEM;
+	}
+	return 0;
+}
+
+void lcache_free(struct link_cache *lc)
+{
+	if(lc->ents) {
+		clear(lc);
+		free(lc->ents);
+	}
+	dtab_free(&lc->canon);
+	memset(lc, 0, sizeof(struct link_cache));
+}
+
+void lcache_forget_dirs(struct link_cache *lc)
+{
+	dtab_clear(&lc->canon);
+}
+
+const char* lcache_resolve(struct link_cache *lc, int dfd, const char *path,
+	const char *name, const struct link_id *id, const struct stat *st)
+{
+	struct link_ent *ent;
+	struct stat tst;
+	char target[PATH_MAX];
+	char buf[PATH_MAX];
+	char *real_path = NULL;
+	char *p;
+	ssize_t n;
+
+	ent = find_ent(lc, id);
+	if(ent->target) return ent->target;
+
+	/* The common case is a link to where the path, as given, is canonical
+	 * up to the target's parent, which is likely to be the parent of other
+	 * links' targets too. Anything else is left to realpath. */
+	n = readlinkat(dfd, name, target, PATH_MAX);
+	if(n <= 0 || n == PATH_MAX) goto slow_path;
+	target[n] = '\0';
+
+	if(target[0] == '/') {
+		memcpy(buf, target, n + 1);
+	} else if(snprintf(buf, PATH_MAX, "%s/%s", (path[1] ? path : ""),
+		target) >= PATH_MAX) {
+		goto slow_path;
+	}
+
+	if(!is_clean(buf)) goto slow_path;
+
+	p = strrchr(buf, '/');
+	if(p != buf && !is_canonical_dir(lc, buf, p - buf)) goto slow_path;
+
+	/* the target itself mustn't be a link to somewhere else */
+	if(lstat(buf, &tst) == -1 || !S_ISDIR(tst.st_mode) ||
+		tst.st_dev != st->st_dev || tst.st_ino != st->st_ino)
+		goto slow_path;
+
+	real_path = strdup(buf);
+	if(!real_path) return NULL;
+	goto add_ent;
+
+	slow_path:
+	if(snprintf(buf, PATH_MAX, "%s/%s", (path[1] ? path : ""),
+		name) >= PATH_MAX) return NULL;
+
+	real_path = realpath(buf, NULL);
+	if(!real_path) return NULL;
+
+	add_ent:
+	/* the table is kept no more than half full */
+	if((lc->nents + 1) * 2 > lc->size) {
+		if(lc->nents >= LC_MAX_ENTS || grow(lc)) clear(lc);
+	}
+
+	ent = find_ent(lc, id);
+	ent->id = *id;
+	ent->target = real_path;
+	lc->nents++;
+
+	return real_path;
+}
+
+/*
+ * Returns the entry for the link identity specified,
+ * or the vacant slot it's to be put in if there's none.
+ */
+static struct link_ent* find_ent(struct link_cache *lc,
+	const struct link_id *id)
+{
+	size_t mask = lc->size - 1;
+	size_t i = hash_id(id->dev, id->ino) & mask;
+
+	while(lc->ents[i].target) {
+		struct link_id *ent_id = &lc->ents[i].id;
+
+		if(ent_id->dev == id->dev && ent_id->ino == id->ino &&
+			ent_id->ctime == id->ctime) break;
+		i = (i + 1) & mask;
+	}
+	return &lc->ents[i];
+}
+
+/*
+ * Doubles the number of slots. Returns zero on success, errno otherwise.
+ */
+static int grow(struct link_cache *lc)
+{
+	struct link_ent *old = lc->ents;
+	size_t old_size = lc->size;
+	size_t i;
+
+	lc->ents = calloc(old_size * 2, sizeof(struct link_ent));
+	if(!lc->ents) {
+		lc->ents = old;
+		return ENOMEM;
+	}
+	lc->size = old_size * 2;
+
+	for(i = 0; i < old_size; i++) {
+		if(old[i].target) {
+			*find_ent(lc, &old[i].id) = old[i];
+		}
+	}
+	free(old);
+
+	return 0;
+}
+
+/*
+ * Removes all entries, retaining the slots
+ */
+static void clear(struct link_cache *lc)
+{
+	size_t i;
+
+	dbg_trace("clearing %lu link cache entries\n", (unsigned long)lc->nents);
+
+	for(i = 0; i < lc->size; i++) {
+		if(lc->ents[i].target) free(lc->ents[i].target);
+	}
+	memset(lc->ents, 0, lc->size * sizeof(struct link_ent));
+	lc->nents = 0;
+	dtab_clear(&lc->canon);
+}
+
+/*
+ * Returns non-zero if path is absolute, and has no empty, . or .. components
+ */
+static int is_clean(const char *path)
+{
+	const char *p = path;
+
+	if(*p != '/') return 0;
+
+	while(*p) {
+		const char *c = ++p; /* past the slash */
+
+		while(*p && *p != '/') p++;
+
+		if(p == c) return 0;
+		if(c[0] == '.' && (p - c == 1 || (p - c == 2 && c[1] == '.')))
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Returns non-zero if the first len characters of path are the canonical
+ * path of a directory. These are checked with realpath once, and kept in
+ * the canonical directory set until the next scan (see lcache_forget_dirs).
+ */
+static int is_canonical_dir(struct link_cache *lc, char *path, size_t len)
+{
+	char *real_path;
+	char c = path[len];
+	int res = 0;
+
+	path[len] = '\0';
+
+	if(dtab_find(&lc->canon, path)) {
+		res = 1;
+	} else if( (real_path = realpath(path, NULL)) ) {
+		res = !strcmp(path, real_path);
+		free(real_path);
+
+		if(res) dtab_add(&lc->canon, path);
+	}
+
+	path[len] = c;
+	return res;
+}
+
+static size_t hash_id(dev_t dev, ino_t ino)
+{
+	unsigned long long h = (unsigned long long)ino * 0x9E3779B97F4A7C15ULL;
+
+	return (size_t)((h >> 32) ^ h ^ (unsigned long long)dev);
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2026 alx@fastestcode.org
+ * This software is distributed under the terms of the X/MIT license.
+ * See the included COPYING file for further information.
+ */
+
+/*
+ * Symbolic link target cache used by the directory reader. Canonical
+ * target paths of symlinks to directories are kept by link identity
+ * (device, inode and ctime; links can't be modified in place, so a new
+ * target means a new link), so that links that are seen again, or
+ * changed in ways that don't matter, aren't resolved over again.
+ */
+
+#ifndef LNKCACHE_H
+#define LNKCACHE_H
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "dirtab.h"
+
+/* Link identity, as returned by lstat */
+struct link_id {
+	dev_t dev;
+	ino_t ino;
+	time_t ctime;
+};
+
+struct link_ent {
+	struct link_id id;
+	char *target; /* NULL if the slot is vacant */
+};
+
+struct link_cache {
+	struct link_ent *ents;
+	size_t nents;
+	size_t size; /* number of slots, a power of two */
+	struct dir_tab canon; /* directories known to be canonical paths */
+};
+
+/* Initializes an empty cache. Returns zero on success, errno otherwise. */
+int lcache_init(struct link_cache*);
+
+/* Frees all data associated with the cache */
+void lcache_free(struct link_cache*);
+
+/*
+ * Forgets directories known to be canonical paths, since any of these may
+ * have been replaced with a symlink since. Must be called before each scan.
+ */
+void lcache_forget_dirs(struct link_cache*);
+
+/*
+ * Returns the canonical path of the directory the symlink name in the
+ * directory dfd refers to. Path is the canonical path of that directory,
+ * id identifies the link, and st is what stat returned for it. The string
+ * returned belongs to the cache. Returns NULL if it can't be resolved.
+ */
+const char* lcache_resolve(struct link_cache*, int dfd, const char *path,
+	const char *name, const struct link_id *id, const struct stat *st);
+
+#endif /* LNKCACHE_H */
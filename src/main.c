@@ -41,6 +41,8 @@
 #include "fsproc.h"
 #include "usrtool.h"
 #include "fsutil.h"
+#include "fspolicy.h"
+#include "watchd.h"
 #include "select.h"
 #include "debug.h"
 
@@ -84,7 +86,7 @@ int main(int argc, char **argv)
 	int nsaved_args;
 	char *open_spec = NULL;
 	char *path;
-	int res;
+	int i, res;
 	
 	XtResource xrdb_resources[] = {
 	{
@@ -111,12 +113,90 @@ int main(int argc, char **argv)
 		XtOffsetOf(struct app_resources, confirm_rm),
 		XmRImmediate,(XtPointer)CS_CONFIRM_ALWAYS
 	},
+	{
+		"directorySizes", "DirectorySizes",
+		XmRString, sizeof(String),
+		XtOffsetOf(struct app_resources, dir_sizes),
+		XmRImmediate,(XtPointer)CS_DSIZE_NONE
+	},
 	{
 		"refreshInterval", "RefreshInterval",
 		XmRInt, sizeof(int),
 		XtOffsetOf(struct app_resources, refresh_int),
 		XmRImmediate,(XtPointer)DEF_REFRESH_INT
 	},
+	{
+		"readerThreads", "ReaderThreads",
+		XmRInt, sizeof(int),
+		XtOffsetOf(struct app_resources, reader_threads),
+		XmRImmediate,(XtPointer)DEF_READER_THREADS
+	},
+	{
+		"listingCacheSize", "ListingCacheSize",
+		XmRInt, sizeof(int),
+		XtOffsetOf(struct app_resources, listing_cache),
+		XmRImmediate,(XtPointer)DEF_LISTING_CACHE
+	},
+	{
+		"readerBufferSize", "ReaderBufferSize",
+		XmRInt, sizeof(int),
+		XtOffsetOf(struct app_resources, reader_buffer),
+		XmRImmediate,(XtPointer)DEF_READER_BUFFER
+	},
+	{
+		"prefetchDelay", "PrefetchDelay",
+		XmRInt, sizeof(int),
+		XtOffsetOf(struct app_resources, prefetch_delay),
+		XmRImmediate,(XtPointer)DEF_PREFETCH_DELAY
+	},
+	{
+		"readTimeout", "ReadTimeout",
+		XmRInt, sizeof(int),
+		XtOffsetOf(struct app_resources, read_timeout),
+		XmRImmediate,(XtPointer)DEF_READ_TIMEOUT
+	},
+	{
+		"savedListingMin", "SavedListingMin",
+		XmRInt, sizeof(int),
+		XtOffsetOf(struct app_resources, saved_listing_min),
+		XmRImmediate,(XtPointer)DEF_SAVED_LISTING_MIN
+	},
+	{
+		"useWatcherDaemon", "UseWatcherDaemon",
+		XmRBoolean, sizeof(Boolean),
+		XtOffsetOf(struct app_resources, watcher_daemon),
+		XmRImmediate,(XtPointer)True
+	},
+	{
+		"localFsPolicy", "FsPolicy",
+		XmRString, sizeof(String),
+		XtOffsetOf(struct app_resources, fs_policy[FSC_LOCAL]),
+		XmRImmediate,(XtPointer)NULL
+	},
+	{
+		"remoteFsPolicy", "FsPolicy",
+		XmRString, sizeof(String),
+		XtOffsetOf(struct app_resources, fs_policy[FSC_REMOTE]),
+		XmRImmediate,(XtPointer)NULL
+	},
+	{
+		"fuseFsPolicy", "FsPolicy",
+		XmRString, sizeof(String),
+		XtOffsetOf(struct app_resources, fs_policy[FSC_FUSE]),
+		XmRImmediate,(XtPointer)NULL
+	},
+	{
+		"memoryFsPolicy", "FsPolicy",
+		XmRString, sizeof(String),
+		XtOffsetOf(struct app_resources, fs_policy[FSC_MEMORY]),
+		XmRImmediate,(XtPointer)NULL
+	},
+	{
+		"virtualFsPolicy", "FsPolicy",
+		XmRString, sizeof(String),
+		XtOffsetOf(struct app_resources, fs_policy[FSC_VIRTUAL]),
+		XmRImmediate,(XtPointer)NULL
+	},
 	{
 		"showAll", "ShowAll",
 		XmRBoolean, sizeof(Boolean),
@@ -242,6 +322,9 @@ int main(int argc, char **argv)
 		{"-s", "sortBy", XrmoptionStickyArg, NULL}
 	};
 	
+	/* the watcher daemon runs without a display */
+	if(argc == 2 && !strcmp(argv[1], "-watchd")) return watchd_main();
+
 	saved_args = calloc(sizeof(char*), argc + 1);
 	memcpy(saved_args, argv, sizeof(char*) * argc);
 	nsaved_args = argc;
@@ -347,8 +430,6 @@ int main(int argc, char **argv)
 	
 	/* Set some initial instance options from app resources */
 	
-	if(app_res.filter) set_filter(app_res.filter);
-	
 	/* NOTE: The matching stuff below should really be done with XtRepTypes,
 	 *       but there is not enough of it to be worth the trouble yet */
 	if(!strcasecmp(app_res.confirm_rm, CS_CONFIRM_ALWAYS)) {
@@ -360,6 +441,17 @@ int main(int argc, char **argv)
 		app_inst.confirm_rm = CONFIRM_ALWAYS;
 	}
 	
+	if(!strcasecmp(app_res.dir_sizes, CS_DSIZE_NONE)) {
+		app_inst.dir_sizes = DSIZE_NONE;
+	} else if(!strcasecmp(app_res.dir_sizes, CS_DSIZE_COUNT)) {
+		app_inst.dir_sizes = DSIZE_COUNT;
+	} else if(!strcasecmp(app_res.dir_sizes, CS_DSIZE_TOTAL)) {
+		app_inst.dir_sizes = DSIZE_TOTAL;
+	} else {
+		stderr_msg("Illegal directorySizes option specified, using default.\n");
+		app_inst.dir_sizes = DSIZE_NONE;
+	}
+	
 	if(!strcasecmp(app_res.icon_size, CS_ICON_AUTO)) {
 		app_inst.icon_size_id = get_best_icon_size();
 	} else if(!strcasecmp(app_res.icon_size, CS_ICON_TINY)) {
@@ -380,9 +472,27 @@ int main(int argc, char **argv)
 		app_res.refresh_int = DEF_REFRESH_INT;
 	}
 	
+	if(app_res.reader_threads > MAX_READER_THREADS) {
+		stderr_msg("Invalid reader threads value, using default.\n");
+		app_res.reader_threads = DEF_READER_THREADS;
+	}
+	
+	/* override built-in file system policies */
+	for(i = 0; i < NUM_FS_CLASSES; i++) {
+		if(app_res.fs_policy[i] &&
+			fsp_parse(&fs_policies[i], app_res.fs_policy[i])) {
+			stderr_msg("Invalid %sFsPolicy value specified, "
+				"using default.\n", fsp_class_name(i));
+		}
+	}
+	
 	db_init(&app_inst.type_db);
 	load_db(); 
 	
+	/* may refer to file types */
+	if(app_res.filter && set_filter(app_res.filter))
+		stderr_msg("Invalid filter expression specified, ignoring.\n");
+	
 	sigchld_sigid = XtAppAddSignal(app_inst.context,
 		xt_sigchld_handler, NULL);
 		
@@ -713,7 +823,10 @@ static void create_main_menus(void)
 /* WM_DELETE_WINDOW handler */
 static void window_close_cb(Widget w, XtPointer client, XtPointer call)
 {
-	if(app_inst.wshell) stop_read_proc();
+	if(app_inst.wshell) {
+		save_listing();
+		stop_read_proc();
+	}
 	
 	if(app_inst.num_sub_shells) {
 		dbg_trace("%d sub-shells still active\n", app_inst.num_sub_shells);
@@ -729,15 +842,19 @@ static void sigchld_handler(int sig)
 {
 	pid_t pid;
 	int status = 0;
-
-	pid = waitpid(-1, &status, WNOHANG);
-
-	if(pid > 0 && !read_proc_sigchld(pid, status)) {
-		if(mount_proc_sigchld(pid, status) ||
-			fs_proc_sigchld(pid, status) ) {
-				XtNoticeSignal(sigchld_sigid);
+	int errno_sav = errno;
+
+	/* Signals coalesce, so reap everything that has exited since */
+	while((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+		if(!read_proc_sigchld(pid, status)) {
+			if(mount_proc_sigchld(pid, status) ||
+				fs_proc_sigchld(pid, status) ) {
+					XtNoticeSignal(sigchld_sigid);
+			}
 		}
+		status = 0;
 	}
+	errno = errno_sav;
 }
 
 static void sigusr_handler(int sig)
@@ -998,79 +1115,34 @@ static void xfile_open(int argc, char **argv)
 	exit(errors ? EXIT_FAILURE : EXIT_SUCCESS);
 }
 
-/* Parses a filter pattern and sets app_inst.filter_pat/neg */
-void set_filter(const char *psz)
+/*
+ * Compiles a filter expression into app_inst.filter_prog.
+ * Returns zero on success, or errno, leaving current filter intact.
+ */
+int set_filter(const char *psz)
 {
-	char *src;
-	char **pat = NULL;
-	char *s;
-	char *p;
-	unsigned int l;
-	unsigned int i;
+	struct filter_prog prog;
+	int res;
 	
+	if(psz) {
+		res = filter_compile(&prog, psz, &app_inst.type_db);
+		if(res) return res;
+	} else {
+		memset(&prog, 0, sizeof(struct filter_prog));
+	}
+
 	if(app_inst.filter) {
 		free(app_inst.filter);
 		app_inst.filter = NULL;
 	}
 	
-	if(app_inst.filter_pat) {
-		for(i = 0; app_inst.filter_pat[i]; i++) {
-			free(app_inst.filter_pat[i]);
-		}
-		free(app_inst.filter_pat);
-		app_inst.filter_pat = NULL;
-	}
-
-	app_inst.filter_neg = False;
-	
-	if(!psz) return;
-	
-	src = strdup(psz);
-
-	s = p = src;
-	l = 0;
-	i = 0;
-	
-	if(*p == '!') {
-		if(p[1] != '!') app_inst.filter_neg = True;
-		memcpy(p, p + 1, strlen(p));
-	}
-
-	for( ; ; ) {
-		if(*p == '\0' || *p == '|') {
-			
-			if(*p == '|' && p[1] == '|') {
-				memcpy(p, p + 1, strlen(p));
-				p++;
-				continue;
-			}
-			
-			if( (l = p - s) ) {
-				pat = realloc(pat, (i + 2) * sizeof(char*));
-
-				pat[i] = malloc(l + 1);
-				memcpy(pat[i], s, l);
-				pat[i][l] = '\0';
-
-				i++;
-			}
-			if(*p == '\0') break;
-
-			l = 0;
-			s = p + 1;
-		}
-		p++;
-	}
-	
-	free(src);
+	filter_free(&app_inst.filter_prog);
+	app_inst.filter_prog = prog;
 	
-	if(i) {
-		pat[i] = NULL;
-		app_inst.filter_pat = pat;
+	/* retain the actual pattern for the filter dialog */
+	if(prog.nnodes) app_inst.filter = strdup(psz);
 
-		/* retain the actual pattern for the filter dialog */
-		app_inst.filter = strdup(psz);
-	}
+	return 0;
 }
 
 /* Sets the status bar text from printf(3) arguments */
@@ -14,6 +14,8 @@
 #include <Xm/Xm.h>
 #include "typedb.h"
 #include "listw.h"
+#include "filter.h"
+#include "fsutil.h"
 
 /* Application resources */
 struct app_resources {
@@ -21,7 +23,16 @@ struct app_resources {
 	Boolean show_app_title;
 	Boolean user_db_only;
 	unsigned int refresh_int;
+	unsigned int reader_threads;
+	unsigned int listing_cache;
+	unsigned int reader_buffer;
+	unsigned int prefetch_delay;
+	unsigned int read_timeout;
+	unsigned int saved_listing_min;
+	Boolean watcher_daemon;
+	String fs_policy[NUM_FS_CLASSES]; /* by FSC_* class */
 	String confirm_rm;
+	String dir_sizes;
 	Boolean path_field;
 	Boolean status_field;
 	Boolean show_all;
@@ -89,9 +100,9 @@ struct app_inst_data {
 	/* options */
 	int icon_size_id;
 	int confirm_rm;
+	int dir_sizes;
 	char *filter;
-	char **filter_pat;
-	Boolean filter_neg;
+	struct filter_prog filter_prog;
 
 	/* number of currently active sub-shells */
 	unsigned int num_sub_shells;
@@ -121,8 +132,9 @@ void fork_xfile(const char *path, Boolean inherit_ui);
 /* Sets GUI sensitivity according to UIF* flags */
 void set_ui_sensitivity(short);
 
-/* Parses a filter pattern and sets app_inst.filter_pat/neg on success */
-void set_filter(const char*);
+/* Compiles a filter expression into app_inst.filter_prog.
+ * Returns zero on success, or errno, leaving current filter intact. */
+int set_filter(const char*);
 
 /* UI sensitivity flags */
 #define UIF_DIR 0x0001		/* displaying a directory */
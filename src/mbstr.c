@@ -196,3 +196,58 @@ void mbs_to_latin1(const char *src, char *dest)
 	}
 	dest[id] = '\0';
 }
+
+/*
+ * This is like strcmp, except it will compare
+ * coinciding strings of digits numerically
+ */
+int mbs_numcmp(const char *a, const char *b)
+{
+	int res = 0;
+
+	while(*a && *b) {
+		if(isdigit((int)*a) && isdigit((int)*b)) {
+			const char *sp_a = a;
+			const char *sp_b = b;
+			unsigned int ai = 0;
+			unsigned int bi = 0;
+			unsigned int fa = 1;
+			const char *p;
+
+			while(*sp_a && isdigit((int)*sp_a)) sp_a++;
+			while(*sp_b && isdigit((int)*sp_b)) sp_b++;
+
+			p = sp_a;
+
+			do {
+				p--;
+				ai += (*p - '0') * fa;
+				fa *= 10;
+			} while(p != a);
+
+			p = sp_b;
+			fa = 1;
+
+			do {
+				p--;
+				bi += (*p - '0') * fa;
+				fa *= 10;
+			} while(p != b);
+			
+			res = (ai - bi);
+			if(res)	return res;
+			
+			a = sp_a;
+			b = sp_b;
+		} else {
+			res = *a - *b;
+			if(res) return res;
+			
+			a++; b++;
+		}
+	}
+	
+	if(*a) res = 1; else if(*b) res = -1; else res = 0;
+
+	return res;
+}
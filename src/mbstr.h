@@ -31,4 +31,8 @@ char* mbs_make_displayable(const char *src);
  */
 void mbs_to_latin1(const char *src, char *dest);
 
+/* This is like strcmp, except it compares coinciding
+ * strings of digits numerically */
+int mbs_numcmp(const char*, const char*);
+
 #endif /* MBSTR_H */
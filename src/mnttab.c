@@ -0,0 +1,251 @@
+/*
+ * Copyright (C) 2026 alx@fastestcode.org
+ * This software is distributed under the terms of the X/MIT license.
+ * See the included COPYING file for further information.
+ */
+
+/*
+ * Mount table snapshot. Mount points are kept in a dir_tab (see dirtab.h),
+ * keyed by path, so that lookups are O(1) and changes can be found by
+ * generation when the table is reread.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include "dirtab.h"
+#include "mnttab.h"
+#include "debug.h"
+
+#ifdef __linux__
+/* Read buffer growth increment */
+#define READ_BUF_GROW 16384
+
+/* Module globals */
+static const char sz_mountinfo[] = "/proc/self/mountinfo";
+static int mnt_fd = -1;
+static struct dir_tab mnt_tab;
+static char *buffer = NULL;
+static size_t buffer_size = 0;
+
+/* Local prototypes */
+static int read_mountinfo(size_t*);
+static char* mount_point(char *line);
+static void unescape(char *s);
+
+int mtab_open(void)
+{
+	int res;
+
+	if(mnt_fd != -1) return 0;
+	
+	mnt_fd = open(sz_mountinfo, O_RDONLY | O_CLOEXEC);
+	if(mnt_fd == -1) return errno;
+	
+	res = dtab_init(&mnt_tab);
+	if(!res) res = mtab_update(NULL, NULL);
+
+	if(res) {
+		close(mnt_fd);
+		mnt_fd = -1;
+	}
+	return res;
+}
+
+int mtab_fd(void)
+{
+	return mnt_fd;
+}
+
+int mtab_update(void (*changed)(const char*, void*), void *data)
+{
+	struct dir_rec *rec;
+	size_t len = 0;
+	size_t i;
+	char *p;
+	int res;
+	
+	if(mnt_fd == -1) return EBADF;
+	
+	res = read_mountinfo(&len);
+	if(res) return res;
+
+	/* mount points not seen in this generation were unmounted */
+	dtab_new_gen(&mnt_tab);
+	
+	for(p = buffer; p < buffer + len; ) {
+		char *line = p;
+		char *mpt;
+
+		p = memchr(line, '\n', (buffer + len) - line);
+		if(p) {
+			*p++ = '\0';
+		} else {
+			/* lines are newline terminated, so this is what's left
+			 * of one cut short by the table changing while read */
+			break;
+		}
+		
+		mpt = mount_point(line);
+		if(!mpt) continue;
+		
+		rec = dtab_find(&mnt_tab, mpt);
+		if(!rec) {
+			rec = dtab_add(&mnt_tab, mpt);
+			if(!rec) return ENOMEM;
+			dbg_printf("mounted: %s\n", mpt);
+			if(changed) changed(mpt, data);
+		}
+		dtab_touch(&mnt_tab, rec);
+	}
+	
+	for(i = 0; i < mnt_tab.nrecs; ) {
+		rec = &mnt_tab.recs[i];
+		
+		if(!dtab_stale(&mnt_tab, rec)) {
+			i++;
+			continue;
+		}
+		dbg_printf("unmounted: %s\n", dtab_name(&mnt_tab, rec));
+		if(changed) changed(dtab_name(&mnt_tab, rec), data);
+
+		/* moves the last record to i */
+		dtab_remove(&mnt_tab, rec);
+	}
+	return 0;
+}
+
+int mtab_is_mounted(const char *path)
+{
+	if(mnt_fd == -1) return -1;
+	
+	return dtab_find(&mnt_tab, path) ? 1 : 0;
+}
+
+int mtab_has_mounts(const char *path)
+{
+	size_t len = strlen(path);
+	size_t i;
+	
+	if(mnt_fd == -1) return -1;
+	
+	/* root has a trailing slash */
+	if(len == 1) len = 0;
+
+	for(i = 0; i < mnt_tab.nrecs; i++) {
+		const char *mpt = dtab_name(&mnt_tab, &mnt_tab.recs[i]);
+		
+		if(!strncmp(mpt, path, len) && mpt[len] == '/' &&
+			mpt[len + 1] != '\0' && !strchr(mpt + len + 1, '/')) return 1;
+	}
+	return 0;
+}
+
+/*
+ * Reads mountinfo in whole into the buffer, sets *len to its length.
+ * Returns zero on success, errno otherwise.
+ */
+static int read_mountinfo(size_t *len)
+{
+	ssize_t n;
+	
+	*len = 0;
+	
+	if(lseek(mnt_fd, 0, SEEK_SET) == -1) return errno;
+	
+	for(;;) {
+		if(*len == buffer_size) {
+			char *p = realloc(buffer, buffer_size + READ_BUF_GROW);
+			if(!p) return ENOMEM;
+			buffer = p;
+			buffer_size += READ_BUF_GROW;
+		}
+		
+		n = read(mnt_fd, buffer + *len, buffer_size - *len);
+		if(n == -1) {
+			if(errno == EINTR) continue;
+			return errno;
+		}
+		if(n == 0) break;
+		*len += n;
+	}
+	return 0;
+}
+
+/*
+ * Returns the (decoded, NUL terminated) mount point field of a mountinfo
+ * line, or NULL if the line is malformed. The line is modified in place.
+ */
+static char* mount_point(char *line)
+{
+	char *p = line;
+	char *mpt;
+	int i;
+	
+	/* mount id, parent id, major:minor, root, mount point */
+	for(i = 0; i < 4; i++) {
+		p = strchr(p, ' ');
+		if(!p) return NULL;
+		p++;
+	}
+
+	mpt = p;
+	p = strchr(p, ' ');
+	if(!p) return NULL;
+	*p = '\0';
+	
+	unescape(mpt);
+	return mpt;
+}
+
+/*
+ * Decodes octal escapes (\040 etc.) the kernel uses for
+ * white space and backslashes in mountinfo fields
+ */
+static void unescape(char *s)
+{
+	char *d = s;
+	
+	while(*s) {
+		if(s[0] == '\\' && (s[1] >= '0' && s[1] <= '3') &&
+			(s[2] >= '0' && s[2] <= '7') && (s[3] >= '0' && s[3] <= '7')) {
+			*d++ = ((s[1] - '0') << 6) | ((s[2] - '0') << 3) | (s[3] - '0');
+			s += 4;
+		} else {
+			*d++ = *s++;
+		}
+	}
+	*d = '\0';
+}
+
+#else /* !__linux__ */
+
+int mtab_open(void)
+{
+	return ENOSYS;
+}
+
+int mtab_fd(void)
+{
+	return -1;
+}
+
+int mtab_update(void (*changed)(const char*, void*), void *data)
+{
+	return ENOSYS;
+}
+
+int mtab_is_mounted(const char *path)
+{
+	return -1;
+}
+
+int mtab_has_mounts(const char *path)
+{
+	return -1;
+}
+
+#endif /* __linux__ */
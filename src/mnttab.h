@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2026 alx@fastestcode.org
+ * This software is distributed under the terms of the X/MIT license.
+ * See the included COPYING file for further information.
+ */
+
+/*
+ * Mount table snapshot, read from /proc/self/mountinfo and indexed by
+ * mount point. Only available on Linux; elsewhere queries return -1 and
+ * callers have to fall back to probing paths with stat.
+ */
+
+#ifndef MNTTAB_H
+#define MNTTAB_H
+
+/* Reads the mount table. Returns zero on success, errno otherwise. */
+int mtab_open(void);
+
+/*
+ * Returns a descriptor that polls POLLPRI when the mount table changes,
+ * or -1 if the table isn't open. Once reported, the change is to be
+ * picked up with mtab_update.
+ */
+int mtab_fd(void);
+
+/*
+ * Rereads the mount table. The changed callback, which may be NULL,
+ * is called for each mount point that was added or removed since.
+ * Returns zero on success, errno otherwise.
+ */
+int mtab_update(void (*changed)(const char *path, void *data), void *data);
+
+/*
+ * Returns 1 if something is mounted on path, 0 if not, or -1 if that
+ * isn't known. Path must be absolute and canonical.
+ */
+int mtab_is_mounted(const char *path);
+
+/*
+ * Returns 1 if there are mount points directly under path, 0 if not,
+ * or -1 if that isn't known. Path must be absolute and canonical.
+ */
+int mtab_has_mounts(const char *path);
+
+#endif /* MNTTAB_H */
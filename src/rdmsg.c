@@ -0,0 +1,556 @@
+/*
+ * Copyright (C) 2026 alx@fastestcode.org
+ * This software is distributed under the terms of the X/MIT license.
+ * See the included COPYING file for further information.
+ */
+
+/*
+ * Directory reader to GUI process message framing
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include "rdmsg.h"
+#include "debug.h"
+
+struct frame_hdr {
+	unsigned short version;
+	unsigned short tag;
+	unsigned short flags;
+	unsigned short reserved;
+	unsigned int length;
+	unsigned int nrecs;
+	unsigned int ring_pos; /* FH_RING: position of the payload */
+};
+
+/* Frame header flags */
+#define FH_RING 0x01 /* the payload is in the shared ring */
+
+#if defined(MAP_ANONYMOUS) && !defined(MAP_ANON)
+#define MAP_ANON MAP_ANONYMOUS
+#endif
+
+/* Orders shared ring accesses against updates of the tail position */
+#ifdef __GNUC__
+#define RING_BARRIER() __sync_synchronize()
+#else
+#define RING_BARRIER() ((void)0)
+#endif
+
+/* Record header, followed by fields and NUL terminated name */
+#define REC_HDR_SIZE 6
+
+/* Receiver buffer size, must hold at least one complete frame */
+#define RECV_BUF_SIZE (RDM_FRAME_MAX * 2)
+
+/* Frame queue growth increment (fd -1 senders) */
+#define QUEUE_GROW_BY (RDM_FRAME_MAX * 2)
+
+/* Local prototypes */
+static size_t fields_size(unsigned int fields);
+static int queue_frame(struct rdm_sender*, const struct frame_hdr*);
+static int ring_frame(struct rdm_sender*, struct frame_hdr*);
+static void release_ring_frame(struct rdm_receiver*);
+static int decode_record(struct msg_data*, const char **name,
+	const char *p, size_t avail);
+
+struct rdm_ring* rdm_create_ring(size_t size)
+{
+	struct rdm_ring *ring;
+	size_t ring_size = RDM_FRAME_MAX;
+	void *p;
+	
+	while(ring_size * 2 <= size && ring_size * 2 <= (~0U >> 1))
+		ring_size *= 2;
+	
+	if(size < ring_size) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	p = mmap(NULL, sizeof(struct rdm_ring) + ring_size,
+		PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
+	if(p == MAP_FAILED) return NULL;
+	
+	ring = p;
+	ring->size = ring_size;
+	ring->tail = 0;
+	ring->data = (char*)p + sizeof(struct rdm_ring);
+	
+	return ring;
+}
+
+void rdm_reset_ring(struct rdm_ring *ring)
+{
+	ring->tail = 0;
+}
+
+void rdm_sender_ring(struct rdm_sender *s, struct rdm_ring *ring)
+{
+	s->ring = ring;
+	s->ring_head = ring ? ring->tail : 0;
+}
+
+void rdm_receiver_ring(struct rdm_receiver *r, struct rdm_ring *ring)
+{
+	r->ring = ring;
+	r->ring_held = 0;
+}
+
+void rdm_init_sender(struct rdm_sender *s, int fd)
+{
+	s->fd = fd;
+	s->tag = 0;
+	s->nrecs = 0;
+	s->len = 0;
+	s->out = NULL;
+	s->out_pos = 0;
+	s->out_len = 0;
+	s->out_size = 0;
+	s->ring = NULL;
+	s->ring_head = 0;
+}
+
+void rdm_retag(struct rdm_sender *s, unsigned int tag)
+{
+	s->nrecs = 0;
+	s->len = 0;
+	s->tag = tag;
+}
+
+int rdm_put(struct rdm_sender *s,
+	const struct msg_data *msg, const char *name)
+{
+	size_t name_len = name ? strlen(name) : 0;
+	size_t rec_size;
+	unsigned short us;
+	char *p;
+	
+	rec_size = REC_HDR_SIZE + fields_size(msg->fields) +
+		(name ? (name_len + 1) : 0);
+
+	dbg_assert(rec_size <= RDM_FRAME_MAX);
+
+	if(s->len + rec_size > RDM_FRAME_MAX) {
+		int res = rdm_flush(s);
+		if(res) return res;
+	}
+	p = s->data + s->len;
+	
+	*p++ = (unsigned char)msg->reason;
+	*p++ = (unsigned char)msg->flags;
+	us = msg->fields;
+	memcpy(p, &us, sizeof(us));
+	p += sizeof(us);
+	us = name ? (name_len + 1) : 0;
+	memcpy(p, &us, sizeof(us));
+	p += sizeof(us);
+
+	#define PUT_FIELD(v) { memcpy(p, &(v), sizeof(v)); p += sizeof(v); }
+	if(msg->fields & MF_ERRNO) PUT_FIELD(msg->stat_errno);
+	if(msg->fields & MF_MODE) PUT_FIELD(msg->mode);
+	if(msg->fields & MF_TIMES) {
+		PUT_FIELD(msg->ctime);
+		PUT_FIELD(msg->mtime);
+	}
+	if(msg->fields & MF_OWNER) {
+		PUT_FIELD(msg->uid);
+		PUT_FIELD(msg->gid);
+	}
+	if(msg->fields & MF_SIZE) PUT_FIELD(msg->size);
+	if(msg->fields & MF_DBINDEX) PUT_FIELD(msg->db_index);
+	if(msg->fields & MF_ICON) PUT_FIELD(msg->icon);
+	if(msg->fields & MF_TOTALS) {
+		PUT_FIELD(msg->files_total);
+		PUT_FIELD(msg->files_skipped);
+		PUT_FIELD(msg->size_total);
+	}
+	if(msg->fields & MF_DIRID) {
+		PUT_FIELD(msg->dir_dev);
+		PUT_FIELD(msg->dir_ino);
+		PUT_FIELD(msg->dir_mtime);
+	}
+	#undef PUT_FIELD
+
+	if(name) memcpy(p, name, name_len + 1);
+
+	s->len += rec_size;
+	s->nrecs++;
+
+	return 0;
+}
+
+int rdm_flush(struct rdm_sender *s)
+{
+	struct frame_hdr hdr;
+	struct iovec iov[2];
+	ssize_t n;
+	
+	if(!s->nrecs) return 0;
+
+	memset(&hdr, 0, sizeof(struct frame_hdr));
+	hdr.version = RDM_VERSION;
+	hdr.tag = s->tag;
+	hdr.length = s->len;
+	hdr.nrecs = s->nrecs;
+	
+	if(s->fd == -1) return queue_frame(s, &hdr);
+	
+	iov[0].iov_base = &hdr;
+	iov[0].iov_len = sizeof(struct frame_hdr);
+	iov[1].iov_base = s->data;
+	iov[1].iov_len = ring_frame(s, &hdr) ? 0 : s->len;
+
+	s->nrecs = 0;
+	s->len = 0;
+
+	while((n = writev(s->fd, iov, 2)) == -1 && errno == EINTR);
+	if(n == -1) return errno;
+	
+	/* interrupted after writing some data */
+	if((size_t)n < iov[0].iov_len + iov[1].iov_len) {
+		if((size_t)n < iov[0].iov_len) {
+			if(writen(s->fd, (char*)iov[0].iov_base + n,
+				iov[0].iov_len - n) == -1) return errno;
+			n = 0;
+		} else {
+			n -= iov[0].iov_len;
+		}
+		if(writen(s->fd, (char*)iov[1].iov_base + n,
+			iov[1].iov_len - n) == -1) return errno;
+	}
+	return 0;
+}
+
+/*
+ * Copies the pending frame's payload into the shared ring, if there's
+ * one and the payload fits in, and sets up the header accordingly.
+ * Payloads are kept contiguous, the space left at the end of the ring
+ * is skipped if necessary.
+ */
+static int ring_frame(struct rdm_sender *s, struct frame_hdr *hdr)
+{
+	struct rdm_ring *ring = s->ring;
+	unsigned int start = s->ring_head;
+	unsigned int offset;
+	
+	if(!ring) return 0;
+	
+	offset = start & (ring->size - 1);
+	if(offset + s->len > ring->size) {
+		start += ring->size - offset;
+		offset = 0;
+	}
+	if(start + s->len - ring->tail > ring->size) return 0;
+
+	/* the receiver must be done with data it released */
+	RING_BARRIER();
+	
+	memcpy(ring->data + offset, s->data, s->len);
+	s->ring_head = start + s->len;
+	
+	hdr->flags |= FH_RING;
+	hdr->ring_pos = start;
+	
+	return 1;
+}
+
+void rdm_drain(struct rdm_sender *s, size_t len)
+{
+	dbg_assert(len <= s->out_len - s->out_pos);
+
+	s->out_pos += len;
+	if(s->out_pos == s->out_len) {
+		s->out_pos = 0;
+		s->out_len = 0;
+	}
+}
+
+/*
+ * Appends the pending frame to the out queue. Returns zero or errno.
+ */
+static int queue_frame(struct rdm_sender *s, const struct frame_hdr *hdr)
+{
+	size_t size = sizeof(struct frame_hdr) + s->len;
+	
+	/* move the unwritten part to the front before growing the buffer */
+	if(s->out_pos && s->out_len + size > s->out_size) {
+		memmove(s->out, s->out + s->out_pos, s->out_len - s->out_pos);
+		s->out_len -= s->out_pos;
+		s->out_pos = 0;
+	}
+	
+	if(s->out_len + size > s->out_size) {
+		size_t new_size = s->out_len + size + QUEUE_GROW_BY;
+		char *p;
+		
+		p = realloc(s->out, new_size);
+		if(!p) return errno;
+		s->out = p;
+		s->out_size = new_size;
+	}
+	
+	memcpy(s->out + s->out_len, hdr, sizeof(struct frame_hdr));
+	memcpy(s->out + s->out_len + sizeof(struct frame_hdr), s->data, s->len);
+	s->out_len += size;
+	
+	s->nrecs = 0;
+	s->len = 0;
+	return 0;
+}
+
+int rdm_init_receiver(struct rdm_receiver *r)
+{
+	memset(r, 0, sizeof(struct rdm_receiver));
+	
+	r->data = malloc(RECV_BUF_SIZE);
+	if(!r->data) return errno;
+	r->size = RECV_BUF_SIZE;
+	
+	return 0;
+}
+
+void rdm_reset_receiver(struct rdm_receiver *r)
+{
+	r->len = 0;
+	r->pos = 0;
+	r->frame_end = 0;
+	r->nrecs = 0;
+	r->ring_frame = NULL;
+	r->ring_held = 0;
+}
+
+int rdm_receive(struct rdm_receiver *r, int fd)
+{
+	ssize_t n;
+	
+	release_ring_frame(r);
+
+	/* move unprocessed data to the beginning of the buffer */
+	if(r->pos) {
+		if(r->len > r->pos)
+			memmove(r->data, r->data + r->pos, r->len - r->pos);
+		r->len -= r->pos;
+		if(r->nrecs) r->frame_end -= r->pos;
+		r->pos = 0;
+	}
+	
+	while(r->len < r->size) {
+		n = read(fd, r->data + r->len, r->size - r->len);
+		if(n > 0) {
+			r->len += n;
+		} else if(n == 0) {
+			return EPIPE;
+		} else {
+			if(errno == EINTR) continue;
+			return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : errno;
+		}
+	}
+	return 0;
+}
+
+int rdm_next(struct rdm_receiver *r,
+	struct msg_data *msg, const char **name)
+{
+	int size;
+	
+	release_ring_frame(r);
+	
+	/* start of a frame; wait until it's read in whole */
+	while(!r->nrecs) {
+		struct frame_hdr hdr;
+		size_t length;
+
+		if(r->len - r->pos < sizeof(struct frame_hdr)) return 0;
+		
+		memcpy(&hdr, r->data + r->pos, sizeof(struct frame_hdr));
+		
+		if(hdr.version != RDM_VERSION || hdr.length > RDM_FRAME_MAX) {
+			dbg_trace("bad frame: version %u, length %u\n",
+				hdr.version, hdr.length);
+			return -1;
+		}
+		
+		if(hdr.flags & FH_RING) {
+			unsigned int offset;
+
+			if(!r->ring) return -1;
+			offset = hdr.ring_pos & (r->ring->size - 1);
+			if(offset + hdr.length > r->ring->size) return -1;
+			
+			r->ring_frame = r->ring->data + offset;
+			r->ring_pos = 0;
+			r->ring_len = hdr.length;
+			r->ring_end = hdr.ring_pos + hdr.length;
+			length = 0;
+		} else {
+			if(r->len - r->pos - sizeof(struct frame_hdr) < hdr.length)
+				return 0;
+			r->ring_frame = NULL;
+			length = hdr.length;
+		}
+
+		r->pos += sizeof(struct frame_hdr);
+		r->frame_end = r->pos + length;
+		r->nrecs = hdr.nrecs;
+		r->tag = hdr.tag;
+		
+		#ifdef DEBUG
+		r->pipe_bytes += sizeof(struct frame_hdr) + length;
+		r->ring_bytes += hdr.length - length;
+		r->nrecs_total += hdr.nrecs;
+		#endif
+
+		if(!r->nrecs) {
+			r->pos = r->frame_end;
+			if(r->ring_frame) r->ring_held = 1;
+		}
+	}
+
+	if(r->ring_frame) {
+		size = decode_record(msg, name, r->ring_frame + r->ring_pos,
+			r->ring_len - r->ring_pos);
+		if(size < 0) return -1;
+		r->ring_pos += size;
+		r->nrecs--;
+
+		if(!r->nrecs) {
+			if(r->ring_pos != r->ring_len) return -1;
+			/* released once the name returned is no longer needed */
+			r->ring_held = 1;
+		}
+	} else {
+		size = decode_record(msg, name, r->data + r->pos,
+			r->frame_end - r->pos);
+		if(size < 0) return -1;
+		r->pos += size;
+		r->nrecs--;
+		
+		if(!r->nrecs && r->pos != r->frame_end) return -1;
+	}
+	return 1;
+}
+
+/*
+ * Makes space taken by the last ring frame, if completely processed,
+ * available to the sender again.
+ */
+static void release_ring_frame(struct rdm_receiver *r)
+{
+	if(!r->ring_held) return;
+	
+	RING_BARRIER();
+	r->ring->tail = r->ring_end;
+	r->ring_held = 0;
+	r->ring_frame = NULL;
+}
+
+/*
+ * Decodes the record at p, with avail bytes left in the frame.
+ * Returns the record size, or -1 if it's malformed.
+ */
+static int decode_record(struct msg_data *msg, const char **name,
+	const char *p, size_t avail)
+{
+	const char *start = p;
+	unsigned short us;
+	size_t name_len;
+
+	if(avail < REC_HDR_SIZE) return -1;
+
+	memset(msg, 0, sizeof(struct msg_data));
+
+	msg->reason = (unsigned char)*p++;
+	msg->flags = (unsigned char)*p++;
+	memcpy(&us, p, sizeof(us));
+	msg->fields = us;
+	p += sizeof(us);
+	memcpy(&us, p, sizeof(us));
+	name_len = us;
+	p += sizeof(us);
+	
+	if(avail < REC_HDR_SIZE + fields_size(msg->fields) + name_len)
+		return -1;
+
+	#define GET_FIELD(v) { memcpy(&(v), p, sizeof(v)); p += sizeof(v); }
+	if(msg->fields & MF_ERRNO) GET_FIELD(msg->stat_errno);
+	if(msg->fields & MF_MODE) GET_FIELD(msg->mode);
+	if(msg->fields & MF_TIMES) {
+		GET_FIELD(msg->ctime);
+		GET_FIELD(msg->mtime);
+	}
+	if(msg->fields & MF_OWNER) {
+		GET_FIELD(msg->uid);
+		GET_FIELD(msg->gid);
+	}
+	if(msg->fields & MF_SIZE) GET_FIELD(msg->size);
+	if(msg->fields & MF_DBINDEX) GET_FIELD(msg->db_index);
+	if(msg->fields & MF_ICON) GET_FIELD(msg->icon);
+	if(msg->fields & MF_TOTALS) {
+		GET_FIELD(msg->files_total);
+		GET_FIELD(msg->files_skipped);
+		GET_FIELD(msg->size_total);
+	}
+	if(msg->fields & MF_DIRID) {
+		GET_FIELD(msg->dir_dev);
+		GET_FIELD(msg->dir_ino);
+		GET_FIELD(msg->dir_mtime);
+	}
+	#undef GET_FIELD
+	
+	if(name_len) {
+		if(p[name_len - 1] != '\0') return -1;
+		*name = p;
+	} else {
+		*name = NULL;
+	}
+	
+	return (p - start) + name_len;
+}
+
+int rdm_peek_tag(struct rdm_receiver *r, unsigned int *tag)
+{
+	struct frame_hdr hdr;
+
+	if(r->nrecs) {
+		*tag = r->tag;
+		return 1;
+	}
+	
+	if(r->len - r->pos < sizeof(struct frame_hdr)) return 0;
+	
+	memcpy(&hdr, r->data + r->pos, sizeof(struct frame_hdr));
+	*tag = hdr.tag;
+	return 1;
+}
+
+/*
+ * Returns the size of field data in a record
+ */
+static size_t fields_size(unsigned int fields)
+{
+	struct msg_data *m = NULL;
+	size_t size = 0;
+
+	if(fields & MF_ERRNO) size += sizeof(m->stat_errno);
+	if(fields & MF_MODE) size += sizeof(m->mode);
+	if(fields & MF_TIMES) size += sizeof(m->ctime) + sizeof(m->mtime);
+	if(fields & MF_OWNER) size += sizeof(m->uid) + sizeof(m->gid);
+	if(fields & MF_SIZE) size += sizeof(m->size);
+	if(fields & MF_DBINDEX) size += sizeof(m->db_index);
+	if(fields & MF_ICON) size += sizeof(m->icon);
+	if(fields & MF_TOTALS) {
+		size += sizeof(m->files_total) + sizeof(m->files_skipped) +
+			sizeof(m->size_total);
+	}
+	if(fields & MF_DIRID) {
+		size += sizeof(m->dir_dev) + sizeof(m->dir_ino) +
+			sizeof(m->dir_mtime);
+	}
+	return size;
+}
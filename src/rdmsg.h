@@ -0,0 +1,251 @@
+/*
+ * Copyright (C) 2026 alx@fastestcode.org
+ * This software is distributed under the terms of the X/MIT license.
+ * See the included COPYING file for further information.
+ */
+
+/*
+ * Directory reader to GUI process message framing.
+ *
+ * Messages are packed into frames that are written with a single
+ * writev call. Each frame starts with a header that carries protocol
+ * version, tag, payload length and number of records in it. Records are
+ * variable length and contain only fields that are set.
+ *
+ * The same framing is used for commands the GUI sends to the reader.
+ * Frames are tagged with the id of the scan these pertain to, so that
+ * messages still in transit after a scan was superseded can be told
+ * apart and dropped.
+ *
+ * Optionally, frame payloads may be passed through a ring buffer in
+ * memory shared by both processes, sparing them the copying in and
+ * out of the pipe. Only frame headers are then written to the pipe,
+ * to wake up the receiver and keep frames in order. Frames that
+ * don't fit in the ring at the time are written to the pipe whole.
+ */
+
+#ifndef RDMSG_H
+#define RDMSG_H
+
+#include <sys/types.h>
+#include <time.h>
+#include "fsutil.h"
+
+/* Protocol version, must be bumped if record layout changes */
+#define RDM_VERSION 4
+
+/* Maximum frame payload size */
+#ifndef RDM_FRAME_MAX
+#define RDM_FRAME_MAX 65536
+#endif
+
+/* Message reasons */
+enum msg_reason {
+	MSG_ADD,
+	MSG_REMOVE,
+	MSG_UPDATE,
+	MSG_EOD,	/* totals (MF_TOTALS), the directory read (MF_DIRID) */
+	MSG_ERROR,	/* stat_errno: reader error code, the scan is over */
+	MSG_DIRSIZE,	/* name: subdirectory, files_total: entries in it,
+			 * size (MF_SIZE): of files in it, recursively */
+	
+	/* Commands (GUI to reader) */
+	CMD_FILTER,	/* name: filter pattern (optional), CF_* flags */
+	CMD_SORT,	/* CF_* flags: list sort order, names are sent in */
+	CMD_SCAN,	/* name: directory to read and watch, CF_* flags */
+	CMD_PRIME,	/* name, times, size, MF_* flags: entry already shown;
+			 * the list is terminated by one without a name */
+	CMD_RESCAN,	/* check for changes now */
+	CMD_STOP,	/* stop watching */
+	CMD_PAUSE,	/* the window can't be seen, suspend watching */
+	CMD_RESUME,	/* resume watching */
+	CMD_SIZE_BASE,	/* name: directory whose subdirectories are to be
+			 * sized (none to stop), CF_* flags */
+	CMD_SIZE	/* name: subdirectory to be sized next, CF_* flags */
+};
+
+/* Message fields (msg_data.fields bits) */
+#define MF_ERRNO	0x0001	/* stat_errno */
+#define MF_MODE 	0x0002	/* mode */
+#define MF_TIMES	0x0004	/* ctime, mtime */
+#define MF_OWNER	0x0008	/* uid, gid */
+#define MF_SIZE 	0x0010	/* size */
+#define MF_DBINDEX	0x0020	/* db_index */
+#define MF_TOTALS	0x0040	/* files_total, files_skipped, size_total */
+#define MF_ICON 	0x0080	/* icon */
+#define MF_DIRID	0x0100	/* dir_dev, dir_ino, dir_mtime */
+
+/* Message flags (msg_data.flags bits) */
+#define MF_SYMLINK	0x01
+#define MF_MPOINT	0x02
+#define MF_MOUNTED	0x04
+#define MF_PARTIAL	0x08	/* MSG_ADD: only name and file type are known,
+				 * MSG_EOD: end of the names-only first pass */
+
+/* Built-in icon classes (msg_data.icon), used if the file type
+ * has no icon of its own */
+enum msg_icon {
+	MI_FILE,
+	MI_DIR,
+	MI_NXDIR,	/* directory that can't be entered */
+	MI_MPT,
+	MI_MPTI,	/* mount point with nothing mounted on it */
+	MI_TEXT,
+	MI_BIN,
+	MI_DLNK,	/* dangling symbolic link */
+	NUM_MSG_ICONS
+};
+
+/* Command flags (msg_data.flags bits) */
+#define CF_SHOW_ALL	0x01	/* CMD_FILTER: show dot files */
+#define CF_FILTER_DIRS	0x02	/* CMD_FILTER: filter applies to directories */
+#define CF_PRIMED	0x04	/* CMD_SCAN: CMD_PRIME list follows */
+#define CF_SORT_ORDER	0x07	/* CMD_SORT: list widget sort order mask */
+#define CF_DESCEND	0x08	/* CMD_SORT: descending sort direction */
+#define CF_NUMBERED	0x10	/* CMD_SORT: numbers compared numerically */
+#define CF_CASE_SENS	0x20	/* CMD_SORT: case sensitive */
+#define CF_RECURSIVE	0x40	/* CMD_SIZE_BASE: total sizes, not just counts */
+#define CF_RECHECK	0x80	/* CMD_SIZE: even if it was sized already */
+
+/* Decoded message data */
+struct msg_data {
+	int reason;
+	unsigned int fields;
+	unsigned int flags;
+	int stat_errno;
+	mode_t mode;
+	time_t ctime;
+	time_t mtime;
+	gid_t gid;
+	uid_t uid;
+	int db_index;
+	unsigned char icon;
+	off_t size;
+	unsigned int files_total;
+	unsigned int files_skipped;
+	struct fsize size_total;
+	dev_t dir_dev; /* the directory read, as of when it was opened */
+	ino_t dir_ino;
+	struct timespec dir_mtime;
+};
+
+/* Shared ring buffer. The size must be a power of two. */
+struct rdm_ring {
+	unsigned int size;
+	volatile unsigned int tail; /* released by the receiver */
+	char *data;
+};
+
+/*
+ * Sender side frame buffer. If fd is -1, complete frames are queued in
+ * the out buffer, for the caller to write out (see rdm_drain).
+ */
+struct rdm_sender {
+	int fd;
+	unsigned int tag;
+	unsigned int nrecs;
+	size_t len;
+	char *out;
+	size_t out_pos;
+	size_t out_len;
+	size_t out_size;
+	struct rdm_ring *ring;
+	unsigned int ring_head;
+	char data[RDM_FRAME_MAX];
+};
+
+/* Receiver side buffer */
+struct rdm_receiver {
+	char *data;
+	size_t size;
+	size_t len;
+	size_t pos;         /* current record */
+	size_t frame_end;   /* end of the current frame's payload */
+	unsigned int nrecs; /* records left in the current frame */
+	unsigned int tag;   /* tag of the current frame */
+	struct rdm_ring *ring;
+	const char *ring_frame; /* current frame's payload, if in the ring */
+	size_t ring_pos;
+	size_t ring_len;
+	unsigned int ring_end; /* ring position to release up to */
+	int ring_held; /* ring_end is to be released */
+	#ifdef DEBUG
+	unsigned long pipe_bytes; /* totals for throughput reports */
+	unsigned long ring_bytes;
+	unsigned long nrecs_total;
+	#endif
+};
+
+/* Initializes the sender to write to fd, or to queue frames if it's -1 */
+void rdm_init_sender(struct rdm_sender*, int fd);
+
+/*
+ * Creates a ring buffer of size bytes (rounded down to a power of two) in
+ * memory that's shared with processes forked afterwards. Returns NULL
+ * and sets errno on failure.
+ */
+struct rdm_ring* rdm_create_ring(size_t size);
+
+/* Empties the ring. Must not be used by either side at the time. */
+void rdm_reset_ring(struct rdm_ring*);
+
+/* Sets (or unsets, if NULL) the ring used by the sender/receiver */
+void rdm_sender_ring(struct rdm_sender*, struct rdm_ring*);
+void rdm_receiver_ring(struct rdm_receiver*, struct rdm_ring*);
+
+/* Discards pending messages and sets the tag for subsequent frames */
+void rdm_retag(struct rdm_sender*, unsigned int tag);
+
+/*
+ * Appends a message and name (may be NULL) to the frame, flushing it
+ * first if it wouldn't fit. Returns zero on success, errno otherwise.
+ */
+int rdm_put(struct rdm_sender*, const struct msg_data*, const char *name);
+
+/* Writes out the pending frame, if any. Returns zero or errno. */
+int rdm_flush(struct rdm_sender*);
+
+/* Returns True if there are messages waiting to be flushed */
+#define rdm_pending(s) ((s)->nrecs)
+
+/* Queued frame data not written out yet (fd -1 senders) */
+#define rdm_queued(s) ((s)->out + (s)->out_pos)
+#define rdm_queued_len(s) ((s)->out_len - (s)->out_pos)
+
+/* Removes len bytes, that were written out, from the queue */
+void rdm_drain(struct rdm_sender*, size_t len);
+
+/* Initializes the receiver. Returns zero on success, errno otherwise. */
+int rdm_init_receiver(struct rdm_receiver*);
+
+/* Discards any buffered data */
+void rdm_reset_receiver(struct rdm_receiver*);
+
+/*
+ * Reads all data available from a non-blocking fd into the receiver
+ * buffer. Returns zero on success (including when no data is available),
+ * errno otherwise, or EPIPE on EOF.
+ */
+int rdm_receive(struct rdm_receiver*, int fd);
+
+/*
+ * Decodes the next complete message in the buffer. Name is set to the
+ * NUL terminated entry name, or NULL, and remains valid until the next
+ * rdm_next or rdm_receive call. Returns 1 if a message was decoded, 0 if there
+ * isn't a complete one, or -1 if data is malformed or incompatible.
+ */
+int rdm_next(struct rdm_receiver*, struct msg_data*, const char **name);
+
+/* Number of bytes received but not decoded yet */
+#define rdm_buffered(r) ((r)->len - (r)->pos)
+
+/* Returns the tag of the frame the last decoded message came from */
+#define rdm_tag(r) ((r)->tag)
+
+/*
+ * Sets tag to that of the frame the next message is in. Returns 1 if
+ * it's known, or 0 if there isn't enough data buffered to tell.
+ */
+int rdm_peek_tag(struct rdm_receiver*, unsigned int *tag);
+
+#endif /* RDMSG_H */
@@ -70,6 +70,7 @@ static int find_type_rec(const struct parser_state*,const char*);
 static int match_name_pat(const char*, struct file_type_rec*);
 static int match_content_pat(const char*, struct file_type_rec*);
 static int probe_contents(const char *fname);
+static unsigned int hash_bytes(unsigned int, const void*, size_t);
 
 /* 
  * Gets next line from parser buffer skipping comments and empty lines. 
@@ -593,6 +594,35 @@ void db_free(struct file_type_db *db)
 	memset(db, 0, sizeof(struct file_type_db));
 }
 
+/*
+ * Hashes everything that decides what a file is matched to, in the order
+ * records are indexed, so that the hash changes with any of that.
+ */
+unsigned int db_hash(struct file_type_db *db)
+{
+	unsigned int hash = 2166136261u; /* FNV-1a offset basis */
+	unsigned int i, j;
+	
+	for(i = 0; i < db->count; i++) {
+		struct file_type_rec *rec = &db->recs[i];
+		
+		hash = hash_bytes(hash, rec->name, strlen(rec->name) + 1);
+		hash = hash_bytes(hash, &rec->priority, sizeof(unsigned int));
+		
+		for(j = 0; j < rec->nname_pat; j++) {
+			hash = hash_bytes(hash, rec->name_pat[j],
+				strlen(rec->name_pat[j]) + 1);
+		}
+		for(j = 0; j < rec->ncontent_pat; j++) {
+			struct content_pattern_rec *cp = &rec->content_pat[j];
+			
+			hash = hash_bytes(hash, &cp->offset, sizeof(unsigned long));
+			hash = hash_bytes(hash, cp->data, cp->data_len);
+		}
+	}
+	return hash;
+}
+
 /*
  * Matches db rec's name patterns against file name specified.
  * Returns non zero if match is found.
@@ -686,12 +716,46 @@ int db_match(const char *name, struct file_type_db *db)
 	return c;
 }
 
+int db_match_name(const char *name, struct file_type_db *db)
+{
+	int i, n, p;
+	int c = DB_UNKNOWN;
+	int nlast = 0;
+	int plast = 0;
+	
+	for(i = 0; i < db->count; i++) {
+		n = match_name_pat(name, &db->recs[i]);
+		p = db->recs[i].priority;
+
+		if(n > nlast || (n && p >= plast)) {
+			plast = p;
+			nlast = n;
+			c = i;
+		}
+	}
+	return c;
+}
+
 struct file_type_rec* db_get_record(struct file_type_db *db, int index)
 {
 	if(index < 0 || index > db->count) return NULL;
 	return &db->recs[index];
 }
 
+/*
+ * FNV-1a hash step over len bytes
+ */
+static unsigned int hash_bytes(unsigned int hash, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+	
+	while(len--) {
+		hash ^= *p++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
 /*
  * For files that are not matched by type DB we'd like at least to know
  * whether these are text or binary. This here patented ass-u-me algorithm
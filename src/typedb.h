@@ -96,6 +96,18 @@ void db_free(struct file_type_db *db);
  */
 int db_match(const char *file_name, struct file_type_db *db);
 
+/*
+ * Same as db_match, except that only name patterns are considered, and
+ * the file is never opened. Used where reading files is too expensive.
+ */
+int db_match_name(const char *file_name, struct file_type_db *db);
+
+/*
+ * Returns a hash of the database contents, which changes whenever the
+ * records, or what these are matched by, do.
+ */
+unsigned int db_hash(struct file_type_db *db);
+
 /*
  * Safe type record retrieval routine.
  * Returns NULL if index is invalid.
@@ -0,0 +1,815 @@
+/*
+ * Copyright (C) 2026 alx@fastestcode.org
+ * This software is distributed under the terms of the X/MIT license.
+ * See the included COPYING file for further information.
+ */
+
+/*
+ * Per-user directory watcher daemon, and the client side of its protocol
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <limits.h>
+#include <time.h>
+#include <poll.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#include "watchd.h"
+#include "dirtab.h"
+#include "fsutil.h"
+#include "fspolicy.h"
+#include "const.h"
+#include "debug.h"
+
+/* Changes are reported at most this often (in ms), so that subscribers
+ * don't reread the directory for each file in a batch of changes */
+#ifndef WD_REPORT_DELAY
+#define WD_REPORT_DELAY 200
+#endif
+
+/* Number of entries of an unchanged directory checked per poll */
+#ifndef WD_POLL_SLICE
+#define WD_POLL_SLICE 256
+#endif
+
+/* Number of polls an entry that changed is checked on every time */
+#ifndef WD_HOT_POLLS
+#define WD_HOT_POLLS 8
+#endif
+
+/* Polled directories are reread in full every this many polls */
+#ifndef WD_POLL_FULL
+#define WD_POLL_FULL 16
+#endif
+
+/* Unchanged directories are polled at up to this many times
+ * the base interval, as in the reader */
+#ifndef WD_BACKOFF_MAX
+#define WD_BACKOFF_MAX 16
+#endif
+
+#ifdef __linux__
+#define WD_NOTIFY_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | \
+	IN_MOVED_TO | IN_ATTRIB | IN_CLOSE_WRITE | IN_DELETE_SELF | \
+	IN_MOVE_SELF | IN_ONLYDIR)
+#define WD_NOTIFY_BUFSIZ 4096
+#endif
+
+/* Shared directory watch */
+struct wd_watch {
+	struct wd_watch *next;
+	dev_t dev;
+	ino_t ino;
+	char *path;
+	unsigned int nsubs;
+	int notify_wd; /* inotify watch descriptor, -1 if polled */
+	int changed; /* not reported to subscribers yet */
+
+	/* polling state, see poll_watch */
+	struct dir_tab list;
+	time_t mtime;
+	time_t ctime;
+	time_t time; /* when these were taken */
+	size_t poll_next;
+	unsigned int npolls; /* partial polls since the last full reread */
+	long base; /* polling interval in ms */
+	long interval;
+	struct timespec next_poll;
+};
+
+/* Client connection */
+struct wd_client {
+	struct wd_client *next;
+	int fd;
+	struct wd_watch *watch; /* subscribed to, may be NULL */
+	size_t len; /* of the request read so far */
+	char buf[sizeof(struct wd_request) + PATH_MAX];
+};
+
+/* Local prototypes */
+static int socket_address(struct sockaddr_un*);
+static int listen_socket(void);
+static void accept_client(void);
+static void drop_client(struct wd_client*);
+static int read_request(struct wd_client*);
+static void subscribe(struct wd_client*, const char*);
+static void unsubscribe(struct wd_client*);
+static struct wd_watch* add_watch(const char*, const struct stat*);
+static void free_watch(struct wd_watch*);
+static int load_entries(struct wd_watch*);
+static void poll_watch(struct wd_watch*);
+static void set_changed(struct wd_watch*);
+static void report_changes(void);
+static void send_heartbeats(void);
+static void send_event(struct wd_client*, dev_t, ino_t);
+#ifdef __linux__
+static void read_notify_events(void);
+#endif
+static void add_msecs(struct timespec*, long);
+static long msecs_until(const struct timespec*);
+
+/* Daemon globals */
+static struct wd_watch *watches = NULL;
+static struct wd_client *clients = NULL;
+static int listen_fd = -1;
+static int notify_fd = -1;
+static int nchanged = 0; /* watches with unreported changes */
+static struct timespec report_time;
+static struct timespec heartbeat_time;
+
+/* Client side event buffer; events may arrive split */
+static char ev_buf[sizeof(struct wd_event)];
+static size_t ev_len = 0;
+
+int watchd_main(void)
+{
+	struct sockaddr_un addr;
+	struct pollfd *pfd = NULL;
+	size_t pfd_size = 0;
+
+	if(socket_address(&addr)) {
+		fputs("xfile: XDG_RUNTIME_DIR isn't set, or is too long\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+
+	listen_fd = listen_socket();
+	if(listen_fd == -1) return EXIT_FAILURE;
+
+	#ifdef __linux__
+	notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	#endif
+
+	clock_gettime(CLOCK_MONOTONIC, &heartbeat_time);
+	add_msecs(&heartbeat_time, WATCHD_HEARTBEAT);
+
+	for(;;) {
+		struct wd_watch *w;
+		struct wd_client *c;
+		size_t n = 0, i;
+		int timeout = -1;
+
+		for(i = 2, c = clients; c; c = c->next) i++;
+		if(i > pfd_size) {
+			struct pollfd *p = realloc(pfd, i * sizeof(struct pollfd));
+			if(!p) {
+				fputs("xfile: out of memory\n", stderr);
+				return EXIT_FAILURE;
+			}
+			pfd = p;
+			pfd_size = i;
+		}
+
+		pfd[n].fd = listen_fd;
+		pfd[n++].events = POLLIN;
+		pfd[n].fd = notify_fd;
+		pfd[n++].events = POLLIN;
+
+		for(c = clients; c; c = c->next) {
+			pfd[n].fd = c->fd;
+			pfd[n++].events = POLLIN;
+		}
+		for(i = 0; i < n; i++) pfd[i].revents = 0;
+
+		/* wake up for whichever poll, or report, is due first */
+		for(w = watches; w; w = w->next) {
+			if(w->notify_wd == -1) {
+				long ms = msecs_until(&w->next_poll);
+				if(timeout == -1 || ms < timeout) timeout = ms;
+			}
+		}
+		if(nchanged) {
+			long ms = msecs_until(&report_time);
+			if(timeout == -1 || ms < timeout) timeout = ms;
+		}
+		if(clients) {
+			long ms = msecs_until(&heartbeat_time);
+			if(timeout == -1 || ms < timeout) timeout = ms;
+		}
+
+		if(poll(pfd, n, timeout) == -1 && errno != EINTR) {
+			perror("xfile: poll");
+			return EXIT_FAILURE;
+		}
+
+		if(pfd[0].revents) accept_client();
+
+		#ifdef __linux__
+		if(pfd[1].revents) read_notify_events();
+		#endif
+
+		/* clients accepted just now aren't in pfd */
+		for(i = 2; i < n; i++) {
+			if(!pfd[i].revents) continue;
+
+			for(c = clients; c && c->fd != pfd[i].fd; c = c->next);
+			if(c && read_request(c)) drop_client(c);
+		}
+
+		for(w = watches; w; w = w->next) {
+			if(w->notify_wd == -1 && !msecs_until(&w->next_poll))
+				poll_watch(w);
+		}
+
+		if(nchanged && !msecs_until(&report_time)) report_changes();
+		
+		/* these stop coming while polling a directory that doesn't
+		 * respond, and subscribers go back to polling on their own */
+		if(!msecs_until(&heartbeat_time)) send_heartbeats();
+	}
+	return EXIT_SUCCESS;
+}
+
+int watchd_connect(void)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if(socket_address(&addr)) return -1;
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd == -1) return -1;
+
+	if(connect(fd, (struct sockaddr*)&addr, sizeof(struct sockaddr_un))) {
+		close(fd);
+		return -1;
+	}
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	ev_len = 0;
+
+	return fd;
+}
+
+int watchd_watch(int fd, const char *path)
+{
+	struct wd_request req;
+	size_t len = strlen(path) + 1;
+	char buf[sizeof(struct wd_request) + len];
+
+	if(len > PATH_MAX) return ENAMETOOLONG;
+
+	req.code = WDR_WATCH;
+	req.len = len;
+	memcpy(buf, &req, sizeof(struct wd_request));
+	memcpy(buf + sizeof(struct wd_request), path, len);
+
+	errno = 0;
+	if(writen(fd, buf, sizeof(buf)) != (ssize_t)sizeof(buf))
+		return errno ? errno : EPIPE;
+
+	return 0;
+}
+
+int watchd_unwatch(int fd)
+{
+	struct wd_request req;
+
+	req.code = WDR_UNWATCH;
+	req.len = 0;
+
+	errno = 0;
+	if(writen(fd, &req, sizeof(struct wd_request)) !=
+		sizeof(struct wd_request)) return errno ? errno : EPIPE;
+
+	return 0;
+}
+
+int watchd_read_events(int fd)
+{
+	char buf[sizeof(struct wd_event) * 64];
+	ssize_t n;
+	size_t i;
+	int match = 0;
+
+	/* called when there's data, so this won't block */
+	n = read(fd, buf, sizeof(buf));
+	if(n == -1 && errno == EINTR) return 0;
+	if(n <= 0) return -1;
+
+	for(i = 0; i < (size_t)n; i++) {
+		ev_buf[ev_len++] = buf[i];
+
+		if(ev_len == sizeof(struct wd_event)) {
+			struct wd_event evt;
+
+			memcpy(&evt, ev_buf, sizeof(struct wd_event));
+			ev_len = 0;
+			if(evt.dev || evt.ino) match = 1;
+		}
+	}
+	return match;
+}
+
+/*
+ * Fills in the socket address. Returns zero on success, errno otherwise.
+ */
+static int socket_address(struct sockaddr_un *addr)
+{
+	const char *dir = getenv("XDG_RUNTIME_DIR");
+
+	if(!dir || !dir[0]) return ENOENT;
+
+	memset(addr, 0, sizeof(struct sockaddr_un));
+	addr->sun_family = AF_UNIX;
+
+	if(snprintf(addr->sun_path, sizeof(addr->sun_path), "%s/%s",
+		dir, WATCHD_SOCKET) >= (int)sizeof(addr->sun_path))
+		return ENAMETOOLONG;
+
+	return 0;
+}
+
+/*
+ * Creates the listening socket, unless another daemon is listening on it
+ * already. Returns the socket descriptor, or -1 on failure.
+ */
+static int listen_socket(void)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	socket_address(&addr);
+
+	fd = watchd_connect();
+	if(fd != -1) {
+		close(fd);
+		fputs("xfile: the watcher daemon is running already\n", stderr);
+		return -1;
+	}
+
+	/* left over by one that didn't exit cleanly */
+	unlink(addr.sun_path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd == -1) {
+		perror("xfile: socket");
+		return -1;
+	}
+
+	if(bind(fd, (struct sockaddr*)&addr, sizeof(struct sockaddr_un)) ||
+		listen(fd, 16)) {
+		fprintf(stderr, "xfile: %s: %s\n", addr.sun_path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+	return fd;
+}
+
+static void accept_client(void)
+{
+	struct wd_client *c;
+	int fd;
+
+	fd = accept(listen_fd, NULL, NULL);
+	if(fd == -1) return;
+
+	c = calloc(1, sizeof(struct wd_client));
+	if(!c) {
+		close(fd);
+		return;
+	}
+
+	/* events are dropped rather than waiting for a client that
+	 * doesn't read these; there's one pending for it then anyway */
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+	c->fd = fd;
+	c->next = clients;
+	clients = c;
+	dbg_trace("watchd: client %d connected\n", fd);
+}
+
+static void drop_client(struct wd_client *c)
+{
+	struct wd_client **p;
+
+	dbg_trace("watchd: client %d gone\n", c->fd);
+
+	for(p = &clients; *p && *p != c; p = &(*p)->next);
+	if(*p) *p = c->next;
+
+	unsubscribe(c);
+	close(c->fd);
+	free(c);
+}
+
+/*
+ * Reads and processes client requests. Returns non-zero if the client
+ * is to be dropped (disconnected, or sent something that doesn't parse).
+ */
+static int read_request(struct wd_client *c)
+{
+	ssize_t n;
+
+	n = read(c->fd, c->buf + c->len, sizeof(c->buf) - c->len);
+	if(n == -1) return (errno == EAGAIN || errno == EINTR) ? 0 : 1;
+	if(n == 0) return 1;
+	c->len += n;
+
+	while(c->len >= sizeof(struct wd_request)) {
+		struct wd_request req;
+		size_t size;
+
+		memcpy(&req, c->buf, sizeof(struct wd_request));
+		if(req.len > PATH_MAX) return 1;
+
+		size = sizeof(struct wd_request) + req.len;
+		if(c->len < size) break;
+
+		if(req.code == WDR_WATCH) {
+			char *path = c->buf + sizeof(struct wd_request);
+
+			if(!req.len || path[req.len - 1]) return 1;
+			subscribe(c, path);
+		} else if(req.code == WDR_UNWATCH) {
+			unsubscribe(c);
+		} else {
+			return 1;
+		}
+
+		c->len -= size;
+		if(c->len) memmove(c->buf, c->buf + size, c->len);
+	}
+	return 0;
+}
+
+/*
+ * Subscribes the client to the directory at path, setting up a watch for
+ * it unless there is one for the same directory already
+ */
+static void subscribe(struct wd_client *c, const char *path)
+{
+	struct wd_watch *w;
+	struct stat st;
+
+	unsubscribe(c);
+
+	/* the client finds out on its own if it's gone */
+	if(stat(path, &st) == -1 || !S_ISDIR(st.st_mode)) return;
+
+	for(w = watches; w; w = w->next) {
+		if(w->dev == st.st_dev && w->ino == st.st_ino) break;
+	}
+
+	if(!w) {
+		w = add_watch(path, &st);
+		if(!w) return;
+	}
+
+	w->nsubs++;
+	c->watch = w;
+	dbg_trace("watchd: %d watching %s (%u)\n", c->fd, w->path, w->nsubs);
+}
+
+/*
+ * Cancels the client's subscription, removing the watch if it was the
+ * only one subscribed to it
+ */
+static void unsubscribe(struct wd_client *c)
+{
+	struct wd_watch *w = c->watch;
+	struct wd_watch **p;
+
+	if(!w) return;
+	c->watch = NULL;
+
+	if(--w->nsubs) return;
+
+	for(p = &watches; *p && *p != w; p = &(*p)->next);
+	if(*p) *p = w->next;
+
+	free_watch(w);
+}
+
+/*
+ * Sets up a watch for the directory. It's watched with inotify where
+ * available and the file system policy allows that, and polled otherwise.
+ */
+static struct wd_watch* add_watch(const char *path, const struct stat *st)
+{
+	struct wd_watch *w;
+	int fs_class = FSC_LOCAL;
+	int fd;
+
+	w = calloc(1, sizeof(struct wd_watch));
+	if(!w) return NULL;
+
+	w->path = strdup(path);
+	if(!w->path || dtab_init(&w->list)) {
+		free(w->path);
+		free(w);
+		return NULL;
+	}
+	w->dev = st->st_dev;
+	w->ino = st->st_ino;
+	w->notify_wd = -1;
+
+	fd = open(path, O_RDONLY);
+	if(fd != -1) {
+		fs_class = get_fs_class(fd);
+		close(fd);
+	}
+
+	#ifdef __linux__
+	if(notify_fd != -1 && (fs_policies[fs_class].flags & FSP_NOTIFY))
+		w->notify_wd = inotify_add_watch(notify_fd, path, WD_NOTIFY_MASK);
+	#endif
+
+	if(w->notify_wd == -1) {
+		w->base = DEF_REFRESH_INT * 1000L * fs_policies[fs_class].interval;
+		w->interval = w->base;
+		load_entries(w);
+		clock_gettime(CLOCK_MONOTONIC, &w->next_poll);
+		add_msecs(&w->next_poll, w->interval);
+	}
+
+	w->next = watches;
+	watches = w;
+
+	return w;
+}
+
+static void free_watch(struct wd_watch *w)
+{
+	dbg_trace("watchd: %s no longer watched\n", w->path);
+
+	#ifdef __linux__
+	if(w->notify_wd != -1) inotify_rm_watch(notify_fd, w->notify_wd);
+	#endif
+
+	if(w->changed) nchanged--;
+	dtab_free(&w->list);
+	free(w->path);
+	free(w);
+}
+
+/*
+ * Reads the polled directory into the watch list, recording its own
+ * times and each entry's. Returns zero on success, errno otherwise.
+ */
+static int load_entries(struct wd_watch *w)
+{
+	struct dirent *ent;
+	struct stat st;
+	DIR *dir;
+
+	w->time = time(NULL);
+	dtab_clear(&w->list);
+
+	dir = opendir(w->path);
+	if(!dir) return errno;
+
+	if(fstat(dirfd(dir), &st) == -1) {
+		int errv = errno;
+		closedir(dir);
+		return errv;
+	}
+	w->mtime = st.st_mtime;
+	w->ctime = st.st_ctime;
+
+	while((ent = readdir(dir))) {
+		struct dir_rec *rec;
+
+		if(!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
+			continue;
+
+		rec = dtab_add(&w->list, ent->d_name);
+		if(!rec) break;
+
+		if(!fstatat(dirfd(dir), ent->d_name, &st, AT_SYMLINK_NOFOLLOW)) {
+			rec->mtime = st.st_mtime;
+			rec->ctime = st.st_ctime;
+			rec->size = st.st_size;
+		}
+	}
+	closedir(dir);
+	w->poll_next = 0;
+	w->npolls = 0;
+
+	return 0;
+}
+
+/*
+ * Polls the directory for changes, much like the reader's poll_directory
+ * does: the directory is reread if its times changed, and otherwise only
+ * a slice of entries is checked, along with those that changed recently.
+ */
+static void poll_watch(struct wd_watch *w)
+{
+	struct stat st;
+	int changed = 0;
+
+	if(stat(w->path, &st) == -1) {
+		/* reported once, until it's back */
+		changed = (w->mtime || w->ctime);
+		w->mtime = w->ctime = 0;
+		dtab_clear(&w->list);
+	} else if(++w->npolls >= WD_POLL_FULL ||
+		st.st_dev != w->dev || st.st_ino != w->ino ||
+		st.st_mtime != w->mtime || st.st_ctime != w->ctime ||
+		w->mtime >= w->time || w->ctime >= w->time) {
+		/* racy times may hide changes, and so may the slices, so
+		 * subscribers are told to reread in either case, as readers
+		 * watching the directory on their own would */
+		w->dev = st.st_dev;
+		w->ino = st.st_ino;
+		load_entries(w);
+		changed = 1;
+	} else if(w->list.nrecs) {
+		int dfd = open(w->path, O_RDONLY);
+		size_t i, nslice, nrecs = w->list.nrecs;
+
+		if(dfd == -1) {
+			changed = 1;
+		} else {
+			if(w->poll_next >= nrecs) w->poll_next = 0;
+			nslice = (nrecs < WD_POLL_SLICE) ? nrecs : WD_POLL_SLICE;
+
+			for(i = 0; i < nrecs; i++) {
+				struct dir_rec *rec = &w->list.recs[i];
+
+				/* records at poll_next and on, wrapping around */
+				if(!rec->hot && ((i + nrecs - w->poll_next) % nrecs) >= nslice)
+					continue;
+
+				if(fstatat(dfd, dtab_name(&w->list, rec),
+					&st, AT_SYMLINK_NOFOLLOW) == -1) {
+					changed = 1;
+				} else if(st.st_mtime != rec->mtime ||
+					st.st_ctime != rec->ctime || st.st_size != rec->size) {
+					rec->mtime = st.st_mtime;
+					rec->ctime = st.st_ctime;
+					rec->size = st.st_size;
+					rec->hot = WD_HOT_POLLS;
+					changed = 1;
+				} else if(rec->hot) {
+					rec->hot--;
+				}
+			}
+			w->poll_next += nslice;
+			close(dfd);
+		}
+	}
+
+	if(changed) {
+		w->interval = w->base;
+		set_changed(w);
+	} else if(w->interval < w->base * WD_BACKOFF_MAX) {
+		w->interval *= 2;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &w->next_poll);
+	add_msecs(&w->next_poll, w->interval);
+}
+
+/*
+ * Marks the watch as changed, to be reported after WD_REPORT_DELAY
+ */
+static void set_changed(struct wd_watch *w)
+{
+	if(w->changed) return;
+
+	w->changed = 1;
+	if(!nchanged++) {
+		clock_gettime(CLOCK_MONOTONIC, &report_time);
+		add_msecs(&report_time, WD_REPORT_DELAY);
+	}
+}
+
+/*
+ * Sends an event to clients subscribed to watches that changed
+ */
+static void report_changes(void)
+{
+	struct wd_client *c, *next;
+	struct wd_watch *w;
+
+	for(c = clients; c; c = next) {
+		next = c->next;
+		if(c->watch && c->watch->changed)
+			send_event(c, c->watch->dev, c->watch->ino);
+	}
+
+	for(w = watches; w; w = w->next) w->changed = 0;
+	nchanged = 0;
+}
+
+/*
+ * Sends a heartbeat to all subscribers, and schedules the next one
+ */
+static void send_heartbeats(void)
+{
+	struct wd_client *c, *next;
+
+	for(c = clients; c; c = next) {
+		next = c->next;
+		if(c->watch) send_event(c, 0, 0);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &heartbeat_time);
+	add_msecs(&heartbeat_time, WATCHD_HEARTBEAT);
+}
+
+/*
+ * Sends an event to the client, dropping it if that fails
+ */
+static void send_event(struct wd_client *c, dev_t dev, ino_t ino)
+{
+	struct wd_event evt;
+	ssize_t n;
+
+	memset(&evt, 0, sizeof(struct wd_event));
+	evt.dev = dev;
+	evt.ino = ino;
+
+	/* a full buffer means it has events to read already */
+	n = write(c->fd, &evt, sizeof(struct wd_event));
+	if(n == -1 && errno != EAGAIN && errno != EINTR) {
+		drop_client(c);
+	} else if(n > 0 && n < (ssize_t)sizeof(struct wd_event)) {
+		/* can't be completed without blocking */
+		drop_client(c);
+	}
+}
+
+#ifdef __linux__
+/*
+ * Reads inotify events, marking watches they pertain to as changed
+ */
+static void read_notify_events(void)
+{
+	char buffer[WD_NOTIFY_BUFSIZ]
+		__attribute__((aligned(__alignof__(struct inotify_event))));
+	ssize_t len;
+
+	while((len = read(notify_fd, buffer, WD_NOTIFY_BUFSIZ)) > 0) {
+		char *p;
+
+		for(p = buffer; p < buffer + len; ) {
+			struct inotify_event *evt = (struct inotify_event*)p;
+			struct wd_watch *w;
+
+			p += sizeof(struct inotify_event) + evt->len;
+
+			for(w = watches; w; w = w->next) {
+				if(w->notify_wd != evt->wd) continue;
+
+				/* removed along with the directory; poll it instead,
+				 * so that subscribers find out when it's back */
+				if(evt->mask & IN_IGNORED) {
+					w->notify_wd = -1;
+					w->base = DEF_REFRESH_INT * 1000L;
+					w->interval = w->base;
+					clock_gettime(CLOCK_MONOTONIC, &w->next_poll);
+				}
+
+				set_changed(w);
+				break;
+			}
+		}
+	}
+}
+#endif /* __linux__ */
+
+static void add_msecs(struct timespec *ts, long ms)
+{
+	ts->tv_sec += ms / 1000;
+	ts->tv_nsec += (ms % 1000) * 1000000L;
+	if(ts->tv_nsec >= 1000000000L) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000L;
+	}
+}
+
+/*
+ * Returns milliseconds until the time specified, or zero if it's past
+ */
+static long msecs_until(const struct timespec *ts)
+{
+	struct timespec now;
+	long ms;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	ms = (ts->tv_sec - now.tv_sec) * 1000L +
+		(ts->tv_nsec - now.tv_nsec) / 1000000L;
+
+	return (ms > 0) ? ms : 0;
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2026 alx@fastestcode.org
+ * This software is distributed under the terms of the X/MIT license.
+ * See the included COPYING file for further information.
+ */
+
+/*
+ * Per-user directory watcher daemon (xfile -watchd). Directory readers of
+ * all xfile instances may have the daemon watch directories for them over
+ * a UNIX socket in $XDG_RUNTIME_DIR, so that a directory shown in several
+ * windows is watched, or polled, once. Watches are shared by directory
+ * identity (device and inode), and subscribers are told when anything in
+ * the directory changed, whereupon these reread it on their own. Each
+ * connection is subscribed to one directory at a time. Readers only use
+ * the daemon for directories they would otherwise poll, since inotify
+ * watches cost next to nothing, and tell what changed. These are watched
+ * by readers themselves when the daemon isn't running, or doesn't respond,
+ * which subscribers tell by heartbeats it sends every WATCHD_HEARTBEAT ms.
+ */
+
+#ifndef WATCHD_H
+#define WATCHD_H
+
+#include <sys/types.h>
+
+/* Socket name, in $XDG_RUNTIME_DIR */
+#define WATCHD_SOCKET "xfile-watchd"
+
+/* Interval, in ms, at which subscribers are sent heartbeats */
+#ifndef WATCHD_HEARTBEAT
+#define WATCHD_HEARTBEAT 2000
+#endif
+
+/* Request codes */
+#define WDR_WATCH	1	/* followed by the path */
+#define WDR_UNWATCH	2
+
+struct wd_request {
+	unsigned int code;
+	unsigned int len; /* of the path, including the terminating NUL */
+};
+
+/* Sent to subscribers when the directory changed; both fields
+ * are zero in heartbeats, sent while the daemon is responsive */
+struct wd_event {
+	dev_t dev;
+	ino_t ino;
+};
+
+/* Daemon entry point. Returns the exit status. */
+int watchd_main(void);
+
+/*
+ * Connects to the daemon. Returns the socket descriptor, or -1 if the
+ * daemon isn't running.
+ */
+int watchd_connect(void);
+
+/*
+ * Subscribes to changes in the directory at path, replacing any previous
+ * subscription. Returns zero on success, errno otherwise, in which case
+ * the connection is to be closed.
+ */
+int watchd_watch(int fd, const char *path);
+
+/* Cancels the subscription. Returns zero on success, errno otherwise. */
+int watchd_unwatch(int fd);
+
+/*
+ * Reads events sent by the daemon. Returns 1 if there were any besides
+ * heartbeats, zero if not, or -1 if the daemon is gone. Events for a
+ * directory watched before the current one may still be in the pipeline,
+ * so these may be spurious.
+ */
+int watchd_read_events(int fd);
+
+#endif /* WATCHD_H */